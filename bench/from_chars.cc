@@ -0,0 +1,134 @@
+/* libcsd/bench/from_chars.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/charconv.h>
+#include <libcsd/format.h>
+#include <libcsd/print.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Parses a generated mix of numeric fields, like the columns of a CSV file,
+   with csd::from_chars() and with strtoull(), strtoll() and strtod(), and
+   prints the time per field and the throughput. The sums are printed too,
+   so the two sides can be checked against each other. */
+
+static constexpr int nfields = 1 << 16;
+static constexpr int rounds = 20;
+static constexpr int field_size = 32;
+
+struct field_set
+{
+	char text[nfields][field_size];
+	int len[nfields];
+	size_t bytes;
+};
+
+static double now_ns()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static unsigned long long rng_state = 0x853c49e6748fea9bull;
+
+static unsigned long long random_number()
+{
+	rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+	return rng_state;
+}
+
+static void add_field(field_set& fields, int i, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void add_field(field_set& fields, int i, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	fields.len[i] = vsnprintf(fields.text[i], field_size, fmt, args);
+	fields.bytes += fields.len[i];
+	va_end(args);
+}
+
+/* Unsigned integers of any length, signed ones which are mostly short, and
+   doubles written in the ways a CSV file or a log would have them. */
+static void generate(field_set& unsigned_fields, field_set& signed_fields,
+					 field_set& double_fields)
+{
+	static const char *double_formats[] = {"%.2f", "%.6g", "%.3e", "%.17g"};
+	unsigned long long r;
+	double d;
+
+	for (int i = 0; i < nfields; i++) {
+		r = random_number();
+		d = (double) (r >> 11) * 1e-6;
+
+		add_field(unsigned_fields, i, "%llu", r >> (r % 60));
+		add_field(signed_fields, i, "%lld", (long long) (r % 200001) - 100000);
+		add_field(double_fields, i, double_formats[i % 4], i % 2 ? d : -d);
+	}
+}
+
+template <typename F>
+static void measure(const char *name, const field_set& fields, F parse)
+{
+	double start = now_ns();
+	double sum = 0;
+	double elapsed;
+
+	for (int k = 0; k < rounds; k++) {
+		for (int i = 0; i < nfields; i++)
+			sum += parse(fields.text[i], fields.len[i]);
+	}
+
+	elapsed = now_ns() - start;
+	println(" ", name,
+			csd::format("{:.1f} ns/field, {:.0f} MB/s, sum {}",
+						elapsed / rounds / nfields,
+						fields.bytes * rounds / elapsed * 1e3, sum));
+}
+
+int main()
+{
+	static field_set unsigned_fields;
+	static field_set signed_fields;
+	static field_set double_fields;
+
+	generate(unsigned_fields, signed_fields, double_fields);
+
+	println("unsigned 64-bit integers");
+	measure("from_chars:", unsigned_fields, [](const char *text, int len) {
+		unsigned long long value = 0;
+		csd::from_chars(text, len, &value);
+		return (double) value;
+	});
+	measure("strtoull:  ", unsigned_fields, [](const char *text, int) {
+		return (double) strtoull(text, NULL, 10);
+	});
+
+	println("signed 64-bit integers");
+	measure("from_chars:", signed_fields, [](const char *text, int len) {
+		long long value = 0;
+		csd::from_chars(text, len, &value);
+		return (double) value;
+	});
+	measure("strtoll:   ", signed_fields, [](const char *text, int) {
+		return (double) strtoll(text, NULL, 10);
+	});
+
+	println("doubles");
+	measure("from_chars:", double_fields, [](const char *text, int len) {
+		double value = 0;
+		csd::from_chars(text, len, &value);
+		return value;
+	});
+	measure("strtod:    ", double_fields, [](const char *text, int) {
+		return strtod(text, NULL);
+	});
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+/* libcsd/bench/logger_latency.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/logger.h>
+#include <libcsd/print.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Measures how long a single csd::logger::info() call takes, from several
+   producer threads at once, against fprintf() followed by fflush() on a
+   shared FILE. The producers pause now and then, so the background thread
+   keeps up and the rings never fill.
+
+    logger_latency [threads] [output file]
+
+   The output goes to /dev/null by default, so only the cost seen by the
+   calling thread is measured. */
+
+static constexpr int messages = 200000;
+static constexpr int pause_every = 1000;
+
+struct producer
+{
+	csd::logger *log;
+	FILE *fp;
+	int id;
+	double *latency;
+};
+
+static double now_ns()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void pause_producer()
+{
+	struct timespec wait = {0, 200 * 1000};
+	nanosleep(&wait, NULL);
+}
+
+static void *log_messages(void *arg)
+{
+	producer *p = (producer *) arg;
+	double start;
+
+	for (int i = 0; i < messages; i++) {
+		start = now_ns();
+		p->log->info("thread {} request {} took {:.2f} ms", p->id, i, 1.25);
+		p->latency[i] = now_ns() - start;
+
+		if (i % pause_every == 0)
+			pause_producer();
+	}
+
+	return NULL;
+}
+
+static void *print_messages(void *arg)
+{
+	producer *p = (producer *) arg;
+	double start;
+
+	for (int i = 0; i < messages; i++) {
+		start = now_ns();
+		fprintf(p->fp, "thread %d request %d took %.2f ms\n", p->id, i, 1.25);
+		fflush(p->fp);
+		p->latency[i] = now_ns() - start;
+
+		if (i % pause_every == 0)
+			pause_producer();
+	}
+
+	return NULL;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run(const char *name, csd::thread::fptr_t func, csd::logger *log,
+				FILE *fp, int nthreads)
+{
+	double *latency = new double[(size_t) messages * nthreads];
+	producer *producers = new producer[nthreads];
+	csd::thread *threads = new csd::thread[nthreads];
+	size_t total = (size_t) messages * nthreads;
+
+	for (int i = 0; i < nthreads; i++) {
+		producers[i] = {log, fp, i, latency + (size_t) messages * i};
+		threads[i](func, &producers[i]);
+	}
+
+	for (int i = 0; i < nthreads; i++)
+		threads[i].join();
+
+	qsort(latency, total, sizeof(double), compare_latency);
+	println(name, "p50", (long) latency[total / 2], "ns, p99",
+			(long) latency[total * 99 / 100], "ns, p999",
+			(long) latency[total * 999 / 1000], "ns");
+
+	delete[] threads;
+	delete[] producers;
+	delete[] latency;
+}
+
+int main(int argc, char **argv)
+{
+	int nthreads = argc > 1 ? atoi(argv[1]) : 4;
+	const char *path = argc > 2 ? argv[2] : "/dev/null";
+	csd::file out;
+	FILE *fp;
+
+	if (nthreads < 1) {
+		println_to(2, "usage: logger_latency [threads] [output file]");
+		return 1;
+	}
+
+	println(nthreads, "threads,", messages, "messages each");
+
+	out.open(path, "w");
+	{
+		csd::logger log(out);
+
+		run("logger:        ", (csd::thread::fptr_t) log_messages, &log,
+			nullptr, nthreads);
+		log.flush();
+	}
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		println_to(2, "logger_latency: cannot open", path);
+		return 1;
+	}
+
+	run("fprintf+fflush:", (csd::thread::fptr_t) print_messages, nullptr,
+		fp, nthreads);
+	fclose(fp);
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/* libcsd/bench/pattern.cc
+   Copyright (c) 2024 bellrise */
+
+#include <fnmatch.h>
+#include <libcsd/format.h>
+#include <libcsd/pattern.h>
+#include <libcsd/print.h>
+#include <regex.h>
+#include <time.h>
+
+/* Matches generated log lines and paths with csd::pattern, with a chain of
+   plain find() calls where the pattern allows it, and with glibc regexec()
+   and fnmatch(). Prints the time per line, and how many lines matched, so
+   the results can be compared. */
+
+static constexpr int nlines = 200000;
+
+static double now_ns()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+template <typename F>
+static void measure(const char *name, const list<str>& lines, F matches)
+{
+	double start = now_ns();
+	int count = 0;
+
+	for (const str& line : lines)
+		count += matches(line);
+
+	println(" ", name, (long) ((now_ns() - start) / lines.len()),
+			"ns/line,", count, "matched");
+}
+
+static void bench_regex(const char *name, const char *expr,
+						const list<str>& lines)
+{
+	csd::pattern pattern(expr);
+	regmatch_t match;
+	regex_t re;
+
+	regcomp(&re, expr, REG_EXTENDED);
+	println(name);
+
+	measure("pattern:", lines,
+			[&](const str& line) { return pattern.search(line).is_ok(); });
+	measure("regexec:", lines, [&](const str& line) {
+		return !regexec(&re, line.view().ptr, 1, &match, 0);
+	});
+
+	regfree(&re);
+}
+
+static void bench_glob(const char *name, const char *glob,
+					   const list<str>& lines)
+{
+	csd::pattern pattern(glob, csd::pattern::glob);
+
+	println(name);
+
+	measure("pattern:", lines,
+			[&](const str& line) { return pattern.match(line); });
+	measure("fnmatch:", lines, [&](const str& line) {
+		return !fnmatch(glob, line.view().ptr, 0);
+	});
+}
+
+int main()
+{
+	static const char *levels[] = {"INFO", "DEBUG", "INFO", "WARN", "ERROR"};
+	static const char *dirs[] = {"var", "home", "srv", "opt", "usr"};
+	static const char *exts[] = {"log", "txt", "cc", "json"};
+	list<str> lines;
+	list<str> paths;
+
+	for (int i = 0; i < nlines; i++) {
+		lines.append(csd::format(
+			"{} {} worker-{} handled request /api/v1/items/{} in {}ms "
+			"2024-0{}-1{}",
+			i, levels[i % 61 % 5], i % 7, i * 31,
+			i % 900, 1 + i % 9, i % 10));
+		paths.append(csd::format("/{}/data/{}/file-{}.{}", dirs[i % 5],
+								 i % 97, i, exts[i % 7 % 4]));
+	}
+
+	bench_regex("date regex, search in log lines",
+				"[0-9]{4}-[0-9]{2}-[0-9]{2}", lines);
+
+	bench_regex("literal alternatives, search in log lines", "ERROR|WARN",
+				lines);
+	measure("find():", lines, [](const str& line) {
+		return line.find("ERROR") != -1 || line.find("WARN") != -1;
+	});
+
+	bench_glob("glob, match log lines", "*/items/*[05] in *", lines);
+
+	bench_glob("glob, match paths", "/*/data/*.log", paths);
+	measure("find():", paths, [](const str& line) {
+		return line.view().ends_with(".log") && line.find("/data/") != -1;
+	});
+
+	return 0;
+}
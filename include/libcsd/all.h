@@ -3,18 +3,33 @@
 
 #pragma once
 
+#include <libcsd/arena.h>
 #include <libcsd/args.h>
+#include <libcsd/binlog.h>
 #include <libcsd/box.h>
+#include <libcsd/builder.h>
 #include <libcsd/bytes.h>
+#include <libcsd/cache.h>
+#include <libcsd/charconv.h>
 #include <libcsd/error.h>
 #include <libcsd/file.h>
 #include <libcsd/format.h>
+#include <libcsd/frozen.h>
+#include <libcsd/hash.h>
+#include <libcsd/hashed_str.h>
+#include <libcsd/interner.h>
 #include <libcsd/list.h>
+#include <libcsd/logger.h>
 #include <libcsd/map.h>
 #include <libcsd/maybe.h>
 #include <libcsd/path.h>
+#include <libcsd/pattern.h>
 #include <libcsd/print.h>
+#include <libcsd/replace.h>
+#include <libcsd/rope.h>
 #include <libcsd/routine.h>
+#include <libcsd/shared_str.h>
+#include <libcsd/split.h>
 #include <libcsd/str.h>
 #include <libcsd/stream.h>
 #include <libcsd/thread.h>
@@ -0,0 +1,68 @@
+/* <libcsd/arena.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace csd {
+
+/**
+ * @class arena
+ * Bump allocator. Memory is handed out from large blocks, and is only freed
+ * all at once, when the arena is cleared or destroyed. Allocated memory never
+ * moves, so pointers into the arena stay valid for its whole lifetime.
+ *
+ *  csd::arena arena;
+ *  char *name = arena.copy("hello", 5);   // NUL-terminated copy
+ *
+ * Allocations larger than the block size get their own block.
+ */
+struct arena
+{
+	static constexpr int default_block_size = 4096;
+
+	arena(int block_size = default_block_size);
+	arena(const arena& copied_arena) = delete;
+	arena(arena&& moved_arena);
+	~arena();
+
+	/**
+	 * @method alloc
+	 * Returns `nbytes` of uninitialized memory, aligned to `align` bytes,
+	 * which has to be a power of 2.
+	 */
+	void *alloc(int nbytes, int align = alignof(max_align_t));
+
+	/**
+	 * @method copy
+	 * Copies `len` bytes into the arena, adding a NUL terminator.
+	 */
+	char *copy(const char *ptr, int len);
+
+	/**
+	 * @method used
+	 * Returns the number of bytes handed out by alloc() & copy().
+	 */
+	size_t used() const;
+
+	void clear();
+
+	arena& operator=(const arena& other) = delete;
+
+  private:
+	struct block
+	{
+		block *prev;
+		int size;
+		int used;
+	};
+
+	block *m_top;
+	int m_block_size;
+	size_t m_used;
+
+	block *new_block(int nbytes);
+};
+
+} // namespace csd
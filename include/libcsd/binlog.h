@@ -0,0 +1,217 @@
+/* <libcsd/binlog.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/bytes.h>
+#include <libcsd/file.h>
+#include <libcsd/format.h>
+
+namespace csd {
+
+/**
+ * @concept BinaryLoggable
+ * Any type a binary_log can store as it is: numbers, chars, pointers and
+ * strings. Types which would have to be converted with to_str() first do
+ * not count, as that is what the binary log avoids.
+ */
+template <typename T>
+concept BinaryLoggable = format_kind_of<T>() != format_kind::converted;
+
+/**
+ * @class binary_format<Args...>
+ * A format string registered in a binary_log, returned by add_format().
+ * Records written with it must have arguments of these types.
+ */
+template <typename... Args>
+struct binary_format
+{
+	unsigned short id;
+};
+
+/* The raw bytes of a single argument. Strings are stored as their length,
+   followed by the bytes themselves. */
+template <typename T>
+struct binary_value
+{
+	static constexpr unsigned char stored_size = sizeof(T);
+
+	T value;
+
+	binary_value(const T& arg)
+		: value(arg)
+	{ }
+
+	size_t size() const
+	{
+		return sizeof(T);
+	}
+
+	char *put(char *p) const
+	{
+		__builtin_memcpy(p, &value, sizeof(T));
+		return p + sizeof(T);
+	}
+};
+
+template <typename T>
+	requires(format_kind_of<T>() == format_kind::pointer)
+struct binary_value<T>
+{
+	static constexpr unsigned char stored_size = sizeof(const void *);
+
+	const void *value;
+
+	binary_value(const T& arg)
+		: value(arg)
+	{ }
+
+	size_t size() const
+	{
+		return sizeof(value);
+	}
+
+	char *put(char *p) const
+	{
+		__builtin_memcpy(p, &value, sizeof(value));
+		return p + sizeof(value);
+	}
+};
+
+template <csd::StringLike T>
+struct binary_value<T>
+{
+	static constexpr unsigned char stored_size = 0;
+
+	csd::str_view view;
+
+	binary_value(const T& arg)
+		: view(arg)
+	{ }
+
+	size_t size() const
+	{
+		return sizeof(unsigned) + view.len;
+	}
+
+	char *put(char *p) const
+	{
+		unsigned len = view.len;
+
+		__builtin_memcpy(p, &len, sizeof(len));
+		__builtin_memcpy(p + sizeof(len), view.ptr, len);
+		return p + sizeof(len) + len;
+	}
+};
+
+/**
+ * @class binary_log
+ * Log which defers the formatting. Each format string is registered once,
+ * and gets an ID. A record then only stores that ID and the raw bytes of
+ * its arguments, which is much cheaper than formatting them. The text is
+ * made later, by decode_binary_log() or the csd-binlog tool.
+ *
+ *  csd::binary_log trace;
+ *  auto done = trace.add_format<int, csd::str_view, double>(
+ *      "request {} to {} took {:.2f} ms");
+ *
+ *  trace.write(done, id, path, elapsed);
+ *  ...
+ *  trace.write_to(out);
+ *
+ * The format strings are checked at compile time, like with format(), and
+ * stored in the log itself, so the decoder needs nothing else. The records
+ * have the layout of the machine which wrote them, so the decoder should
+ * run on the same kind of machine. A binary_log is not thread-safe, use one
+ * for each thread.
+ */
+struct binary_log
+{
+	static constexpr int max_formats = 0xffff;
+
+	binary_log();
+	binary_log(const binary_log& copied_log) = delete;
+
+	/**
+	 * @method add_format
+	 * Register a format string for records with the given argument types.
+	 * The definition becomes part of the log, before any record using it.
+	 */
+	template <csd::BinaryLoggable... Args>
+	binary_format<Args...>
+	add_format(const format_string<no_deduce<Args>...>& fmt)
+	{
+		constexpr unsigned char args[] = {
+			(unsigned char) format_kind_of<Args>()...,
+			binary_value<Args>::stored_size..., 0};
+
+		return {add_format_erased(fmt.layout(), args, sizeof...(Args))};
+	}
+
+	/**
+	 * @method write
+	 * Append a record. This only copies the ID and the arguments, and
+	 * allocates only when the log has to grow.
+	 */
+	template <typename... Args>
+	void write(const binary_format<Args...>& format,
+			   const no_deduce<Args>&...args)
+	{
+		write_values(format.id, binary_value<Args>(args)...);
+	}
+
+	/**
+	 * @method write_to
+	 * Write the whole log to the file, and empty it. Later records may be
+	 * written to the end of the same file, as the definitions of their
+	 * formats are already in it. Throws an invalid_operation_exception if
+	 * writing fails, in which case the part not written stays in the log.
+	 */
+	size_t write_to(file& out);
+
+	int size() const;
+	bytes to_bytes() const;
+
+	binary_log& operator=(const binary_log& other) = delete;
+
+  private:
+	bytes m_data;
+	int m_len;
+	int m_nformats;
+
+	unsigned short add_format_erased(const format_layout& layout,
+									 const unsigned char *args, int nargs);
+	void grow(size_t nbytes);
+
+	char *reserve(size_t nbytes)
+	{
+		char *ptr;
+
+		if (nbytes > (size_t) (m_data.size() - m_len))
+			grow(nbytes);
+
+		ptr = (char *) m_data.raw_ptr() + m_len;
+		m_len += nbytes;
+		return ptr;
+	}
+
+	template <typename... Values>
+	void write_values(unsigned short id, const Values&...values)
+	{
+		char *p = reserve(sizeof(id) + (0 + ... + values.size()));
+
+		__builtin_memcpy(p, &id, sizeof(id));
+		p += sizeof(id);
+		((p = values.put(p)), ...);
+	}
+};
+
+/**
+ * @function decode_binary_log
+ * Turn a log written by binary_log back into text, with one line for each
+ * record. A record cut off at the end, like after a crash, is skipped.
+ * Throws an invalid_argument_exception if `data` is not a binary log.
+ */
+str decode_binary_log(const bytes& data);
+
+} // namespace csd
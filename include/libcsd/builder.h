@@ -0,0 +1,101 @@
+/* <libcsd/builder.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/str.h>
+
+/**
+ * @class str_builder
+ * Collects many small pieces of text into one str. Appending to a str
+ * reallocates and copies everything once it outgrows its buffer, while the
+ * builder keeps the text in a chain of chunks, which are never moved. The
+ * first chunk lives inside the builder itself, so short strings do not
+ * touch the heap until finish() is called.
+ *
+ *  str_builder out;
+ *
+ *  out.append("user ").append(name).append(" has ").append(42);
+ *  out += " points";
+ *
+ *  str line = out.finish();    // "user bellrise has 42 points"
+ *
+ * Numbers are written with csd::to_chars() straight into the chunk, and
+ * strings are copied directly, so no temporary str objects are created.
+ * Other types are appended through their to_str() method. finish() returns
+ * everything in one str, allocated with the exact size. If the final size
+ * is roughly known beforehand, pass it as `size_hint`.
+ */
+struct str_builder
+{
+	static constexpr int local_size = 128;
+
+	str_builder(int size_hint = 0);
+	str_builder(const str_builder& copied_builder) = delete;
+	~str_builder();
+
+	int len() const;
+
+	str_builder& append(csd::str_view string);
+	str_builder& append(const char *string);
+	str_builder& append(const str& string);
+	str_builder& append(char c);
+	str_builder& append(int number);
+	str_builder& append(unsigned int number);
+	str_builder& append(long number);
+	str_builder& append(unsigned long number);
+	str_builder& append(long long number);
+	str_builder& append(unsigned long long number);
+	str_builder& append(float number);
+	str_builder& append(double number);
+	str_builder& append(void *pointer);
+
+	template <csd::StringConvertible T>
+	str_builder& append(const T& object)
+	{
+		if constexpr (csd::ImplementsToString<T>)
+			return append(object.to_str());
+		else
+			return append(str(object));
+	}
+
+	template <typename T>
+	str_builder& operator+=(const T& value)
+	{
+		return append(value);
+	}
+
+	/**
+	 * @method finish
+	 * Returns the whole text as a single str. The builder is empty
+	 * afterwards, and may be used again.
+	 */
+	str finish();
+
+	void clear();
+
+	str_builder& operator=(const str_builder& other) = delete;
+
+  private:
+	struct chunk
+	{
+		chunk *next;
+		char *data;
+		int len;
+		int space;
+	};
+
+	chunk m_first; /* points to m_local */
+	chunk *m_last;
+	int m_len;
+	char m_local[local_size];
+
+	/* Returns a pointer to at least `nbytes` of contiguous space at the end
+	   of the text, which becomes a part of it with commit(). */
+	char *reserve(int nbytes);
+	void commit(int nbytes);
+	void add_chunk(int min_space);
+
+	template <typename T>
+	str_builder& append_number(T number);
+};
@@ -32,6 +32,30 @@ struct bytes
 	str as_str() const;
 	bytes copy() const;
 
+	/* UTF-8 helpers, working on the contents as if they were a str_view.
+	   See csd::is_valid_utf8() and friends. */
+	bool is_valid_utf8() const;
+	int count_codepoints() const;
+	csd::codepoint_range codepoints() const;
+	maybe<bytes> to_utf16() const;
+	maybe<bytes> to_utf32() const;
+
+	/**
+	 * @method to_hex
+	 * Returns the contents encoded as lowercase hexadecimal, or as base64
+	 * for to_base64(). from_hex() and from_base64() decode such a text back
+	 * into bytes, returning an empty maybe if it's not strictly valid, see
+	 * csd::hex_decode() and csd::base64_decode().
+	 *
+	 *  str text = payload.to_base64(csd::base64_url);
+	 *  bytes back = bytes::from_base64(text, csd::base64_url).unpack();
+	 */
+	str to_hex() const;
+	str to_base64(csd::base64_variant variant = csd::base64_standard) const;
+	static maybe<bytes> from_hex(csd::str_view text);
+	static maybe<bytes> from_base64(
+		csd::str_view text, csd::base64_variant variant = csd::base64_standard);
+
 	void alloc(int nbytes);
 	void use_static_buffer(byte *raw_ptr, int nbytes);
 	void copy_from(const byte *raw_ptr, int nbytes);
@@ -57,4 +81,5 @@ struct bytes
 	bool m_user_provided;
 
 	int resolve_index(int index) const;
+	csd::str_view view() const;
 };
@@ -0,0 +1,461 @@
+/* <libcsd/cache.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/format.h>
+#include <libcsd/hash.h>
+#include <libcsd/maybe.h>
+#include <libcsd/thread.h>
+#include <time.h>
+
+/**
+ * @class lru_cache<K, V>
+ * Fixed-capacity cache, which evicts the least recently used entry when a
+ * new one does not fit. Both lookup and insertion are O(1): the entries are
+ * kept in a linked list ordered by last use, and indexed by a hash table of
+ * their keys, so K has to be csd::Hashable.
+ *
+ *  lru_cache<str, str> pages(256);
+ *
+ *  maybe<str> page = pages.get(url);
+ *  if (!page.is_ok())
+ *      pages.put(url, render(url));
+ *
+ * Entries may also expire. Pass a default TTL in milliseconds to the
+ * constructor, or a per-entry TTL to put(). An expired entry counts as a
+ * miss, and is removed when it's next looked up. A TTL of 0 means that the
+ * entry never expires.
+ */
+template <csd::Hashable K, typename V>
+struct lru_cache
+{
+	lru_cache(int capacity, long ttl_ms = 0)
+		: m_buckets(nullptr)
+		, m_bucket_mask(0)
+		, m_head(nullptr)
+		, m_tail(nullptr)
+		, m_len(0)
+		, m_capacity(capacity)
+		, m_ttl(ttl_ms)
+		, m_hits(0)
+		, m_misses(0)
+	{
+		int nbuckets = 1;
+
+		if (capacity <= 0) {
+			throw csd::invalid_argument_exception(
+				"lru_cache: capacity must be positive");
+		}
+
+		while (nbuckets < capacity)
+			nbuckets <<= 1;
+
+		m_buckets = new node *[nbuckets];
+		m_bucket_mask = nbuckets - 1;
+
+		for (int i = 0; i < nbuckets; i++)
+			m_buckets[i] = nullptr;
+	}
+
+	lru_cache(const lru_cache& copied_cache) = delete;
+
+	~lru_cache()
+	{
+		clear();
+		delete[] m_buckets;
+	}
+
+	inline int len() const
+	{
+		return m_len;
+	}
+
+	inline int capacity() const
+	{
+		return m_capacity;
+	}
+
+	/**
+	 * @method hits
+	 * Returns the number of get() calls that found a value.
+	 */
+	inline size_t hits() const
+	{
+		return m_hits;
+	}
+
+	/**
+	 * @method misses
+	 * Returns the number of get() calls that found nothing, or found an
+	 * expired value.
+	 */
+	inline size_t misses() const
+	{
+		return m_misses;
+	}
+
+	void reset_stats()
+	{
+		m_hits = 0;
+		m_misses = 0;
+	}
+
+	/**
+	 * @method get
+	 * Returns the value stored at `key`, marking it as the most recently
+	 * used one. Returns an empty maybe<V> on a miss.
+	 */
+	maybe<V> get(const K& key)
+	{
+		node *n = find_node(key, csd::hash(key));
+
+		if (n && is_expired(n)) {
+			erase_node(n);
+			n = nullptr;
+		}
+
+		if (!n) {
+			m_misses++;
+			return {};
+		}
+
+		m_hits++;
+		move_to_front(n);
+		return n->value;
+	}
+
+	/**
+	 * @method has_key
+	 * Check if a live value is stored at `key`. This does not change the
+	 * usage order nor the hit/miss counters.
+	 */
+	bool has_key(const K& key) const
+	{
+		node *n = find_node(key, csd::hash(key));
+		return n && !is_expired(n);
+	}
+
+	/**
+	 * @method put
+	 * Store `value` at `key`, replacing the previous value if there was
+	 * one. If the cache is full, the least recently used entry is evicted.
+	 */
+	lru_cache& put(const K& key, const V& value)
+	{
+		return put(key, value, m_ttl);
+	}
+
+	lru_cache& put(const K& key, const V& value, long ttl_ms)
+	{
+		size_t key_hash = csd::hash(key);
+		node *n = find_node(key, key_hash);
+
+		if (n) {
+			n->value = value;
+			n->expires_at = ttl_ms ? now_ms() + ttl_ms : 0;
+			move_to_front(n);
+			return *this;
+		}
+
+		if (m_len == m_capacity) {
+			/* Re-use the evicted node, so a full cache does not
+			   allocate on every miss. */
+			n = m_tail;
+			unlink_bucket(n);
+			unlink_list(n);
+			n->key = key;
+			n->value = value;
+		} else {
+			n = new node {key, value, 0, 0, nullptr, nullptr, nullptr};
+			m_len++;
+		}
+
+		n->hash = key_hash;
+		n->expires_at = ttl_ms ? now_ms() + ttl_ms : 0;
+		link_bucket(n);
+		link_front(n);
+
+		return *this;
+	}
+
+	/**
+	 * @method remove
+	 * Remove the value at `key`. Returns true if there was such a value.
+	 */
+	bool remove(const K& key)
+	{
+		node *n = find_node(key, csd::hash(key));
+
+		if (!n)
+			return false;
+
+		erase_node(n);
+		return true;
+	}
+
+	void clear()
+	{
+		node *n = m_head;
+
+		while (n) {
+			node *next = n->next;
+			delete n;
+			n = next;
+		}
+
+		for (int i = 0; i <= m_bucket_mask; i++)
+			m_buckets[i] = nullptr;
+
+		m_head = nullptr;
+		m_tail = nullptr;
+		m_len = 0;
+	}
+
+	str to_str() const
+	{
+		return csd::format("<lru_cache len={} capacity={} hits={} misses={}>",
+						   m_len, m_capacity, m_hits, m_misses);
+	}
+
+	lru_cache& operator=(const lru_cache& other) = delete;
+
+  private:
+	struct node
+	{
+		K key;
+		V value;
+		size_t hash;
+		long expires_at;
+		node *prev;  /* more recently used */
+		node *next;  /* less recently used */
+		node *chain; /* next node in the same bucket */
+	};
+
+	node **m_buckets;
+	int m_bucket_mask;
+	node *m_head;
+	node *m_tail;
+	int m_len;
+	int m_capacity;
+	long m_ttl;
+	size_t m_hits;
+	size_t m_misses;
+
+	static long now_ms()
+	{
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	}
+
+	static bool is_expired(const node *n)
+	{
+		return n->expires_at && n->expires_at <= now_ms();
+	}
+
+	node *find_node(const K& key, size_t key_hash) const
+	{
+		node *n = m_buckets[key_hash & m_bucket_mask];
+
+		while (n) {
+			if (n->hash == key_hash && n->key == key)
+				return n;
+			n = n->chain;
+		}
+
+		return nullptr;
+	}
+
+	void link_bucket(node *n)
+	{
+		node **bucket = &m_buckets[n->hash & m_bucket_mask];
+
+		n->chain = *bucket;
+		*bucket = n;
+	}
+
+	void unlink_bucket(node *n)
+	{
+		node **slot = &m_buckets[n->hash & m_bucket_mask];
+
+		while (*slot != n)
+			slot = &(*slot)->chain;
+		*slot = n->chain;
+	}
+
+	void link_front(node *n)
+	{
+		n->prev = nullptr;
+		n->next = m_head;
+
+		if (m_head)
+			m_head->prev = n;
+		m_head = n;
+
+		if (!m_tail)
+			m_tail = n;
+	}
+
+	void unlink_list(node *n)
+	{
+		if (n->prev)
+			n->prev->next = n->next;
+		else
+			m_head = n->next;
+
+		if (n->next)
+			n->next->prev = n->prev;
+		else
+			m_tail = n->prev;
+	}
+
+	void move_to_front(node *n)
+	{
+		if (m_head == n)
+			return;
+
+		unlink_list(n);
+		link_front(n);
+	}
+
+	void erase_node(node *n)
+	{
+		unlink_bucket(n);
+		unlink_list(n);
+		delete n;
+		m_len--;
+	}
+};
+
+/**
+ * @class concurrent_lru_cache<K, V, Shards>
+ * Thread-safe variant of lru_cache. The keys are spread over `Shards`
+ * separate caches, each guarded by its own lock, so threads only wait for
+ * each other when they touch the same shard. The capacity is split evenly
+ * between the shards, which means that the eviction order is LRU within a
+ * single shard, not across the whole cache. Each shard needs room for at
+ * least one entry, so the capacity may not be smaller than `Shards`.
+ */
+template <csd::Hashable K, typename V, int Shards = 16>
+struct concurrent_lru_cache
+{
+	static_assert(Shards > 0);
+
+	concurrent_lru_cache(int capacity, long ttl_ms = 0)
+	{
+		if (capacity < Shards) {
+			throw csd::invalid_argument_exception(
+				"concurrent_lru_cache: capacity is smaller than the number "
+				"of shards");
+		}
+
+		for (int i = 0; i < Shards; i++) {
+			m_shards[i] = new lru_cache<K, V>(
+				capacity / Shards + (i < capacity % Shards), ttl_ms);
+		}
+	}
+
+	concurrent_lru_cache(const concurrent_lru_cache& copied_cache) = delete;
+
+	~concurrent_lru_cache()
+	{
+		for (int i = 0; i < Shards; i++)
+			delete m_shards[i];
+	}
+
+	maybe<V> get(const K& key)
+	{
+		int i = shard_index(key);
+		csd::scoped_lock guard(m_locks[i]);
+		return m_shards[i]->get(key);
+	}
+
+	bool has_key(const K& key)
+	{
+		int i = shard_index(key);
+		csd::scoped_lock guard(m_locks[i]);
+		return m_shards[i]->has_key(key);
+	}
+
+	concurrent_lru_cache& put(const K& key, const V& value)
+	{
+		int i = shard_index(key);
+		csd::scoped_lock guard(m_locks[i]);
+		m_shards[i]->put(key, value);
+		return *this;
+	}
+
+	concurrent_lru_cache& put(const K& key, const V& value, long ttl_ms)
+	{
+		int i = shard_index(key);
+		csd::scoped_lock guard(m_locks[i]);
+		m_shards[i]->put(key, value, ttl_ms);
+		return *this;
+	}
+
+	bool remove(const K& key)
+	{
+		int i = shard_index(key);
+		csd::scoped_lock guard(m_locks[i]);
+		return m_shards[i]->remove(key);
+	}
+
+	void clear()
+	{
+		for (int i = 0; i < Shards; i++) {
+			csd::scoped_lock guard(m_locks[i]);
+			m_shards[i]->clear();
+		}
+	}
+
+	int len()
+	{
+		int total = 0;
+
+		for (int i = 0; i < Shards; i++) {
+			csd::scoped_lock guard(m_locks[i]);
+			total += m_shards[i]->len();
+		}
+
+		return total;
+	}
+
+	size_t hits()
+	{
+		size_t total = 0;
+
+		for (int i = 0; i < Shards; i++) {
+			csd::scoped_lock guard(m_locks[i]);
+			total += m_shards[i]->hits();
+		}
+
+		return total;
+	}
+
+	size_t misses()
+	{
+		size_t total = 0;
+
+		for (int i = 0; i < Shards; i++) {
+			csd::scoped_lock guard(m_locks[i]);
+			total += m_shards[i]->misses();
+		}
+
+		return total;
+	}
+
+	concurrent_lru_cache& operator=(const concurrent_lru_cache& other) = delete;
+
+  private:
+	lru_cache<K, V> *m_shards[Shards];
+	csd::mutex m_locks[Shards];
+
+	static int shard_index(const K& key)
+	{
+		/* The shards use the low bits of the hash for their buckets, so
+		   pick the shard using the high ones. */
+		return (csd::hash(key) >> 32) % Shards;
+	}
+};
@@ -0,0 +1,100 @@
+/* <libcsd/charconv.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+namespace csd {
+
+/**
+ * @var to_chars_max
+ * A buffer of this size fits the output of any to_chars() call.
+ */
+constexpr int to_chars_max = 32;
+
+/**
+ * @function to_chars
+ * Write the decimal representation of `value` into `buf`, which has room for
+ * `size` characters. Returns the number of characters written, or -1 if they
+ * would not fit, in which case nothing is written. The output is not
+ * NUL-terminated. These never allocate and do not depend on the locale.
+ *
+ *  char buf[csd::to_chars_max];
+ *  int n = csd::to_chars(buf, sizeof(buf), 18446744073709551615ull);
+ *
+ * Floating point numbers are written in the shortest form which reads back
+ * as the exact same number, using the Ryu algorithm. Like in Python, large
+ * and small numbers use the scientific notation, and whole numbers keep a
+ * trailing ".0":
+ *
+ *  0.3      -> "0.3"
+ *  1.0      -> "1.0"
+ *  1e100    -> "1e+100"
+ *  0.00001  -> "1e-05"
+ *  NaN      -> "nan"
+ *
+ * A float is formatted as the shortest float, so 0.1f is "0.1", not
+ * "0.10000000149011612".
+ */
+int to_chars(char *buf, int size, int value);
+int to_chars(char *buf, int size, unsigned int value);
+int to_chars(char *buf, int size, long value);
+int to_chars(char *buf, int size, unsigned long value);
+int to_chars(char *buf, int size, long long value);
+int to_chars(char *buf, int size, unsigned long long value);
+int to_chars(char *buf, int size, float value);
+int to_chars(char *buf, int size, double value);
+
+/**
+ * @function to_chars_hex
+ * Write `value` as lowercase hexadecimal digits, without any prefix. Returns
+ * the same as to_chars().
+ *
+ *  csd::to_chars_hex(buf, sizeof(buf), 48879);   // "beef"
+ */
+int to_chars_hex(char *buf, int size, unsigned long long value);
+
+/**
+ * @function to_chars_fixed
+ * Write `value` with exactly `precision` digits after the decimal point, like
+ * printf("%.*f") would. Returns the same as to_chars(). The exact binary
+ * value is rounded, with ties going to the even digit, so 0.125 becomes
+ * "0.12", and 2.675 becomes "2.67", as the closest double is a bit smaller.
+ *
+ *  csd::to_chars_fixed(buf, sizeof(buf), 3.14159, 3);   // "3.142"
+ *  csd::to_chars_fixed(buf, sizeof(buf), 1e6, 1);       // "1000000.0"
+ *
+ * Large numbers have up to 309 digits in front of the point, so the buffer
+ * may have to be much larger than to_chars_max.
+ */
+int to_chars_fixed(char *buf, int size, double value, int precision);
+
+/**
+ * @function to_chars_scientific
+ * Write `value` in scientific notation with `precision` digits after the
+ * decimal point, like printf("%.*e"), rounded the same way as with
+ * to_chars_fixed(). The exponent has at least two digits.
+ *
+ *  csd::to_chars_scientific(buf, sizeof(buf), 123456.0, 3);   // "1.235e+05"
+ */
+int to_chars_scientific(char *buf, int size, double value, int precision);
+
+/**
+ * @function from_chars
+ * Parse all `len` characters of `buf` as a decimal number into `value`.
+ * Returns false if the input is not a valid number, or does not fit into
+ * the type, in which case `value` is left untouched. Nothing may come
+ * before or after the number, not even whitespace. Like to_chars(), these
+ * never allocate and do not depend on the locale.
+ *
+ * Integers are an optional sign followed by digits. Floating point numbers
+ * may also have a fraction and an exponent, like "-1.5e-3", or be "inf",
+ * "infinity" or "nan", in any case. They are always rounded correctly, to
+ * the nearest double. Too large numbers become infinity, and too small ones
+ * zero. The str and str_view to_int() family wraps these in a maybe<T>.
+ */
+bool from_chars(const char *buf, int len, int *value);
+bool from_chars(const char *buf, int len, long long *value);
+bool from_chars(const char *buf, int len, unsigned long long *value);
+bool from_chars(const char *buf, int len, double *value);
+
+} // namespace csd
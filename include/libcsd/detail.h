@@ -90,6 +90,20 @@ struct same_type_s<T, T> : true_result
 template <typename T, typename U>
 constexpr static bool same_type = same_type_s<T, U>::result;
 
+template <typename T>
+struct no_deduce_s
+{
+	using type = T;
+};
+
+/**
+ * @type no_deduce<T>
+ * Evaluates to T, but a function parameter of this type does not take part
+ * in template argument deduction, so T has to come from the other ones.
+ */
+template <typename T>
+using no_deduce = typename no_deduce_s<T>::type;
+
 /**
  * @concept IsMovable<T>
  * Any type that can be moved.
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <libcsd/format.h>
 #include <libcsd/list.h>
 #include <libcsd/str.h>
 #include <libcsd/stream.h>
@@ -15,6 +16,8 @@ namespace csd {
  */
 struct file
 {
+	static constexpr int format_buffer_size = 256;
+
 	file();
 	~file();
 
@@ -25,7 +28,27 @@ struct file
 
 	size_t write(const bytes& buf);
 	bytes read(int size);
-	size_t write_string(const str& s);
+	size_t write_string(csd::str_view s);
+
+	/**
+	 * @method write_format
+	 * Formats the text like csd::format(), and writes it. Texts of up to
+	 * `format_buffer_size` bytes are formatted on the stack, so writing them
+	 * does not allocate.
+	 *
+	 *  out.write_format("{} {}\n", key, value);
+	 */
+	template <csd::StringConvertible... Args>
+	size_t write_format(const format_string<no_deduce<Args>...>& fmt,
+						const Args&...args)
+	{
+		char buf[format_buffer_size];
+		size_t len = csd::format_to(buf, sizeof(buf), fmt, args...);
+
+		if (len <= sizeof(buf))
+			return write_string(csd::str_view(buf, len));
+		return write_string(csd::format(fmt, args...));
+	}
 	str read_string(int size);
 	str read_all();
 	list<str> read_lines();
@@ -3,36 +3,741 @@
 
 #pragma once
 
+#include <libcsd/builder.h>
+#include <libcsd/bytes.h>
+#include <libcsd/charconv.h>
+#include <libcsd/detail.h>
+#include <libcsd/error.h>
 #include <libcsd/str.h>
 
 namespace csd {
 
-inline str format(const str& empty_fmt)
+/* Never defined. A format string calls one of these while it is parsed at
+   compile time if something is wrong with it, which makes the compiler
+   report the call as an error. */
+void format_string_does_not_match_arguments();
+void format_string_is_invalid();
+void format_string_has_too_many_fields();
+void format_spec_does_not_match_argument();
+
+/**
+ * @class format_spec
+ * How a single argument is written, parsed from the part after the colon of
+ * a replacement field. See format_string for the syntax.
+ */
+struct format_spec
+{
+	static constexpr int max_number = 0x7fff;
+
+	char fill = ' ';        /* only used with a width */
+	char align = 0;         /* '<', '>', '^', or 0 for the default */
+	char sign = 0;          /* '+', ' ', or 0 for only the minus sign */
+	char type = 0;          /* the presentation type, or 0 */
+	bool alternate = false; /* '#', a base prefix for integers */
+	bool zero_pad = false;  /* '0', pad numbers with zeros after the sign */
+	short width = 0;
+	short precision = -1; /* not given */
+};
+
+/* What an argument is to the formatter. Anything which is not a string, a
+   number or a pointer is converted to a str first. */
+enum class format_kind : char
+{
+	string,
+	converted,
+	character,
+	signed_integer,
+	unsigned_integer,
+	single,
+	floating,
+	pointer,
+};
+
+template <typename T>
+consteval format_kind format_kind_of()
+{
+	if constexpr (csd::StringLike<T>)
+		return format_kind::string;
+	else if constexpr (csd::same_type<T, char>)
+		return format_kind::character;
+	else if constexpr (csd::same_type<T, bool> || csd::same_type<T, signed char>
+					   || csd::same_type<T, short> || csd::same_type<T, int>
+					   || csd::same_type<T, long>
+					   || csd::same_type<T, long long>)
+		return format_kind::signed_integer;
+	else if constexpr (csd::same_type<T, unsigned char>
+					   || csd::same_type<T, unsigned short>
+					   || csd::same_type<T, unsigned int>
+					   || csd::same_type<T, unsigned long>
+					   || csd::same_type<T, unsigned long long>)
+		return format_kind::unsigned_integer;
+	else if constexpr (csd::same_type<T, float>)
+		return format_kind::single;
+	else if constexpr (csd::same_type<T, double>)
+		return format_kind::floating;
+	else if constexpr (requires(const T& t, void (*f)(const void *)) { f(t); })
+		return format_kind::pointer;
+	else
+		return format_kind::converted;
+}
+
+/* Checks if the spec makes sense for the kind of argument, like a precision
+   for a float, or a base for an integer. Format strings are checked at
+   compile time, and the binary log checks the specs it reads. */
+constexpr bool format_spec_matches(const format_spec& spec, format_kind kind)
+{
+	const char *types = "";
+	bool numeric = false;
+	bool integer = false;
+
+	switch (kind) {
+	case format_kind::string:
+	case format_kind::converted:
+		types = "s";
+		break;
+	case format_kind::character:
+		types = "cdxXbo";
+		integer = spec.type && spec.type != 'c';
+		numeric = integer;
+		break;
+	case format_kind::signed_integer:
+	case format_kind::unsigned_integer:
+		types = "dxXbo";
+		integer = true;
+		numeric = true;
+		break;
+	case format_kind::single:
+	case format_kind::floating:
+		types = "eEfFgG";
+		numeric = true;
+		break;
+	case format_kind::pointer:
+		types = "p";
+		break;
+	}
+
+	if (spec.type) {
+		while (*types && *types != spec.type)
+			types++;
+		if (!*types)
+			return false;
+	}
+
+	if ((spec.sign || spec.zero_pad) && !numeric)
+		return false;
+	if (spec.alternate && !integer)
+		return false;
+	if (spec.precision != -1 && (integer || kind == format_kind::character
+								 || kind == format_kind::pointer))
+		return false;
+
+	return true;
+}
+
+/* A replacement field, together with the literal text in front of it. The
+   fields are kept small, as a copy of all of them is made for each call. */
+struct format_field
+{
+	static constexpr int max_len = 0xffff;
+
+	unsigned short text_len = 0;
+	unsigned short field_len = 0; /* of the field itself, with its braces */
+	bool text_escaped = false;    /* has {{ or }}, which are written once */
+	bool plain = true;            /* no spec, the argument is written as is */
+	unsigned char arg = 0;
+	format_spec spec;
+};
+
+/* The parsed format string, without its argument types. */
+struct format_layout
+{
+	csd::str_view text;
+	const format_field *fields;
+	int nfields;
+};
+
+/**
+ * @class format_string<Args...>
+ * Format string, which is parsed at compile time. It is created implicitly
+ * from the string literal passed to format() or format_to(), and each of its
+ * replacement fields is checked against the arguments, so a mismatch does
+ * not compile.
+ *
+ *  csd::format("{} + {}", 1, 2);        // "1 + 2"
+ *  csd::format("{1} - {0}", 1, 2);      // "2 - 1"
+ *  csd::format("{:>6}|{:<4}|", "ab", 7); // "    ab|7   |"
+ *  csd::format("{:08.3f}", 3.14159);    // "0003.142"
+ *  csd::format("{:#x}", 255);           // "0xff"
+ *  csd::format("{{{}}}", 1);            // "{1}"
+ *  csd::format("{} + {}", 1);           // compile error
+ *  csd::format("{:x}", "text");         // compile error
+ *
+ * Fields either all have an argument index, or none of them do, in which
+ * case they take the arguments in order. Each argument has to be used at
+ * least once, and there can be at most twice as many fields as arguments.
+ * After the colon comes the spec:
+ *
+ *  [[fill]align][sign][#][0][width][.precision][type]
+ *
+ *  fill       any ASCII character apart from { and }, a space by default
+ *  align      < left, > right, ^ centered; numbers go right by default
+ *  sign       + for a plus on positive numbers, a space for a space
+ *  #          0x, 0X, 0b or 0 in front of integers in the other bases
+ *  0          pad numbers with zeros after the sign, instead of the fill
+ *  width      minimum width, in code points for strings
+ *  precision  digits after the point, or significant digits for g, and
+ *             the maximum number of code points for strings
+ *  type       s for strings, c for char; d, x, X, b, o for integers, and
+ *             for chars, which are then written as their byte value; f, e,
+ *             g for floats, or F, E, G in upper case; p for pointers
+ *
+ * Floats without a type use the shortest form, like to_chars(), or g when
+ * there is a precision. f, e and g default to a precision of 6, and round
+ * like printf(). The fields are stored in the object, so formatting does
+ * not parse anything, and arguments without a spec take a quicker path.
+ */
+template <typename... Args>
+struct format_string
+{
+	static constexpr int nargs = sizeof...(Args);
+	static constexpr int max_fields = 2 * nargs;
+
+	csd::str_view text;
+	format_field fields[max_fields + 1]; /* the last one is only text */
+	int nfields;
+	bool simple; /* only {} in order, without escapes */
+
+	template <size_t N>
+	consteval format_string(const char (&fmt)[N])
+		: text(fmt, N - 1)
+		, fields()
+		, nfields(0)
+		, simple(false)
+	{
+		constexpr format_kind kinds[] = {format_kind_of<Args>()...,
+										 format_kind::string};
+		bool used[nargs + 1] = {};
+		bool manual = false;
+		bool automatic = false;
+		bool escaped = false;
+		int next_arg = 0;
+		int start = 0;
+		int arg;
+		int i = 0;
+
+		while (i < text.len) {
+			if (fmt[i] == '}') {
+				if (fmt[i + 1] != '}')
+					format_string_is_invalid();
+				escaped = true;
+				i += 2;
+				continue;
+			}
+
+			if (fmt[i] != '{') {
+				i++;
+				continue;
+			}
+
+			if (fmt[i + 1] == '{') {
+				escaped = true;
+				i += 2;
+				continue;
+			}
+
+			if (nfields == max_fields)
+				format_string_has_too_many_fields();
+
+			format_field field;
+			field.text_len = check_len(i - start);
+			field.text_escaped = escaped;
+			start = i++;
+
+			if (is_digit(fmt[i])) {
+				manual = true;
+				arg = parse_number(fmt, i);
+			} else {
+				automatic = true;
+				arg = next_arg++;
+			}
+
+			if (manual && automatic)
+				format_string_is_invalid();
+			if (arg >= nargs)
+				format_string_does_not_match_arguments();
+			used[arg] = true;
+			field.arg = arg;
+
+			if (fmt[i] == ':') {
+				field.plain = false;
+				parse_spec(fmt, ++i, field.spec);
+				if (!format_spec_matches(field.spec, kinds[arg]))
+					format_spec_does_not_match_argument();
+			}
+
+			if (fmt[i] != '}')
+				format_string_is_invalid();
+
+			field.field_len = check_len(++i - start);
+			fields[nfields++] = field;
+			start = i;
+			escaped = false;
+		}
+
+		for (arg = 0; arg < nargs; arg++) {
+			if (!used[arg])
+				format_string_does_not_match_arguments();
+		}
+
+		fields[nfields].text_len = check_len(text.len - start);
+		fields[nfields].text_escaped = escaped;
+
+		simple = !escaped && nfields == nargs;
+		for (int k = 0; k < nfields; k++) {
+			simple = simple && fields[k].plain && !fields[k].text_escaped
+				  && fields[k].arg == k;
+		}
+	}
+
+	constexpr format_layout layout() const
+	{
+		return {text, fields, nfields};
+	}
+
+	/* Returns the literal text in front of the given field, or after the
+	   last one for `nfields`. */
+	constexpr csd::str_view segment(int index) const
+	{
+		const char *ptr = text.ptr;
+
+		for (int k = 0; k < index; k++)
+			ptr += fields[k].text_len + fields[k].field_len;
+
+		return {ptr, fields[index].text_len};
+	}
+
+  private:
+	static constexpr bool is_digit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	static constexpr bool is_align(char c)
+	{
+		return c == '<' || c == '>' || c == '^';
+	}
+
+	static consteval int check_len(int len)
+	{
+		if (len > format_field::max_len)
+			format_string_is_invalid();
+		return len;
+	}
+
+	static consteval int parse_number(const char *fmt, int& i)
+	{
+		int value = 0;
+
+		while (is_digit(fmt[i])) {
+			value = value * 10 + fmt[i++] - '0';
+			if (value > format_spec::max_number)
+				format_string_is_invalid();
+		}
+
+		return value;
+	}
+
+	static consteval void parse_spec(const char *fmt, int& i,
+									 format_spec& spec)
+	{
+		if (fmt[i] && is_align(fmt[i + 1])) {
+			if (fmt[i] == '{' || fmt[i] == '}' || fmt[i] & 0x80)
+				format_string_is_invalid();
+			spec.fill = fmt[i];
+			spec.align = fmt[i + 1];
+			i += 2;
+		} else if (is_align(fmt[i])) {
+			spec.align = fmt[i++];
+		}
+
+		if (fmt[i] == '+' || fmt[i] == ' ')
+			spec.sign = fmt[i++];
+		else if (fmt[i] == '-')
+			i++;
+
+		if (fmt[i] == '#') {
+			spec.alternate = true;
+			i++;
+		}
+
+		if (fmt[i] == '0') {
+			spec.zero_pad = true;
+			i++;
+		}
+
+		if (is_digit(fmt[i]))
+			spec.width = parse_number(fmt, i);
+
+		if (fmt[i] == '.') {
+			if (!is_digit(fmt[++i]))
+				format_string_is_invalid();
+			spec.precision = parse_number(fmt, i);
+		}
+
+		if (fmt[i] != '}' && fmt[i])
+			spec.type = fmt[i++];
+	}
+};
+
+/**
+ * @class format_arg
+ * A single argument, with its type erased, so that the formatting itself
+ * does not have to be a template.
+ */
+struct format_arg
+{
+	format_kind kind;
+	int len; /* of the string */
+
+	union
+	{
+		const char *string;
+		char character;
+		long long integer;
+		unsigned long long uinteger;
+		float single;
+		double floating;
+		const void *pointer;
+	};
+};
+
+/* Converts a single argument to a format_arg. Strings are viewed as they
+   are, while anything with a to_str(), or which is not known to the
+   formatter, is converted to a str which lives in this object. */
+template <typename T>
+struct format_value
+{
+	str text;
+	format_arg arg;
+
+	format_value(const T& value)
+		: text(convert(value))
+	{
+		arg.kind = format_kind::string;
+		arg.string = text.view().ptr;
+		arg.len = text.len();
+	}
+
+	static str convert(const T& value)
+	{
+		if constexpr (csd::ImplementsToString<T>)
+			return static_cast<str>(value.to_str());
+		else
+			return str(value);
+	}
+};
+
+template <typename T>
+	requires(format_kind_of<T>() != format_kind::converted)
+struct format_value<T>
+{
+	format_arg arg;
+
+	format_value(const T& value)
+	{
+		constexpr format_kind kind = format_kind_of<T>();
+
+		arg.kind = kind;
+		if constexpr (kind == format_kind::string) {
+			csd::str_view view = value;
+			arg.string = view.ptr;
+			arg.len = view.len;
+		} else if constexpr (kind == format_kind::character) {
+			arg.character = value;
+		} else if constexpr (kind == format_kind::signed_integer) {
+			arg.integer = value;
+		} else if constexpr (kind == format_kind::unsigned_integer) {
+			arg.uinteger = value;
+		} else if constexpr (kind == format_kind::single) {
+			arg.single = value;
+		} else if constexpr (kind == format_kind::floating) {
+			arg.floating = value;
+		} else {
+			arg.pointer = value;
+		}
+	}
+};
+
+/* The text of a single argument. Strings are used as they are, numbers and
+   characters are written into a small buffer, and anything else is turned
+   into a str. */
+template <typename T>
+struct format_piece
+{
+	str text;
+
+	format_piece(const T& arg)
+		: text(arg)
+	{ }
+
+	csd::str_view view() const
+	{
+		return text;
+	}
+};
+
+template <csd::StringLike T>
+struct format_piece<T>
+{
+	csd::str_view text;
+
+	format_piece(const T& arg)
+		: text(arg)
+	{ }
+
+	csd::str_view view() const
+	{
+		return text;
+	}
+};
+
+template <typename T>
+	requires(!csd::StringLike<T> && !csd::same_type<T, char>)
+			&& requires(char *buf, const T& value) {
+				   csd::to_chars(buf, csd::to_chars_max, value);
+			   }
+struct format_piece<T>
+{
+	char buf[csd::to_chars_max];
+	int len;
+
+	format_piece(const T& arg)
+		: len(csd::to_chars(buf, csd::to_chars_max, arg))
+	{ }
+
+	csd::str_view view() const
+	{
+		return {buf, len};
+	}
+};
+
+template <typename T>
+	requires csd::same_type<T, char>
+struct format_piece<T>
 {
-	return empty_fmt;
+	char c;
+
+	format_piece(char arg)
+		: c(arg)
+	{ }
+
+	csd::str_view view() const
+	{
+		return {&c, 1};
+	}
+};
+
+template <typename Format, typename... Pieces>
+size_t formatted_size_of(const Format& fmt, const Pieces&...pieces)
+{
+	return fmt.text.len - 2 * Format::nargs
+		 + (0 + ... + (size_t) pieces.view().len);
+}
+
+/* Copies as much of `text` to `buf` + `at` as fits below `cap`, and returns
+   the position after the whole text, which may lie past `cap`. */
+inline size_t format_copy(char *buf, size_t cap, size_t at,
+						  csd::str_view text)
+{
+	if (at < cap) {
+		__builtin_memcpy(buf + at, text.ptr,
+						 cap - at < (size_t) text.len ? cap - at : text.len);
+	}
+
+	return at + text.len;
+}
+
+template <typename Format, typename... Pieces>
+size_t format_pieces_to(char *buf, size_t cap, const Format& fmt,
+						const Pieces&...pieces)
+{
+	size_t at = 0;
+	int index = 0;
+
+	((at = format_copy(buf, cap, at, fmt.segment(index++)),
+	  at = format_copy(buf, cap, at, pieces.view())),
+	 ...);
+
+	return format_copy(buf, cap, at, fmt.segment(index));
+}
+
+template <typename Format, typename... Pieces>
+void format_pieces_to(str& out, const Format& fmt, const Pieces&...pieces)
+{
+	size_t size = out.len() + formatted_size_of(fmt, pieces...);
+	int index = 0;
+
+	if (size <= (size_t) str::max_len)
+		out.reserve(size);
+
+	(out.append(fmt.segment(index++)).append(pieces.view()), ...);
+	out.append(fmt.segment(index));
 }
 
+template <typename Format, typename... Pieces>
+size_t format_pieces_to(bytes& out, const Format& fmt, const Pieces&...pieces)
+{
+	size_t size = formatted_size_of(fmt, pieces...);
+
+	if (size > (size_t) str::max_len)
+		throw csd::memory_exception("format: text too long");
+	if (size > (size_t) out.size())
+		out.alloc(size);
+
+	return format_pieces_to((char *) out.raw_ptr(), out.size(), fmt,
+							pieces...);
+}
+
+template <int N>
+struct format_arg_array
+{
+	format_arg args[N ? N : 1];
+};
+
+/* The formatting itself, used by the templates below. */
+str format_erased(const format_layout& layout, const format_arg *args);
+size_t formatted_size_erased(const format_layout& layout,
+							 const format_arg *args);
+void format_erased_to(str_builder& out, const format_layout& layout,
+					  const format_arg *args);
+size_t format_erased_to(str& out, const format_layout& layout,
+						const format_arg *args);
+size_t format_erased_to(bytes& out, const format_layout& layout,
+						const format_arg *args);
+size_t format_erased_to(char *buf, size_t cap, const format_layout& layout,
+						const format_arg *args);
+
 /**
  * @function format
- * Format the given string with the following arguments.
+ * Format the given string with the following arguments, putting them in
+ * place of each replacement field. See format_string for what can go in
+ * the fields. The result is allocated once, with the exact size.
  *
  *  str hello = csd::format("Hello there {}, you are {} yo!", "John", 12);
  *  println(hello); // Hello there John, you are 12 yo!
  */
-template <csd::StringConvertible T, typename... VT>
-str format(const str& fmt, T first_arg, VT... args)
+template <csd::StringConvertible... Args>
+str format(const format_string<no_deduce<Args>...>& fmt, const Args&...args)
+{
+	if (fmt.simple) {
+		str result;
+		format_pieces_to(result, fmt, format_piece<Args>(args)...);
+		return result;
+	}
+
+	return format_erased(
+		fmt.layout(),
+		format_arg_array<sizeof...(Args)>{{format_value<Args>(args).arg...}}
+			.args);
+}
+
+/**
+ * @function formatted_size
+ * Returns the length of the text format() would return for the same
+ * arguments, without writing it anywhere.
+ */
+template <csd::StringConvertible... Args>
+size_t formatted_size(const format_string<no_deduce<Args>...>& fmt,
+					  const Args&...args)
 {
-	int index;
-	str formatted;
+	if (fmt.simple)
+		return formatted_size_of(fmt, format_piece<Args>(args)...);
 
-	if ((index = fmt.find("{}")) == str::invalid_index)
-		return fmt;
+	return formatted_size_erased(
+		fmt.layout(),
+		format_arg_array<sizeof...(Args)>{{format_value<Args>(args).arg...}}
+			.args);
+}
 
-	formatted += fmt.substr(0, index);
-	formatted += str(first_arg);
-	formatted += format(fmt.substr(index + 2), args...);
+/**
+ * @function format_to
+ * Same as format(), but writes the text somewhere else. With a str_builder
+ * or a str, the text is appended to it. With bytes, it's written from the
+ * start of the buffer, which grows if it's too small. With a plain buffer of
+ * `cap` bytes, as much of the text as fits is written, without a NUL at the
+ * end. The last three return the full length of the text, so a result over
+ * `cap` means that it was cut off, and tells how much space it needs.
+ *
+ *  char buf[64];
+ *  size_t len = csd::format_to(buf, sizeof(buf), "{}:{}", host, port);
+ *
+ *  if (len > sizeof(buf))
+ *      ...
+ *
+ * Apart from arguments with their own to_str(), none of them allocate,
+ * except to grow the output.
+ */
+template <csd::StringConvertible... Args>
+void format_to(str_builder& out, const format_string<no_deduce<Args>...>& fmt,
+			   const Args&...args)
+{
+	int index = 0;
+
+	if (!fmt.simple) {
+		format_erased_to(
+			out, fmt.layout(),
+			format_arg_array<sizeof...(Args)>{
+				{format_value<Args>(args).arg...}}
+				.args);
+		return;
+	}
+
+	((out.append(fmt.segment(index)), out.append(args), index++), ...);
+	out.append(fmt.segment(index));
+}
+
+template <csd::StringConvertible... Args>
+size_t format_to(str& out, const format_string<no_deduce<Args>...>& fmt,
+				 const Args&...args)
+{
+	int len = out.len();
+
+	if (fmt.simple) {
+		format_pieces_to(out, fmt, format_piece<Args>(args)...);
+		return out.len() - len;
+	}
+
+	return format_erased_to(
+		out, fmt.layout(),
+		format_arg_array<sizeof...(Args)>{{format_value<Args>(args).arg...}}
+			.args);
+}
+
+template <csd::StringConvertible... Args>
+size_t format_to(bytes& out, const format_string<no_deduce<Args>...>& fmt,
+				 const Args&...args)
+{
+	if (fmt.simple)
+		return format_pieces_to(out, fmt, format_piece<Args>(args)...);
+
+	return format_erased_to(
+		out, fmt.layout(),
+		format_arg_array<sizeof...(Args)>{{format_value<Args>(args).arg...}}
+			.args);
+}
+
+template <csd::StringConvertible... Args>
+size_t format_to(char *buf, size_t cap,
+				 const format_string<no_deduce<Args>...>& fmt,
+				 const Args&...args)
+{
+	if (fmt.simple)
+		return format_pieces_to(buf, cap, fmt, format_piece<Args>(args)...);
 
-	return formatted;
+	return format_erased_to(
+		buf, cap, fmt.layout(),
+		format_arg_array<sizeof...(Args)>{{format_value<Args>(args).arg...}}
+			.args);
 }
 
 } // namespace csd
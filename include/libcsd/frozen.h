@@ -0,0 +1,484 @@
+/* <libcsd/frozen.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/hash.h>
+#include <libcsd/maybe.h>
+#include <string.h>
+
+namespace csd {
+
+/* Read the next `n` (<= 8) bytes as a little-endian word. This has to give
+   the same result in constant evaluation and at runtime, as the tables are
+   built by the compiler but looked up by the program. */
+constexpr inline unsigned long long frozen_read_word(const char *ptr, int n)
+{
+	unsigned long long word = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (!__builtin_is_constant_evaluated() && n == 8) {
+		memcpy(&word, ptr, 8);
+		return word;
+	}
+#endif
+
+	for (int i = 0; i < n; i++)
+		word |= (unsigned long long) (unsigned char) ptr[i] << (i * 8);
+	return word;
+}
+
+constexpr inline size_t frozen_hash(const char *ptr, int len)
+{
+	unsigned long long h = 0x9e3779b97f4a7c15ULL ^ (unsigned long long) len;
+
+	while (len >= 8) {
+		h = hash_mix(h ^ frozen_read_word(ptr, 8));
+		ptr += 8;
+		len -= 8;
+	}
+
+	return hash_mix(h ^ frozen_read_word(ptr, len));
+}
+
+constexpr inline int frozen_strlen(const char *string)
+{
+	int len = 0;
+	while (string[len])
+		len++;
+	return len;
+}
+
+constexpr inline bool frozen_equals(const char *a, const char *b, int len)
+{
+	if (!__builtin_is_constant_evaluated())
+		return !memcmp(a, b, len);
+
+	for (int i = 0; i < len; i++) {
+		if (a[i] != b[i])
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * @class frozen_index<N>
+ * Perfect hash over N key hashes, used by frozen_map and frozen_set. The
+ * keys are split into buckets by their hash, and each bucket gets its own
+ * displacement which moves its keys into free slots of the table. A bucket
+ * with a single key stores the slot directly. Looking up a hash is then a
+ * bucket read and at most one more mix, without any probing.
+ */
+template <int N>
+struct frozen_index
+{
+	static constexpr int size = [] {
+		int n = 1;
+		while (n < N)
+			n <<= 1;
+		return n;
+	}();
+
+	static constexpr int mask = size - 1;
+
+	int disp[size];
+	int slots[size];
+
+	constexpr frozen_index()
+		: disp()
+		, slots()
+	{ }
+
+	constexpr void build(const size_t (&hashes)[N])
+	{
+		int bucket_len[size] = {};
+		int order[size] = {};
+		bool taken[size] = {};
+		int members[N] = {};
+		int next_free = 0;
+
+		for (int i = 0; i < N; i++) {
+			for (int j = 0; j < i; j++) {
+				if (hashes[i] == hashes[j]) {
+					throw csd::invalid_argument_exception(
+						"frozen_index: duplicate key");
+				}
+			}
+
+			bucket_len[hashes[i] & mask]++;
+		}
+
+		for (int i = 0; i < size; i++) {
+			order[i] = i;
+			slots[i] = -1;
+		}
+
+		/* Place the largest buckets first, while most slots are free. */
+		for (int i = 1; i < size; i++) {
+			for (int j = i; j > 0; j--) {
+				if (bucket_len[order[j]] <= bucket_len[order[j - 1]])
+					break;
+				int tmp = order[j];
+				order[j] = order[j - 1];
+				order[j - 1] = tmp;
+			}
+		}
+
+		for (int i = 0; i < size; i++) {
+			int bucket = order[i];
+			int nmembers = 0;
+
+			if (!bucket_len[bucket])
+				break;
+
+			for (int k = 0; k < N; k++) {
+				if ((int) (hashes[k] & mask) == bucket)
+					members[nmembers++] = k;
+			}
+
+			if (nmembers == 1) {
+				while (taken[next_free])
+					next_free++;
+				taken[next_free] = true;
+				slots[next_free] = members[0];
+				disp[bucket] = -next_free - 1;
+				continue;
+			}
+
+			disp[bucket] = find_displacement(hashes, members, nmembers, taken);
+		}
+	}
+
+	constexpr int lookup(size_t hash) const
+	{
+		int d = disp[hash & mask];
+		int slot = d < 0 ? -d - 1 : (int) (displace(hash, d) & mask);
+		return slots[slot];
+	}
+
+  private:
+	static constexpr size_t displace(size_t hash, int d)
+	{
+		return hash_mix(hash ^ (d * 0x9e3779b97f4a7c15ULL));
+	}
+
+	constexpr int find_displacement(const size_t (&hashes)[N],
+									const int (&members)[N], int nmembers,
+									bool (&taken)[size])
+	{
+		int picked[N] = {};
+
+		for (int d = 1; d < 1 << 16; d++) {
+			bool fits = true;
+
+			for (int k = 0; k < nmembers && fits; k++) {
+				picked[k] = displace(hashes[members[k]], d) & mask;
+				fits = !taken[picked[k]];
+
+				for (int j = 0; j < k && fits; j++)
+					fits = picked[j] != picked[k];
+			}
+
+			if (!fits)
+				continue;
+
+			for (int k = 0; k < nmembers; k++) {
+				taken[picked[k]] = true;
+				slots[picked[k]] = members[k];
+			}
+
+			return d;
+		}
+
+		throw csd::invalid_operation_exception(
+			"frozen_index: failed to find a perfect hash");
+	}
+};
+
+template <typename K, typename V>
+struct frozen_pair
+{
+	K key;
+	V value;
+};
+
+} // namespace csd
+
+/**
+ * @class frozen_map<K, V, N>
+ * Immutable map, which is built at compile time. The keys are placed using a
+ * perfect hash, so a lookup is a single hash of the key, one table access and
+ * one key comparison. K may either be an integer type, or `const char *` for
+ * string keys, which can then be looked up with any str or str_view. Create
+ * one using make_frozen_map:
+ *
+ *  constexpr auto mime_types = make_frozen_map<const char *, const char *>({
+ *      {"html", "text/html"},
+ *      {"css", "text/css"},
+ *      {"png", "image/png"},
+ *  });
+ *
+ *  const char *type = mime_types.get_or(extension, "text/plain");
+ *
+ * Because the map is constexpr, there is no startup cost: the table is
+ * stored in the binary as-is. Duplicate keys fail to compile.
+ */
+template <typename K, typename V, int N>
+struct frozen_map
+{
+	static_assert(N > 0);
+
+	using pair = csd::frozen_pair<K, V>;
+	static constexpr bool string_keys = csd::same_type<K, const char *>;
+
+	constexpr frozen_map(const pair (&pairs)[N])
+		: m_pairs()
+		, m_lens()
+		, m_index()
+	{
+		size_t hashes[N] = {};
+
+		for (int i = 0; i < N; i++) {
+			m_pairs[i] = pairs[i];
+
+			if constexpr (string_keys) {
+				m_lens[i] = csd::frozen_strlen(pairs[i].key);
+				hashes[i] = csd::frozen_hash(pairs[i].key, m_lens[i]);
+			} else {
+				hashes[i] = csd::hash_mix(pairs[i].key);
+			}
+		}
+
+		m_index.build(hashes);
+	}
+
+	constexpr int len() const
+	{
+		return N;
+	}
+
+	constexpr bool has_key(const K& key) const
+	{
+		return index_of(key) != -1;
+	}
+
+	bool has_key(csd::str_view key) const
+		requires string_keys
+	{
+		return index_of(key) != -1;
+	}
+
+	/**
+	 * @method get_or
+	 * Returns the value at `key`, or the `fallback` if there is no such key.
+	 */
+	constexpr const V& get_or(const K& key, const V& fallback) const
+	{
+		int i = index_of(key);
+		return i == -1 ? fallback : m_pairs[i].value;
+	}
+
+	const V& get_or(csd::str_view key, const V& fallback) const
+		requires string_keys
+	{
+		int i = index_of(key);
+		return i == -1 ? fallback : m_pairs[i].value;
+	}
+
+	maybe<V> get(const K& key) const
+	{
+		int i = index_of(key);
+		if (i == -1)
+			return {};
+		return m_pairs[i].value;
+	}
+
+	maybe<V> get(csd::str_view key) const
+		requires string_keys
+	{
+		int i = index_of(key);
+		if (i == -1)
+			return {};
+		return m_pairs[i].value;
+	}
+
+	/**
+	 * @method operator[]
+	 * Access the value at `key`. Throws if such a key does not exist.
+	 */
+	constexpr const V& operator[](const K& key) const
+	{
+		int i = index_of(key);
+
+		if (i == -1) {
+			if constexpr (string_keys)
+				throw csd::index_exception(str(key));
+			else
+				throw csd::index_exception((int) key);
+		}
+
+		return m_pairs[i].value;
+	}
+
+	const V& operator[](csd::str_view key) const
+		requires string_keys
+	{
+		int i = index_of(key);
+		if (i == -1)
+			throw csd::index_exception(key.to_str());
+		return m_pairs[i].value;
+	}
+
+	/**
+	 * @method index_of
+	 * Returns the index of the pair with `key`, in the order the pairs were
+	 * given in, or -1 if there is no such key.
+	 */
+	constexpr int index_of(const K& key) const
+	{
+		if constexpr (string_keys)
+			return index_of_string(key, csd::frozen_strlen(key));
+		else
+			return index_of_number(key);
+	}
+
+	int index_of(csd::str_view key) const
+		requires string_keys
+	{
+		return index_of_string(key.ptr, key.len);
+	}
+
+	constexpr const pair *begin() const
+	{
+		return &m_pairs[0];
+	}
+
+	constexpr const pair *end() const
+	{
+		return &m_pairs[N];
+	}
+
+  private:
+	pair m_pairs[N];
+	int m_lens[string_keys ? N : 1];
+	csd::frozen_index<N> m_index;
+
+	constexpr int index_of_string(const char *ptr, int len) const
+	{
+		int i = m_index.lookup(csd::frozen_hash(ptr, len));
+
+		if (i == -1 || m_lens[i] != len)
+			return -1;
+		return csd::frozen_equals(m_pairs[i].key, ptr, len) ? i : -1;
+	}
+
+	constexpr int index_of_number(const K& key) const
+	{
+		int i = m_index.lookup(csd::hash_mix(key));
+		return (i != -1 && m_pairs[i].key == key) ? i : -1;
+	}
+};
+
+/**
+ * @class frozen_set<K, N>
+ * Immutable set of keys, which is built at compile time. The same rules
+ * apply as for frozen_map, see above.
+ *
+ *  constexpr auto keywords = make_frozen_set<const char *>({
+ *      "if", "else", "while", "return"
+ *  });
+ *
+ *  if (keywords.contains(token))
+ *      ...
+ */
+template <typename K, int N>
+struct frozen_set
+{
+	static_assert(N > 0);
+
+	static constexpr bool string_keys = csd::same_type<K, const char *>;
+
+	constexpr frozen_set(const K (&keys)[N])
+		: m_keys()
+		, m_lens()
+		, m_index()
+	{
+		size_t hashes[N] = {};
+
+		for (int i = 0; i < N; i++) {
+			m_keys[i] = keys[i];
+
+			if constexpr (string_keys) {
+				m_lens[i] = csd::frozen_strlen(keys[i]);
+				hashes[i] = csd::frozen_hash(keys[i], m_lens[i]);
+			} else {
+				hashes[i] = csd::hash_mix(keys[i]);
+			}
+		}
+
+		m_index.build(hashes);
+	}
+
+	constexpr int len() const
+	{
+		return N;
+	}
+
+	constexpr bool contains(const K& key) const
+	{
+		if constexpr (string_keys)
+			return contains_string(key, csd::frozen_strlen(key));
+		else
+			return contains_number(key);
+	}
+
+	bool contains(csd::str_view key) const
+		requires string_keys
+	{
+		return contains_string(key.ptr, key.len);
+	}
+
+	constexpr const K *begin() const
+	{
+		return &m_keys[0];
+	}
+
+	constexpr const K *end() const
+	{
+		return &m_keys[N];
+	}
+
+  private:
+	K m_keys[N];
+	int m_lens[string_keys ? N : 1];
+	csd::frozen_index<N> m_index;
+
+	constexpr bool contains_string(const char *ptr, int len) const
+	{
+		int i = m_index.lookup(csd::frozen_hash(ptr, len));
+
+		if (i == -1 || m_lens[i] != len)
+			return false;
+		return csd::frozen_equals(m_keys[i], ptr, len);
+	}
+
+	constexpr bool contains_number(const K& key) const
+	{
+		int i = m_index.lookup(csd::hash_mix(key));
+		return i != -1 && m_keys[i] == key;
+	}
+};
+
+template <typename K, typename V, int N>
+constexpr frozen_map<K, V, N>
+make_frozen_map(const csd::frozen_pair<K, V> (&pairs)[N])
+{
+	return frozen_map<K, V, N>(pairs);
+}
+
+template <typename K, int N>
+constexpr frozen_set<K, N> make_frozen_set(const K (&keys)[N])
+{
+	return frozen_set<K, N>(keys);
+}
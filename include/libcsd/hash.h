@@ -0,0 +1,94 @@
+/* <libcsd/hash.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace csd {
+
+/**
+ * @function hash_bytes
+ * Hash an arbitrary run of `len` bytes into a size_t. The hash is fast and
+ * well distributed, but not cryptographically secure, so it should only be
+ * used for hash tables and similar lookup structures.
+ */
+size_t hash_bytes(const void *ptr, size_t len, size_t seed = 0);
+
+/**
+ * @function hash_mix
+ * Scramble an integer, so that close values end up in different buckets
+ * of a power-of-2 sized hash table.
+ */
+constexpr inline size_t hash_mix(unsigned long long value)
+{
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdULL;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ULL;
+	value ^= value >> 33;
+	return value;
+}
+
+/**
+ * @concept ImplementsHash
+ * Any type that implements the hash() method, returning a size_t.
+ */
+template <typename T>
+concept ImplementsHash = requires(const T& t) { (size_t) t.hash(); };
+
+inline size_t hash(char value)
+{
+	return hash_mix(value);
+}
+
+inline size_t hash(int value)
+{
+	return hash_mix(value);
+}
+
+inline size_t hash(unsigned int value)
+{
+	return hash_mix(value);
+}
+
+inline size_t hash(long value)
+{
+	return hash_mix(value);
+}
+
+inline size_t hash(unsigned long value)
+{
+	return hash_mix(value);
+}
+
+inline size_t hash(long long value)
+{
+	return hash_mix(value);
+}
+
+inline size_t hash(unsigned long long value)
+{
+	return hash_mix(value);
+}
+
+inline size_t hash(const void *pointer)
+{
+	return hash_mix((unsigned long long) pointer);
+}
+
+template <ImplementsHash T>
+size_t hash(const T& object)
+{
+	return object.hash();
+}
+
+/**
+ * @concept Hashable
+ * Any type that can be passed to csd::hash(), either because it's one of
+ * the built-in integer types or because it implements the hash() method.
+ */
+template <typename T>
+concept Hashable = requires(const T& t) { (size_t) csd::hash(t); };
+
+} // namespace csd
@@ -0,0 +1,60 @@
+/* <libcsd/hashed_str.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/str.h>
+
+/**
+ * @class hashed_str
+ * Immutable str which computes its hash once, when it's created. hash() is
+ * then free, and two hashed_str objects with different hashes are told
+ * apart without looking at their bytes, which makes it a good key for
+ * hash tables and for strings which are compared over and over again.
+ *
+ *  hashed_str key("content-length");
+ *
+ *  for (const hashed_str& name : names) {
+ *      if (name == key)        // usually just one integer compare
+ *          ...
+ *  }
+ *
+ * Comparing against any other string falls back to the usual str_view
+ * comparison. The constructors are explicit, so that a string is never
+ * hashed just to be compared. Use to_str() to get a mutable copy.
+ */
+struct hashed_str
+{
+	hashed_str();
+	explicit hashed_str(const char *string);
+	explicit hashed_str(const str& string);
+	explicit hashed_str(str&& moved);
+	explicit hashed_str(csd::str_view view);
+
+	int len() const;
+	bool empty() const;
+	size_t hash() const;
+	csd::str_view view() const;
+	str to_str() const;
+
+	bool operator==(const hashed_str& other) const;
+	/* Exact matches for any other string type, so that comparing against a
+	   str does not have to choose between converting either side. */
+	template <csd::StringLike T>
+	bool operator==(const T& other) const
+	{
+		return view() == csd::str_view(other);
+	}
+
+	template <csd::StringLike T>
+	int operator<=>(const T& other) const
+	{
+		return view().compare(csd::str_view(other));
+	}
+
+	operator csd::str_view() const;
+
+  private:
+	str m_str;
+	size_t m_hash;
+};
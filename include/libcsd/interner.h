@@ -0,0 +1,140 @@
+/* <libcsd/interner.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/arena.h>
+#include <libcsd/hash.h>
+#include <libcsd/maybe.h>
+#include <pthread.h>
+
+namespace csd {
+
+/**
+ * @class symbol
+ * Handle to a string stored in an interner. Two symbols from the same
+ * interner are equal only if their strings are equal, so comparing them
+ * is a single integer comparison.
+ */
+struct symbol
+{
+	unsigned int id;
+
+	bool operator==(const symbol& other) const
+	{
+		return id == other.id;
+	}
+
+	bool operator!=(const symbol& other) const
+	{
+		return id != other.id;
+	}
+
+	size_t hash() const
+	{
+		return csd::hash_mix(id);
+	}
+
+	str to_str() const;
+};
+
+/**
+ * @class interner
+ * String interning table. Each unique string is stored once, and gets a
+ * small symbol which can be used instead of the string itself.
+ *
+ *  csd::interner names;
+ *
+ *  csd::symbol a = names.intern("width");
+ *  csd::symbol b = names.intern(some_str);   // "width"
+ *
+ *  if (a == b)                               // O(1) comparison
+ *      println(names.resolve(a).ptr);        // "width"
+ *
+ * The strings are copied into an arena, and never move, so the str_view
+ * returned from resolve() is valid for as long as the interner exists. The
+ * views are also NUL-terminated. The symbol ids are handed out in order,
+ * starting from 0.
+ */
+struct interner
+{
+	interner();
+	interner(const interner& copied_interner) = delete;
+	~interner();
+
+	symbol intern(str_view string);
+	symbol intern(const char *ptr, int len);
+
+	/**
+	 * @method lookup
+	 * Returns the symbol of `string`, without interning it if it's not
+	 * present yet.
+	 */
+	maybe<symbol> lookup(str_view string) const;
+	maybe<symbol> lookup(const char *ptr, int len) const;
+
+	/**
+	 * @method lookup
+	 * Same as above, but stores the symbol in `sym` and returns whether it
+	 * was found, so nothing has to be allocated for a maybe<>.
+	 */
+	bool lookup(const char *ptr, int len, symbol *sym) const;
+
+	/**
+	 * @method resolve
+	 * Returns the interned string. Throws an index_exception if the symbol
+	 * does not come from this interner.
+	 */
+	str_view resolve(symbol sym) const;
+
+	int len() const;
+
+	interner& operator=(const interner& other) = delete;
+
+  private:
+	struct entry
+	{
+		char *ptr;
+		int len;
+		size_t hash;
+	};
+
+	csd::arena m_arena;
+	entry *m_entries;
+	unsigned int *m_slots; /* symbol id + 1, 0 means empty */
+	int m_len;
+	int m_entries_space;
+	int m_slots_mask;
+
+	int find_slot(const char *ptr, int len, size_t h) const;
+	void grow_slots();
+};
+
+/**
+ * @class concurrent_interner
+ * Thread-safe interner, which may be shared between csd::thread workers.
+ * Lookups of already interned strings only take a shared read lock, so
+ * threads do not wait for each other unless a new string is added.
+ */
+struct concurrent_interner
+{
+	concurrent_interner();
+	concurrent_interner(const concurrent_interner& copied_interner) = delete;
+	~concurrent_interner();
+
+	symbol intern(str_view string);
+	symbol intern(const char *ptr, int len);
+	maybe<symbol> lookup(str_view string) const;
+	maybe<symbol> lookup(const char *ptr, int len) const;
+	bool lookup(const char *ptr, int len, symbol *sym) const;
+	str_view resolve(symbol sym) const;
+	int len() const;
+
+	concurrent_interner& operator=(const concurrent_interner& other) = delete;
+
+  private:
+	interner m_interner;
+	mutable pthread_rwlock_t m_lock;
+};
+
+} // namespace csd
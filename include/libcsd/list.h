@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <libcsd/builder.h>
 #include <libcsd/routine.h>
 #include <memory.h>
 
@@ -434,16 +435,17 @@ struct list
 	template <csd::StringConvertible U>
 	str string_repr() const
 	{
-		str builder = '[';
+		str_builder builder;
 
-		if (len() == 0)
-			return "[]";
-
-		for (int i = 0; i < len() - 1; i++)
-			builder += str(*m_ptr[i]) + ", ";
+		builder.append('[');
+		for (int i = 0; i < len(); i++) {
+			if (i)
+				builder.append(", ");
+			builder.append(*m_ptr[i]);
+		}
+		builder.append(']');
 
-		builder += str(*m_ptr[len() - 1]);
-		return builder + ']';
+		return builder.finish();
 	}
 
 	void copy_from(const list& other_list)
@@ -460,5 +462,13 @@ struct list
 };
 
 namespace csd {
-list<str> split_str(str to_split, const str& by);
-}
+
+/**
+ * @function split_str
+ * Split the string into a list of owned parts. If you only need to walk
+ * over the parts, use csd::split() from <libcsd/split.h> instead, which
+ * does not allocate.
+ */
+list<str> split_str(str_view to_split, str_view by);
+
+} // namespace csd
@@ -0,0 +1,191 @@
+/* <libcsd/logger.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/file.h>
+#include <libcsd/format.h>
+#include <libcsd/thread.h>
+
+namespace csd {
+
+enum class log_level : char
+{
+	debug,
+	info,
+	warning,
+	error,
+};
+
+/**
+ * @enum log_overflow
+ * What happens to a message if the ring buffer of its thread is full,
+ * because the background thread cannot keep up. With `drop` the message is
+ * lost and counted in logger::dropped(), and with `block` the calling
+ * thread waits until there is room.
+ */
+enum class log_overflow : char
+{
+	drop,
+	block,
+};
+
+struct log_ring;
+
+/**
+ * @class logger
+ * Asynchronous logger, which never waits for the disk. Each thread that
+ * logs gets its own ring buffer, into which the message is formatted
+ * directly, without any locks or allocations. A background csd::thread
+ * takes the messages from all rings and writes them to the file in large
+ * batches. The messages of a thread are always written in the order they
+ * were logged. Each batch is sorted by timestamp, but a message which was
+ * still being logged while a batch was collected goes into the next one, so
+ * lines from different threads may be slightly out of order.
+ *
+ *  csd::file out;
+ *  out.open("server.log", "w");
+ *
+ *  csd::logger log(out);
+ *
+ *  log.info("listening on port {}", port);
+ *  log.warning("slow request to {}, took {:.1f} ms", path, elapsed);
+ *
+ * Each line starts with the UTC time and the level:
+ *
+ *  2024-06-01 12:30:45.123456 warning: slow request to /, took 51.2 ms
+ *
+ * Messages below level() are skipped before they are formatted. The rings
+ * take `ring_size` bytes per thread, which bounds the memory used, and a
+ * single message may take at most half of that; longer ones are cut off.
+ * When a ring is full, the `overflow` policy decides what happens. The
+ * background thread checks for new messages every `drain_interval_us`
+ * microseconds when idle. The file has to outlive the logger, which writes
+ * out all remaining messages when it's destroyed.
+ */
+struct logger
+{
+	static constexpr int default_ring_size = 64 * 1024;
+	static constexpr int drain_interval_us = 1000;
+
+	logger(file& out, log_overflow overflow = log_overflow::drop,
+		   int ring_size = default_ring_size);
+	logger(const logger& copied_logger) = delete;
+	~logger();
+
+	void set_level(log_level level);
+	log_level level() const;
+
+	bool enabled(log_level level) const
+	{
+		return (char) level >= __atomic_load_n(&m_level, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * @method dropped
+	 * Returns how many messages were lost because their ring was full.
+	 */
+	size_t dropped() const;
+
+	/**
+	 * @method failed_writes
+	 * Returns how many times writing to the file failed. The messages of a
+	 * failed write are lost.
+	 */
+	size_t failed_writes() const;
+
+	/**
+	 * @method flush
+	 * Wait until everything logged before this call is written to the
+	 * file.
+	 */
+	void flush();
+
+	template <csd::StringConvertible... Args>
+	void log(log_level level, const format_string<no_deduce<Args>...>& fmt,
+			 const Args&...args)
+	{
+		log_ring *ring;
+		size_t space;
+		size_t len;
+		char *ptr;
+
+		if (!enabled(level))
+			return;
+
+		ring = local_ring();
+		ptr = begin_record(ring, &space);
+		len = csd::format_to(ptr, space, fmt, args...);
+
+		if (!space || len > space) {
+			ptr = reserve_record(ring, &len);
+			if (!ptr)
+				return;
+			csd::format_to(ptr, len, fmt, args...);
+		}
+
+		commit_record(ring, level, len);
+	}
+
+	template <csd::StringConvertible... Args>
+	void debug(const format_string<no_deduce<Args>...>& fmt,
+			   const Args&...args)
+	{
+		log(log_level::debug, fmt, args...);
+	}
+
+	template <csd::StringConvertible... Args>
+	void info(const format_string<no_deduce<Args>...>& fmt,
+			  const Args&...args)
+	{
+		log(log_level::info, fmt, args...);
+	}
+
+	template <csd::StringConvertible... Args>
+	void warning(const format_string<no_deduce<Args>...>& fmt,
+				 const Args&...args)
+	{
+		log(log_level::warning, fmt, args...);
+	}
+
+	template <csd::StringConvertible... Args>
+	void error(const format_string<no_deduce<Args>...>& fmt,
+			   const Args&...args)
+	{
+		log(log_level::error, fmt, args...);
+	}
+
+	logger& operator=(const logger& other) = delete;
+
+  private:
+	file& m_out;
+	log_overflow m_overflow;
+	char m_level;
+	bool m_stop;
+	int m_ring_size;
+	unsigned long m_id;
+	size_t m_dropped;
+	size_t m_failed_writes;
+	log_ring *m_rings;
+	mutex m_rings_lock;
+	char *m_buffer;
+	thread m_thread;
+
+	/* Returns the ring of the calling thread, creating it on first use. */
+	log_ring *local_ring();
+
+	/* Returns where the next message goes, and how much contiguous space
+	   there is right now in `space`. */
+	char *begin_record(log_ring *ring, size_t *space);
+
+	/* Makes room for a message of `len` bytes, waiting or dropping it
+	   according to the overflow policy. Cuts `len` to the maximum message
+	   size, and returns NULL if the message has been dropped. */
+	char *reserve_record(log_ring *ring, size_t *len);
+	void commit_record(log_ring *ring, log_level level, size_t len);
+
+	static void *drain_thread(void *self);
+	bool drain();
+};
+
+} // namespace csd
@@ -20,7 +20,11 @@ struct map
 
 		str to_str() const
 		{
-			return csd::format("{{}: {}}", key, value);
+			str_builder builder;
+
+			builder.append('{').append(key).append(": ").append(value);
+			builder.append('}');
+			return builder.finish();
 		}
 	};
 
@@ -163,19 +167,18 @@ struct map
 
 	str to_str() const
 	{
-		str ret = '{';
-
-		if (!len())
-			return "{}";
+		str_builder builder;
 
+		builder.append('{');
 		for (int i = 0; i < len(); i++) {
-			ret.append(m_pairs[i].key).append(": ").append(m_pairs[i].value);
-
-			if (i + 1 != len())
-				ret.append(", ");
+			if (i)
+				builder.append(", ");
+			builder.append(m_pairs[i].key).append(": ").append(
+				m_pairs[i].value);
 		}
+		builder.append('}');
 
-		return ret + '}';
+		return builder.finish();
 	}
 
 	iterator begin()
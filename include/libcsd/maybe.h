@@ -5,6 +5,15 @@
 
 #include <libcsd/error.h>
 
+namespace csd {
+
+/* Throws an unpack_exception. It's defined out of line, so that maybe<T>
+   does not need the complete exception types, and str.h can include this
+   header for the str::to_int() family. */
+[[noreturn]] void throw_unpack_exception();
+
+} // namespace csd
+
 /**
  * @class maybe<T>
  * Possibly a value. Used as a return type in functions, which usually return
@@ -42,7 +51,8 @@ template <typename T>
 struct maybe
 {
 	maybe()
-		: m_ok(false)
+		: m_value(nullptr)
+		, m_ok(false)
 	{ }
 
 	maybe(const T& copied_value)
@@ -51,7 +61,7 @@ struct maybe
 	{ }
 
 	maybe(T&& moved_value)
-		: m_value(new T(moved_value))
+		: m_value(new T(csd::move(moved_value)))
 		, m_ok(true)
 	{ }
 
@@ -68,7 +78,7 @@ struct maybe
 	T&& unpack()
 	{
 		if (!is_ok())
-			throw csd::unpack_exception();
+			csd::throw_unpack_exception();
 		return csd::move(*m_value);
 	}
 
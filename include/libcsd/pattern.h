@@ -0,0 +1,95 @@
+/* <libcsd/pattern.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/list.h>
+#include <libcsd/maybe.h>
+#include <libcsd/str.h>
+
+namespace csd {
+
+/**
+ * @class pattern
+ * Compiled glob or regular expression. The pattern is turned into an
+ * automaton, which reads each byte of the input once and never backtracks,
+ * so matching takes linear time no matter what the pattern looks like.
+ *
+ *  csd::pattern date("[0-9]{4}-[0-9]{2}-[0-9]{2}");
+ *  csd::pattern logs("*.log", csd::pattern::glob);
+ *
+ *  if (logs.match(path))
+ *      println(date.search(line).unpack());
+ *
+ *  for (csd::str_view number : csd::pattern("[0-9]+").find_all(line))
+ *      ...
+ *
+ * The regex syntax is a practical subset of POSIX extended regexes:
+ *
+ *  a .           literal byte, any byte apart from a newline
+ *  [abc] [^a-z]  byte class, which may also contain \d, \w and \s
+ *  \d \w \s      digit, word byte and whitespace, or the opposite in upper
+ *                case, \n \t \r \f \v \0 and \xHH, and \ before any
+ *                punctuation character for a literal
+ *  ab a|b (ab)   concatenation, alternation, grouping; (?:ab) is the same
+ *  * + ? {n}     repetition, also {n,} and {n,m}, up to 1000
+ *  ^ $           anchors, only at the start and the end of the pattern,
+ *                where they apply to all of it
+ *
+ * There are no capture groups or backreferences, which cannot be matched
+ * without backtracking. When several matches start at the same place, the
+ * longest one wins. Globs support *, ? and [abc] or [!abc], and have to
+ * match the whole input, where * matches any bytes, including slashes.
+ * An invalid pattern throws an invalid_argument_exception.
+ *
+ * The automaton states are built lazily, as the input needs them, and kept
+ * in a cache of up to `max_cached_states`, so even huge patterns use a
+ * bounded amount of memory. Because of the cache, a pattern may not be used
+ * from several threads at once.
+ */
+struct pattern
+{
+	enum syntax
+	{
+		regex,
+		glob,
+	};
+
+	static constexpr int max_cached_states = 4096;
+
+	struct program;
+
+	pattern(str_view source, syntax kind = regex);
+	pattern(const pattern& copied_pattern) = delete;
+	~pattern();
+
+	/**
+	 * @method match
+	 * Returns true if the whole input matches the pattern.
+	 */
+	bool match(str_view input);
+
+	/**
+	 * @method search
+	 * Returns the first match in the input, which is a view into it, or an
+	 * empty maybe if there is none.
+	 */
+	maybe<str_view> search(str_view input);
+
+	/**
+	 * @method find_all
+	 * Returns all matches which do not overlap, from left to right. After an
+	 * empty match, the next one is looked for one byte further.
+	 */
+	list<str_view> find_all(str_view input);
+
+	pattern& operator=(const pattern& other) = delete;
+
+  private:
+	program *m_forward;
+	program *m_reverse; /* the pattern read backwards, finds match starts */
+	bool m_anchor_start;
+	bool m_anchor_end;
+};
+
+} // namespace csd
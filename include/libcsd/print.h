@@ -8,6 +8,77 @@
 
 namespace csd {
 
+/**
+ * @var print_buffer_size
+ * Size of the per-thread buffer print() and println() write into. Anything
+ * up to this size is written out with a single write(2) call.
+ */
+constexpr int print_buffer_size = 4096;
+
+/**
+ * @enum print_buffering
+ * When print() and println() write the buffered text to stdout.
+ *
+ *  line   as soon as the printed text contains a newline
+ *  block  only when the buffer is full, on csd::flush() or thread exit
+ *  none   at the end of each call
+ *
+ * The default is line buffering if stdout is a terminal, and block
+ * buffering otherwise. Each thread has its own buffer, so lines printed by
+ * different threads never get mixed, even with block buffering. Buffers of
+ * threads still running when the process exits are written out by exit().
+ */
+enum class print_buffering : char
+{
+	line,
+	block,
+	none,
+};
+
+/**
+ * @function set_print_buffering
+ * Set the buffering policy for all threads. Any text already buffered by
+ * the calling thread is written out first.
+ */
+void set_print_buffering(print_buffering policy);
+print_buffering get_print_buffering();
+
+/**
+ * @function flush
+ * Write out everything the calling thread has printed to stdout, but is
+ * still in its buffer. This does not touch the stdio buffers, so call
+ * fflush(stdout) too if mixing print() with printf().
+ */
+void flush();
+
+/* The printing itself, used by the templates below. */
+void print_erased(const format_arg *args, int nargs, bool newline);
+void print_erased_to(int fd, const format_arg *args, int nargs, bool newline);
+void print_erased_to(file& out, const format_arg *args, int nargs,
+					 bool newline);
+void print_erased_to(stream& out, const format_arg *args, int nargs,
+					 bool newline);
+
+/* Like format_value, but prints bools as "true" and "false". */
+template <typename T>
+struct print_value : format_value<T>
+{
+	using format_value<T>::format_value;
+};
+
+template <>
+struct print_value<bool>
+{
+	format_arg arg;
+
+	print_value(bool value)
+	{
+		arg.kind = format_kind::string;
+		arg.string = value ? "true" : "false";
+		arg.len = value ? 4 : 5;
+	}
+};
+
 void print_single(const void *val);
 void print_single(const char *val);
 void print_single(const str& val);
@@ -25,40 +96,75 @@ void print_single(const bool val);
 
 } // namespace csd
 
-template <typename T>
-void print(const T *value)
+/**
+ * @function print
+ * Print the values to stdout, separated by spaces. Strings are printed as
+ * they are, numbers like with csd::to_chars(), pointers in hex, and other
+ * types through their to_str() method.
+ *
+ *  print("x =", 1.5, true);     // x = 1.5 true
+ *
+ * The whole call is formatted into a per-thread buffer first, without
+ * taking any locks, and written to stdout according to the buffering
+ * policy, see csd::print_buffering. Note that printf() has its own buffer,
+ * so text printed with both may come out in a different order.
+ */
+template <typename... Args>
+void print(const Args&...values)
 {
-	csd::print_single(value);
+	csd::print_erased(csd::format_arg_array<sizeof...(Args)>{
+						  {csd::print_value<Args>(values).arg...}}
+						  .args,
+					  sizeof...(Args), false);
 }
 
-template <csd::ImplementsToString T>
-void print(const T& value)
+/**
+ * @function println
+ * Same as print(), followed by a newline. With the default line buffering,
+ * the whole line is written with a single write(2) call, so lines printed
+ * at the same time by different threads do not get mixed.
+ */
+template <typename... Args>
+void println(const Args&...values)
 {
-	csd::print_single(value.to_str());
+	csd::print_erased(csd::format_arg_array<sizeof...(Args)>{
+						  {csd::print_value<Args>(values).arg...}}
+						  .args,
+					  sizeof...(Args), true);
 }
 
-/* Multiple-argument print() functions. */
-
-template <typename T, typename... VT>
-void print(const T& value, const VT&...values)
-{
-	csd::print_single(value);
-
-	if constexpr (sizeof...(values) != 0) {
-		csd::print_single(' ');
-		print(values...);
+/**
+ * @function print_to
+ * Same as print(), but the text goes to the given file descriptor, file or
+ * stream. It's not buffered between calls, so each call is written out
+ * right away, usually at once. Printing to fd 1 first writes anything still
+ * buffered by print(), so the order stays the same.
+ *
+ *  print_to(2, "error:", message);
+ *  println_to(log_file, "took", elapsed, "ms");
+ */
+template <typename Out, typename... Args>
+	requires requires(Out& out, const csd::format_arg *args) {
+		csd::print_erased_to(out, args, 0, false);
 	}
-}
-
-template <typename T, typename... VT>
-void println(const T& value, const VT&...values)
+void print_to(Out&& out, const Args&...values)
 {
-	csd::print_single(value);
+	csd::print_erased_to(out,
+						 csd::format_arg_array<sizeof...(Args)>{
+							 {csd::print_value<Args>(values).arg...}}
+							 .args,
+						 sizeof...(Args), false);
+}
 
-	if constexpr (sizeof...(values) != 0) {
-		csd::print_single(' ');
-		print(values...);
+template <typename Out, typename... Args>
+	requires requires(Out& out, const csd::format_arg *args) {
+		csd::print_erased_to(out, args, 0, false);
 	}
-
-	csd::print_single('\n');
+void println_to(Out&& out, const Args&...values)
+{
+	csd::print_erased_to(out,
+						 csd::format_arg_array<sizeof...(Args)>{
+							 {csd::print_value<Args>(values).arg...}}
+							 .args,
+						 sizeof...(Args), true);
 }
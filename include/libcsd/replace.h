@@ -0,0 +1,78 @@
+/* <libcsd/replace.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/list.h>
+#include <libcsd/str.h>
+
+namespace csd {
+
+/**
+ * @class multi_replacer
+ * Replaces many different patterns in a single pass over the input. This is
+ * much faster than calling str::replace_all() once for each pattern, and
+ * the replacements are never scanned again, so a replacement containing
+ * another pattern stays as it is.
+ *
+ *  csd::multi_replacer page;
+ *
+ *  page.add("{title}", title)
+ *      .add("{body}", body)
+ *      .add("{author}", "bellrise");
+ *
+ *  csd::str html = page.apply(html_template);
+ *
+ * If more than one pattern matches, the one starting first wins, and of
+ * those, the longest one. Adding the same pattern again changes its
+ * replacement. The patterns are compiled into an Aho-Corasick automaton on
+ * the first apply() after they change, so apply() reads each byte of the
+ * input once, and runs in time linear to the input and the number of
+ * matches, no matter how many patterns there are.
+ */
+struct multi_replacer
+{
+	multi_replacer();
+	multi_replacer(const multi_replacer& copied_replacer) = delete;
+	~multi_replacer();
+
+	/**
+	 * @method add
+	 * Add a pattern with its replacement. Throws an
+	 * invalid_argument_exception if the pattern is empty.
+	 */
+	multi_replacer& add(str_view pattern, str_view replacement);
+
+	str apply(str_view input);
+
+	/**
+	 * @method len
+	 * Returns the amount of patterns.
+	 */
+	int len() const;
+
+	multi_replacer& operator=(const multi_replacer& other) = delete;
+
+  private:
+	list<str> m_patterns;
+	list<str> m_replacements;
+
+	/* The automaton, with a row of m_nclasses transitions for each state.
+	   Bytes which do not appear in any pattern share class 0. */
+	int *m_next;
+	int *m_depth;
+	int *m_match;  /* pattern ending exactly at this state, or -1 */
+	int *m_fail;   /* longest proper suffix which is also a state */
+	int *m_output; /* closest state on the failure chain with a match */
+	int *m_pending; /* longest match at each start, by start % m_window */
+	int m_window;
+	int m_nstates;
+	int m_nclasses;
+	unsigned char m_class[256];
+	bool m_compiled;
+
+	void compile();
+	void free_automaton();
+};
+
+} // namespace csd
@@ -0,0 +1,138 @@
+/* <libcsd/rope.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/rc.h>
+#include <libcsd/str.h>
+
+/**
+ * @class rope
+ * String for large texts which are edited often. Instead of one contiguous
+ * buffer, the text is kept in chunks of up to `max_chunk` bytes, which are
+ * the leaves of a balanced tree. Inserting, erasing and concatenating only
+ * rebuild the O(log n) nodes along the edited path, so they stay fast no
+ * matter how long the text is.
+ *
+ *  rope doc = file.read_all().view();
+ *
+ *  doc.insert(0, "# Title\n");
+ *  doc.erase(120, 16);
+ *  doc.replace(400, 5, "world");
+ *
+ *  for (csd::str_view chunk : doc.chunks())   // no copying
+ *      out.write_string(chunk);
+ *
+ * The nodes are immutable and reference counted, so copying a rope or
+ * taking a substr() shares the untouched parts of the tree and is cheap.
+ * Editing a rope never changes its copies, and copies may be used by
+ * different threads. Use to_str() to get a flat string when one is needed.
+ */
+struct rope
+{
+	static constexpr int max_chunk = 1024;
+	static constexpr int max_height = 64;
+
+	struct node;
+
+	struct chunk_iterator
+	{
+		chunk_iterator(const node *root);
+
+		csd::str_view operator*() const;
+		chunk_iterator& operator++();
+
+		friend bool operator==(const chunk_iterator& a,
+							   const chunk_iterator& b)
+		{
+			/* The same chunk may appear twice in a tree, so compare all
+			   that is left to visit, not just the current chunk. */
+			if (a.m_depth != b.m_depth)
+				return false;
+			for (int i = 0; i < a.m_depth; i++) {
+				if (a.m_stack[i] != b.m_stack[i])
+					return false;
+			}
+			return true;
+		}
+
+		friend bool operator!=(const chunk_iterator& a,
+							   const chunk_iterator& b)
+		{
+			return !(a == b);
+		}
+
+	  private:
+		/* Subtrees left to visit, with the current chunk on top. */
+		const node *m_stack[max_height];
+		int m_depth;
+
+		void descend_left(const node *from);
+	};
+
+	struct chunk_range
+	{
+		const node *root;
+
+		chunk_iterator begin() const;
+		chunk_iterator end() const;
+	};
+
+	rope();
+	rope(csd::str_view string);
+	rope(const rope& other);
+	rope(rope&& moved);
+	~rope();
+
+	int len() const;
+	bool empty() const;
+
+	/**
+	 * @method chunks
+	 * Returns a range over the chunks of the text, in order. Each chunk is
+	 * a str_view into the rope, valid as long as the rope is not modified.
+	 */
+	chunk_range chunks() const;
+
+	/**
+	 * @method substr
+	 * Returns the `length` bytes starting at `start_index` as a new rope,
+	 * with the same rules as str::substr(). Only the chunks at both edges
+	 * are copied, everything in between is shared.
+	 */
+	rope substr(int start_index, int length = -1) const;
+
+	/* Chain-modify methods. Indices have to be in the range of the rope,
+	   otherwise an index_exception is thrown. */
+	rope& insert(int index, csd::str_view string);
+	rope& insert(int index, const rope& other);
+	rope& erase(int index, int length);
+	rope& replace(int index, int length, csd::str_view replacement);
+	rope& append(csd::str_view string);
+	rope& append(const rope& other);
+
+	/**
+	 * @method to_str
+	 * Copies the whole text into a flat str.
+	 */
+	str to_str() const;
+
+	rope& operator=(const rope& other);
+	rope& operator=(rope&& other);
+	rope& operator+=(csd::str_view string);
+	rope& operator+=(const rope& other);
+
+	/**
+	 * @method []
+	 * Returns the character at the given index, in O(log n). May throw
+	 * index_exception if `index` is out of bounds.
+	 */
+	char operator[](int index) const;
+
+  private:
+	node *m_root;
+
+	explicit rope(node *root);
+
+	void check_range(int index, int length) const;
+};
@@ -0,0 +1,112 @@
+/* <libcsd/shared_str.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/rc.h>
+#include <libcsd/str.h>
+
+/**
+ * @class shared_str
+ * Immutable string, which shares its buffer between all copies. The text
+ * is allocated once, together with an atomic reference count, so copying a
+ * shared_str is O(1) and never allocates. This makes it a good fit for
+ * strings which are passed to many threads, or stored in many maps.
+ *
+ *  shared_str path = some_str;      // copies the text once
+ *  shared_str other = path;         // shares it
+ *  shared_str ext = path.substr(path.len() - 4);
+ *
+ *  println(ext.use_count());        // 3, all share the same buffer
+ *
+ *  if (ext == ".txt")
+ *      println(ext);
+ *
+ * A substr() points into the buffer of its parent, and keeps it alive.
+ * Because of that, the text is not guaranteed to be NUL-terminated. Use
+ * to_str() to get an owned, mutable copy.
+ */
+struct shared_str
+{
+	using iterator = const char *;
+
+	static constexpr int invalid_index = -1;
+
+	struct block;
+
+	shared_str();
+	shared_str(const char *string);
+	shared_str(const str& string);
+	explicit shared_str(csd::str_view view);
+	shared_str(const shared_str& other);
+	shared_str(shared_str&& moved);
+	~shared_str();
+
+	int len() const;
+	bool empty() const;
+	size_t hash() const;
+
+	/**
+	 * @method view
+	 * Returns a view of the text, valid as long as this shared_str or any
+	 * copy of it exists.
+	 */
+	csd::str_view view() const;
+	str to_str() const;
+
+	/**
+	 * @method use_count
+	 * Returns the number of shared_str objects sharing the buffer, or 0
+	 * for an empty string, which has no buffer at all.
+	 */
+	long use_count() const;
+
+	int find(csd::str_view substr) const;
+	int rfind(csd::str_view substr) const;
+	int find_char(char c, int start_index = 0) const;
+	bool contains(csd::str_view substr) const;
+	bool begins_with(csd::str_view other) const;
+	bool ends_with(csd::str_view other) const;
+
+	/**
+	 * @method substr
+	 * Returns a slice of the string with the same rules as str::substr().
+	 * Nothing is copied, the new string shares the buffer of this one.
+	 */
+	shared_str substr(int start_index, int length = -1) const;
+
+	shared_str& operator=(const shared_str& other);
+	shared_str& operator=(shared_str&& other);
+	/* Exact matches for any other string type, so that comparing against a
+	   str does not have to choose between converting either side. */
+	template <csd::StringLike T>
+	bool operator==(const T& other) const
+	{
+		return view() == csd::str_view(other);
+	}
+
+	template <csd::StringLike T>
+	int operator<=>(const T& other) const
+	{
+		return view().compare(csd::str_view(other));
+	}
+
+	operator csd::str_view() const;
+
+	/**
+	 * @method []
+	 * Returns the character at the given index. May throw index_exception
+	 * if `index` is out of bounds.
+	 */
+	const char& operator[](int index) const;
+
+	iterator begin() const;
+	iterator end() const;
+
+  private:
+	block *m_block;
+	const char *m_ptr;
+	int m_len;
+
+	shared_str(block *shared_block, const char *ptr, int len);
+};
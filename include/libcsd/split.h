@@ -0,0 +1,103 @@
+/* <libcsd/split.h>
+   Copyright (c) 2024 bellrise */
+
+#pragma once
+
+#include <libcsd/str.h>
+
+namespace csd {
+
+/**
+ * @class splitter
+ * Lazy sequence of the parts of a string, split by some separator. Each part
+ * is a str_view into the original string, so splitting does not allocate
+ * anything, and each part is only found when the iterator reaches it. Create
+ * one with split(), split_any() or split_whitespace():
+ *
+ *  for (csd::str_view field : csd::split("a,b,,c", ","))
+ *      println(field);                    // "a", "b", "", "c"
+ *
+ *  for (csd::str_view word : csd::split_whitespace("  to be  or "))
+ *      println(word);                     // "to", "be", "or"
+ *
+ * If `max_splits` is not negative, the string is split at most that many
+ * times, and the last part holds the rest of the string. Like any view, the
+ * parts are only valid as long as the original string is.
+ */
+struct splitter
+{
+	enum split_mode
+	{
+		split_by_string,
+		split_by_any,
+		split_by_whitespace,
+	};
+
+	struct iterator
+	{
+		iterator(const splitter *parent, bool at_end);
+
+		str_view operator*() const;
+		iterator& operator++();
+
+		friend bool operator==(const iterator& a, const iterator& b)
+		{
+			if (a.m_at_end || b.m_at_end)
+				return a.m_at_end == b.m_at_end;
+			return a.m_rest.ptr == b.m_rest.ptr
+				&& a.m_token.ptr == b.m_token.ptr;
+		}
+
+		friend bool operator!=(const iterator& a, const iterator& b)
+		{
+			return !(a == b);
+		}
+
+	  private:
+		const splitter *m_parent;
+		str_view m_rest;
+		str_view m_token;
+		int m_splits;
+		bool m_last;
+		bool m_at_end;
+
+		void advance();
+		int find_separator(int *sep_len) const;
+	};
+
+	splitter(str_view input, str_view separator, split_mode mode,
+			 int max_splits);
+
+	iterator begin() const;
+	iterator end() const;
+
+  private:
+	str_view m_input;
+	str_view m_separator;
+	split_mode m_mode;
+	int m_max_splits;
+	unsigned char m_any[32];
+};
+
+/**
+ * @function split
+ * Split `input` at every occurrence of `separator`. Empty parts are kept, so
+ * "a,,b" gives "a", "", "b". An empty separator does not split at all.
+ */
+splitter split(str_view input, str_view separator, int max_splits = -1);
+
+/**
+ * @function split_any
+ * Split `input` at every byte which appears in `separators`.
+ */
+splitter split_any(str_view input, str_view separators, int max_splits = -1);
+
+/**
+ * @function split_whitespace
+ * Split `input` at runs of whitespace, skipping any leading and trailing
+ * whitespace, so there are never any empty parts. Whitespace means the
+ * ASCII space, \t, \n, \v, \f and \r, whatever the locale.
+ */
+splitter split_whitespace(str_view input, int max_splits = -1);
+
+} // namespace csd
@@ -9,6 +9,9 @@
 struct bytes;
 struct str;
 
+template <typename T>
+struct maybe;
+
 namespace csd {
 
 /**
@@ -28,39 +31,371 @@ template <typename T>
 concept StringConvertible =
 	ImplementsToString<T> || requires(T t) { static_cast<str>(t); };
 
+/**
+ * @function find_bytes
+ * Returns the index of the first occurrence of `needle` in `hay`, or -1
+ * if there is none. Both are treated as raw bytes, so they may contain NUL
+ * characters. The search is vectorized where the CPU supports it, and runs
+ * in linear time for any input. An empty needle is found at index 0.
+ */
+int find_bytes(const char *hay, int hay_len, const char *needle,
+			   int needle_len);
+
+/**
+ * @function rfind_bytes
+ * Same as find_bytes, but returns the index of the last occurrence.
+ */
+int rfind_bytes(const char *hay, int hay_len, const char *needle,
+				int needle_len);
+
+/**
+ * @function find_byte
+ * Returns the index of the first `c` in `hay`, or -1.
+ */
+int find_byte(const char *hay, int hay_len, char c);
+
+/* ASCII case conversion and comparison, vectorized where the CPU supports
+   it. Only the letters A-Z and a-z are affected, all other bytes, including
+   anything above 0x7f, are left as they are. */
+void ascii_to_lower(char *ptr, int len);
+void ascii_to_upper(char *ptr, int len);
+bool ascii_equal_ignore_case(const char *a, const char *b, int len);
+
+/**
+ * @function find_bytes_ignore_case
+ * Same as find_bytes, but ASCII letters match regardless of their case.
+ */
+int find_bytes_ignore_case(const char *hay, int hay_len, const char *needle,
+						   int needle_len);
+
+/**
+ * @function is_valid_utf8
+ * Returns true if the bytes are well-formed UTF-8, as defined by the Unicode
+ * standard, which rules out overlong forms, surrogates and anything above
+ * U+10FFFF. The check is vectorized where the CPU supports it.
+ */
+bool is_valid_utf8(const char *ptr, int len);
+
+/**
+ * @function count_codepoints
+ * Returns the number of code points in UTF-8 text, by counting the bytes
+ * which do not continue a sequence. Only meaningful for valid UTF-8.
+ */
+int count_codepoints(const char *ptr, int len);
+
+/* Transcoding between UTF-8, UTF-16 and UTF-32, all in native byte order.
+   Each function returns the number of units written to `out`, or -1 if the
+   input is not valid, in which case the contents of `out` are unspecified.
+   The output has to be large enough: converting from UTF-8 never produces
+   more than `len` units, and utf16_length() or utf8_length() give the exact
+   size for valid input (utf8_length() returns -1 for invalid input). */
+int utf16_length(const char *ptr, int len);
+long utf8_length(const char16_t *units, int len);
+long utf8_length(const char32_t *units, int len);
+int utf8_to_utf16(const char *ptr, int len, char16_t *out);
+int utf8_to_utf32(const char *ptr, int len, char32_t *out);
+int utf16_to_utf8(const char16_t *units, int len, char *out);
+int utf32_to_utf8(const char32_t *units, int len, char *out);
+
+/**
+ * @enum base64_variant
+ * The alphabet of base64. The standard one uses + and / and pads the text
+ * with = to a multiple of 4 characters, while the URL and filename safe one
+ * from RFC 4648 uses - and _, and leaves out the padding, so its decoder
+ * rejects any = in the text.
+ */
+enum base64_variant
+{
+	base64_standard,
+	base64_url,
+};
+
+/* Hexadecimal and base64 encoding into a buffer provided by the caller. The
+   encoders write exactly hex_length() or base64_length() characters, in
+   lower case for hex, and return that number. The decoders are strict, and
+   return -1 for any character outside of the alphabet, including spaces,
+   for an odd number of hex digits, or for a base64 text with wrong padding
+   or leftover bits which are not zero, in which case the contents of `out`
+   are unspecified. Otherwise, they return the number of decoded bytes,
+   which is never more than len / 2 for hex, or len * 3 / 4 for base64.
+   Both directions are vectorized where the CPU supports it. */
+long hex_length(int nbytes);
+long hex_encode(const void *data, int len, char *out);
+int hex_decode(const char *text, int len, void *out);
+long base64_length(int nbytes, base64_variant variant = base64_standard);
+long base64_encode(const void *data, int len, char *out,
+				   base64_variant variant = base64_standard);
+int base64_decode(const char *text, int len, void *out,
+				  base64_variant variant = base64_standard);
+
+/**
+ * @class codepoint_iterator
+ * Decodes UTF-8 text one code point at a time. An invalid sequence yields a
+ * single U+FFFD, and is skipped up to the first byte which cannot continue
+ * it, as recommended by the Unicode standard. Get one from codepoints():
+ *
+ *  for (char32_t c : name.codepoints())
+ *      ...
+ */
+struct codepoint_iterator
+{
+	static constexpr char32_t replacement = 0xfffd;
+
+	codepoint_iterator(const char *ptr, const char *end);
+
+	char32_t operator*() const;
+	codepoint_iterator& operator++();
+
+	bool operator==(const codepoint_iterator& other) const
+	{
+		return m_ptr == other.m_ptr;
+	}
+
+	bool operator!=(const codepoint_iterator& other) const
+	{
+		return m_ptr != other.m_ptr;
+	}
+
+  private:
+	const char *m_ptr;
+	const char *m_end;
+	char32_t m_codepoint;
+	int m_width;
+
+	void decode();
+};
+
+struct codepoint_range
+{
+	const char *ptr;
+	int len;
+
+	codepoint_iterator begin() const;
+	codepoint_iterator end() const;
+};
+
+/**
+ * @class str_view
+ * Non-owning, read-only view into a string. A view is just a pointer and a
+ * length, so it's cheap to copy and slicing it with substr() or strip() does
+ * not allocate anything. It may be implicitly created from a str or a string
+ * literal, so functions which only read a string can take a str_view and
+ * accept both.
+ *
+ *  csd::str_view line = "GET /index.html HTTP/1.1";
+ *  csd::str_view method = line.substr(0, line.find_char(' '));  // "GET"
+ *
+ * The viewed string must outlive the view, and the view is not necessarily
+ * NUL-terminated. Use to_str() to make an owned copy.
+ */
 struct str_view
 {
-	char *ptr;
+	using iterator = const char *;
+
+	static constexpr int invalid_index = -1;
+
+	const char *ptr;
 	int len;
 
-	str_view(char *ptr_, int len_)
+	constexpr str_view()
+		: ptr("")
+		, len(0)
+	{ }
+
+	constexpr str_view(const char *ptr_, int len_)
 		: ptr(ptr_)
 		, len(len_)
 	{ }
+
+	constexpr str_view(const char *string)
+		: ptr(string ? string : "")
+		, len(string ? __builtin_strlen(string) : 0)
+	{ }
+
+	str_view(const str& string);
+
+	bool empty() const;
+	str to_str() const;
+	size_t hash() const;
+
+	int find(str_view substr) const;
+	int find_from(str_view substr, int start_index) const;
+	int rfind(str_view substr) const;
+	int find_char(char c, int start_index = 0) const;
+	bool contains(str_view substr) const;
+	bool begins_with(str_view other) const;
+	bool ends_with(str_view other) const;
+
+	/**
+	 * @method equals_ignore_case
+	 * Returns true if both strings are equal, treating upper and lower case
+	 * ASCII letters as the same. find_ignore_case() works like find(), with
+	 * the same rule.
+	 *
+	 *  if (header.equals_ignore_case("content-length"))
+	 *      ...
+	 */
+	bool equals_ignore_case(str_view other) const;
+	int find_ignore_case(str_view substr) const;
+
+	/**
+	 * @method substr
+	 * Returns a view of `length` bytes starting at `start_index`, with the
+	 * same rules as str::substr(). Nothing is copied.
+	 */
+	str_view substr(int start_index, int length = -1) const;
+
+	/* Return a view with the whitespace removed, the viewed string itself
+	   is never modified. */
+	str_view lstrip() const;
+	str_view rstrip() const;
+	str_view strip() const;
+
+	/**
+	 * @method compare
+	 * Compares the bytes of both strings, returning a negative number if
+	 * this string sorts before `other`, 0 if they are equal, and a positive
+	 * number if it sorts after. Bytes are compared as unsigned, and when one
+	 * string is a prefix of the other, the shorter one sorts first.
+	 */
+	int compare(str_view other) const;
+
+	/**
+	 * @method to_int
+	 * Parse the whole view as a number, with the rules of csd::from_chars().
+	 * Returns an empty maybe if it's not a valid number, or if it does not
+	 * fit into the returned type.
+	 *
+	 *  maybe<int> port = csd::str_view("8080").to_int();
+	 *  maybe<double> ratio = csd::str_view("0.75").to_double();
+	 */
+	maybe<int> to_int() const;
+	maybe<long long> to_int64() const;
+	maybe<unsigned long long> to_uint64() const;
+	maybe<double> to_double() const;
+
+	/* UTF-8 helpers, see csd::is_valid_utf8() and friends. */
+	bool is_valid_utf8() const;
+	int count_codepoints() const;
+	codepoint_range codepoints() const;
+
+	/**
+	 * @method to_utf16
+	 * Returns the text converted to UTF-16 code units in native byte order,
+	 * or an empty maybe if it's not valid UTF-8. to_utf32() does the same
+	 * with UTF-32.
+	 *
+	 *  bytes wide = name.to_utf16().unpack();
+	 *  auto *units = (const char16_t *) wide.raw_ptr();
+	 *  int nunits = wide.size() / sizeof(char16_t);
+	 */
+	maybe<bytes> to_utf16() const;
+	maybe<bytes> to_utf32() const;
+
+	/**
+	 * @method to_hex
+	 * Returns the bytes of the string encoded as lowercase hexadecimal, or
+	 * as base64 for to_base64(). Decode them with bytes::from_hex() and
+	 * bytes::from_base64().
+	 *
+	 *  csd::str_view("hi!").to_hex();                  // "686921"
+	 *  csd::str_view("hi!").to_base64();               // "aGkh"
+	 */
+	str to_hex() const;
+	str to_base64(base64_variant variant = base64_standard) const;
+
+	/**
+	 * @method ==
+	 * Returns true if both strings hold the same bytes. Strings of different
+	 * lengths are rejected right away, and longer ones by their first word,
+	 * so most unequal strings are told apart without calling memcmp().
+	 */
+	bool operator==(str_view other) const
+	{
+		unsigned long long word, other_word;
+
+		if (len != other.len)
+			return false;
+		if (len < 8)
+			return !__builtin_memcmp(ptr, other.ptr, len);
+
+		__builtin_memcpy(&word, ptr, 8);
+		__builtin_memcpy(&other_word, other.ptr, 8);
+
+		return word == other_word
+			&& !__builtin_memcmp(ptr + 8, other.ptr + 8, len - 8);
+	}
+
+	/**
+	 * @method <=>
+	 * Orders strings like compare(), so that <, <=, > and >= work, and they
+	 * can be sorted or used as ordered keys. The result is an int instead
+	 * of std::strong_ordering, so that no STL header is needed; like the
+	 * ordering types it is only meant to be compared against 0.
+	 *
+	 *  if (a < b)
+	 *      ...
+	 */
+	int operator<=>(str_view other) const
+	{
+		return compare(other);
+	}
+
+	/**
+	 * @method []
+	 * Returns the character at the given index. May throw index_exception
+	 * if `index` is out of bounds.
+	 */
+	const char& operator[](int index) const;
+
+	iterator begin() const;
+	iterator end() const;
 };
 
+/**
+ * @concept StringLike<T>
+ * Any type that implicitly converts to a str_view, like str, string literals
+ * or other string types. Numbers do not count, even though they could be
+ * turned into a temporary str first.
+ */
+template <typename T>
+concept StringLike =
+	requires(const T& t, void (*takes_view)(str_view)) { takes_view(t); };
+
 } // namespace csd
 
 /**
  * @class str
- * Heap-allocated string.
+ * Byte string. Short strings of up to `sso_capacity` bytes are stored inside
+ * the object itself, and only longer ones are allocated on the heap. In both
+ * cases the data is reachable through m_ptr, and is always NUL-terminated.
  */
 struct str
 {
 	using iterator = csd::iterator<char>;
 
 	static constexpr int invalid_index = -1;
+	static constexpr int sso_capacity = 23;
+	static constexpr int max_len = 0x7ffffffe;
 
 	str();
 	str(str&& moved);
 	str(const str& other);
 	str(const char *string);
 	str(const char *string, int maxlen);
+	explicit str(csd::str_view view);
 
+	/* Numbers are formatted with csd::to_chars(), and pointers as
+	   hexadecimal addresses starting with 0x. */
 	str(void *pointer);
-	str(size_t number);
-	str(float number);
 	str(int number);
+	str(unsigned int number);
+	str(long number);
+	str(unsigned long number);
+	str(long long number);
+	str(unsigned long long number);
+	str(float number);
+	str(double number);
 	str(char c);
 
 	template <csd::ImplementsToString T>
@@ -71,21 +406,94 @@ struct str
 	~str();
 
 	int len() const;
+
+	/**
+	 * @method capacity
+	 * Returns how many bytes the string can hold before it needs to
+	 * allocate a larger buffer.
+	 */
+	int capacity() const;
+
+	/**
+	 * @method reserve
+	 * Make room for at least `nchars` bytes, so that appending up to that
+	 * length does not allocate. Use this if you know the final size of a
+	 * string you're building.
+	 */
+	void reserve(int nchars);
+
+	/**
+	 * @method shrink_to_fit
+	 * Release any spare capacity, moving the string back inside the object
+	 * if it's short enough.
+	 */
+	void shrink_to_fit();
+
 	str to_str() const;
 	bytes to_bytes() const;
 	void print() const;
 	bool empty() const;
-	bool contains(const str& substr) const;
-	bool begins_with(const str& other) const;
-	bool ends_with(const str& other) const;
+	bool contains(csd::str_view substr) const;
+	bool begins_with(csd::str_view other) const;
+	bool ends_with(csd::str_view other) const;
 	str copy() const;
+	size_t hash() const;
+
+	/* Byte-wise ordering, see str_view::compare(). */
+	int compare(csd::str_view other) const;
+
+	/* Parse the string as a number, see str_view::to_int(). */
+	maybe<int> to_int() const;
+	maybe<long long> to_int64() const;
+	maybe<unsigned long long> to_uint64() const;
+	maybe<double> to_double() const;
+
+	/* UTF-8 helpers, see str_view. */
+	bool is_valid_utf8() const;
+	int count_codepoints() const;
+	csd::codepoint_range codepoints() const;
+	maybe<bytes> to_utf16() const;
+	maybe<bytes> to_utf32() const;
+
+	/**
+	 * @method from_utf16
+	 * Creates a UTF-8 string from UTF-16 code units in native byte order.
+	 * Returns an empty maybe if there is an unpaired surrogate. from_utf32()
+	 * works the same way, and rejects surrogates and values above U+10FFFF.
+	 */
+	static maybe<str> from_utf16(const char16_t *units, int len);
+	static maybe<str> from_utf32(const char32_t *units, int len);
+
+	/* Hex and base64 encoding, see str_view::to_hex(). */
+	str to_hex() const;
+	str to_base64(csd::base64_variant variant = csd::base64_standard) const;
 
 	/**
 	 * @method find
 	 * Returns the index at which the found sub-string starts,
 	 * or str::invalid_index if no string is found.
 	 */
-	int find(const str& substr) const;
+	int find(csd::str_view substr) const;
+
+	/**
+	 * @method find_from
+	 * Same as find(), but starts searching at `start_index`.
+	 */
+	int find_from(csd::str_view substr, int start_index) const;
+
+	/**
+	 * @method rfind
+	 * Returns the index at which the last occurrence of the sub-string
+	 * starts, or str::invalid_index if no string is found.
+	 */
+	int rfind(csd::str_view substr) const;
+
+	/**
+	 * @method find_char
+	 * Returns the index of the first `c` at or after `start_index`, or
+	 * str::invalid_index if there is no such character.
+	 */
+	int find_char(char c, int start_index = 0) const;
 
 	/**
 	 * @method substr
@@ -96,25 +504,74 @@ struct str
 	 */
 	str substr(int start_index, int length = -1) const;
 
+	/* Case-insensitive comparison of ASCII letters, see str_view. */
+	bool equals_ignore_case(csd::str_view other) const;
+	int find_ignore_case(csd::str_view substr) const;
+
+	/* Remove the whitespace from the start, end or both ends of the string.
+	   The string is trimmed in place, without reallocating. */
 	str& lstrip();
 	str& rstrip();
 	str& strip();
-	const csd::str_view view();
+	const csd::str_view view() const;
 
 	/* Chain-modify methods */
 	str& replace(char from, char to);
-	str& replace(const str& substr, const str& replacement);
+
+	/**
+	 * @method to_lower
+	 * Convert all ASCII letters to lower case in place. to_upper() does the
+	 * opposite. Other bytes are left unchanged.
+	 */
+	str& to_lower();
+	str& to_upper();
+
+	/**
+	 * @method replace
+	 * Replace the first occurrence of `substr` with `replacement`. The new
+	 * string is built with a single allocation, if it needs one at all.
+	 */
+	str& replace(csd::str_view substr, csd::str_view replacement);
+
+	/**
+	 * @method replace_all
+	 * Replace every occurrence of `substr` with `replacement`, scanning left
+	 * to right, so the replaced parts never overlap:
+	 *
+	 *  csd::str("aaaa").replace_all("aa", "b");    // "bb"
+	 *
+	 * The size of the result is computed first, so the string is only
+	 * reallocated once. To replace many different patterns at once, see
+	 * csd::multi_replacer.
+	 */
+	str& replace_all(csd::str_view substr, csd::str_view replacement);
 	str& append(const str& next);
 	str& append(const char *next);
+	str& append(csd::str_view next);
+
+	/**
+	 * @method append_hex
+	 * Appends `len` bytes of data, encoded as lowercase hexadecimal, or as
+	 * base64 for append_base64(). The text is encoded straight into the
+	 * string, so together with reserve() this needs no allocation at all.
+	 *
+	 *  str line = "key=";
+	 *  line.append_base64(key.raw_ptr(), key.size());
+	 */
+	str& append_hex(const void *data, int len);
+	str& append_base64(const void *data, int len,
+					   csd::base64_variant variant = csd::base64_standard);
 
 	/* Operator overloads */
 	str& operator=(const str& other);
+	str& operator=(str&& other);
 	str& operator=(const char *other);
 	str& operator+(const str& next);
 	str& operator+(const char *next);
 	str& operator+=(const str& next);
 	str& operator+=(const char *next);
-	bool operator==(const str& other) const;
+	bool operator==(csd::str_view other) const;
+	int operator<=>(csd::str_view other) const;
 
 	/**
 	 * @method []
@@ -131,15 +588,28 @@ struct str
 	char *m_ptr;
 	int m_space;
 	int m_len;
+	char m_local[sso_capacity + 1];
 
 	void copy_from(const str& other);
 	void copy_from_raw(const char *other, int other_len);
+	void move_from(str& moved);
+	bool is_local() const;
 
 	int resolve_index(int index) const;
 
-	/* Resize the buffer the string is stored in. This must return the
-	   number of available bytes to use, and not the resized space. This way
-	   any caller functions may check if the next operation will fit in the
-	   buffer. resize() may modify m_space. */
-	[[nodiscard]] int resize(int nbytes);
+	void append_raw(const char *ptr, int nbytes);
+
+	/* Makes room for `nbytes` more bytes at the end, and returns where they
+	   go. `data` may point into this string, and is updated if it moves. */
+	char *append_room(const void *&data, long nbytes);
+
+	/* Make sure the buffer holds at least `nbytes`, growing geometrically.
+	   Throws a memory_exception if the allocation fails, in which case the
+	   string is left untouched. */
+	void grow(int nbytes);
+	void realloc_to(int nbytes);
 };
+
+/* The to_int() family returns maybe<T>, which needs str for its exceptions,
+   so it can only be defined after it. */
+#include <libcsd/maybe.h>
@@ -50,6 +50,13 @@ struct stream
 	void write_char(char);
 	void write_byte(byte);
 
+	/**
+	 * @method write_string
+	 * Write all of `text`, with a single batch write if the stream has
+	 * one, or byte by byte otherwise.
+	 */
+	void write_string(csd::str_view text);
+
 	void set_read_single(read_single_function_t f);
 	void set_write_single(write_single_function_t f);
 	void set_read_batch(read_function_t f);
@@ -3,6 +3,7 @@
 #include <libcsd/box.h>
 #include <libcsd/map.h>
 #include <libcsd/routine.h>
+#include <pthread.h>
 
 namespace csd {
 
@@ -43,6 +44,46 @@ struct thread
 	void run(fptr_t fptr, void *arg);
 };
 
+/**
+ * @class mutex
+ * Mutual exclusion lock, used to guard data shared between threads. Prefer
+ * locking it with a scoped_lock, so it's always unlocked when leaving the
+ * scope, even if an exception is thrown.
+ */
+struct mutex
+{
+	mutex();
+	mutex(const mutex& copied_mutex) = delete;
+	~mutex();
+
+	void lock();
+	void unlock();
+	bool try_lock();
+
+  private:
+	pthread_mutex_t m_mutex;
+};
+
+/**
+ * @class scoped_lock
+ * Locks the mutex for the lifetime of this object.
+ *
+ *  void append_shared(list<int>& shared, csd::mutex& lock, int value)
+ *  {
+ *      csd::scoped_lock guard(lock);
+ *      shared.append(value);
+ *  }
+ */
+struct scoped_lock
+{
+	scoped_lock(mutex& locked_mutex);
+	scoped_lock(const scoped_lock& copied_lock) = delete;
+	~scoped_lock();
+
+  private:
+	mutex& m_mutex;
+};
+
 /**
  * @class typed_thread<R, A>
  * Wrapper around a csd::thread, which takes a single argument and returns a
@@ -0,0 +1,105 @@
+/* libcsd/src/arena.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/arena.h>
+#include <libcsd/error.h>
+#include <string.h>
+
+namespace csd {
+
+arena::arena(int block_size)
+	: m_top(nullptr)
+	, m_block_size(block_size)
+	, m_used(0)
+{
+	if (block_size <= 0)
+		throw csd::invalid_argument_exception("arena: block size must be > 0");
+}
+
+arena::arena(arena&& moved_arena)
+	: m_top(moved_arena.m_top)
+	, m_block_size(moved_arena.m_block_size)
+	, m_used(moved_arena.m_used)
+{
+	moved_arena.m_top = nullptr;
+	moved_arena.m_used = 0;
+}
+
+arena::~arena()
+{
+	clear();
+}
+
+void *arena::alloc(int nbytes, int align)
+{
+	size_t base;
+	size_t aligned;
+
+	if (nbytes < 0)
+		throw csd::invalid_argument_exception("arena: negative allocation");
+
+	if (m_top) {
+		base = (size_t) (m_top + 1) + m_top->used;
+		aligned = (base + align - 1) & ~((size_t) align - 1);
+
+		if (aligned + nbytes <= (size_t) (m_top + 1) + m_top->size) {
+			m_top->used += (aligned - base) + nbytes;
+			m_used += nbytes;
+			return (void *) aligned;
+		}
+	}
+
+	/* Does not fit, so start a new block. The extra `align` bytes make
+	   sure the aligned allocation always fits. */
+	new_block(nbytes + align);
+
+	base = (size_t) (m_top + 1);
+	aligned = (base + align - 1) & ~((size_t) align - 1);
+	m_top->used = (aligned - base) + nbytes;
+	m_used += nbytes;
+
+	return (void *) aligned;
+}
+
+char *arena::copy(const char *ptr, int len)
+{
+	char *copied = (char *) alloc(len + 1, 1);
+
+	if (len)
+		memcpy(copied, ptr, len);
+	copied[len] = 0;
+
+	return copied;
+}
+
+size_t arena::used() const
+{
+	return m_used;
+}
+
+void arena::clear()
+{
+	while (m_top) {
+		block *prev = m_top->prev;
+		delete[] (char *) m_top;
+		m_top = prev;
+	}
+
+	m_used = 0;
+}
+
+arena::block *arena::new_block(int nbytes)
+{
+	int size = nbytes > m_block_size ? nbytes : m_block_size;
+	block *b;
+
+	b = (block *) new char[sizeof(block) + size];
+	b->prev = m_top;
+	b->size = size;
+	b->used = 0;
+
+	m_top = b;
+	return b;
+}
+
+} // namespace csd
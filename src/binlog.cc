@@ -0,0 +1,444 @@
+/* libcsd/src/binlog.cc
+   Copyright (c) 2024 bellrise */
+
+#include <errno.h>
+#include <libcsd/binlog.h>
+#include <libcsd/builder.h>
+#include <libcsd/error.h>
+#include <libcsd/list.h>
+#include <string.h>
+#include <sys/types.h>
+
+/* A binary log starts with the magic below, followed by entries which all
+   begin with a 16-bit format ID. A record has the ID of its format, which
+   is never 0, and then the arguments, each one in its native layout, or
+   as a 32-bit length and the bytes for strings. An ID of 0 starts the
+   definition of the next format:
+
+    u16 id, u16 nargs, u16 nfields, u32 text length
+    the format string
+    the format_kind of each argument, then the size of each argument
+    nfields + 1 format_fields, as written by field_size bytes below
+
+   The fields are the ones parsed at compile time, so the decoder does not
+   have to parse the format string again. */
+
+namespace csd {
+
+static constexpr char magic[8] = {'c', 's', 'd', 'b', 'l', 'o', 'g', '1'};
+static constexpr size_t initial_size = 4096;
+static constexpr size_t field_size = 17;
+
+template <typename T>
+static char *put(char *p, T value)
+{
+	memcpy(p, &value, sizeof(value));
+	return p + sizeof(value);
+}
+
+static char *put_field(char *p, const format_field& field)
+{
+	p = put<unsigned short>(p, field.text_len);
+	p = put<unsigned short>(p, field.field_len);
+	p = put<unsigned char>(p, field.text_escaped);
+	p = put<unsigned char>(p, field.plain);
+	p = put<unsigned char>(p, field.arg);
+	p = put<char>(p, field.spec.fill);
+	p = put<char>(p, field.spec.align);
+	p = put<char>(p, field.spec.sign);
+	p = put<char>(p, field.spec.type);
+	p = put<unsigned char>(p, field.spec.alternate);
+	p = put<unsigned char>(p, field.spec.zero_pad);
+	p = put<short>(p, field.spec.width);
+	return put<short>(p, field.spec.precision);
+}
+
+binary_log::binary_log()
+	: m_data()
+	, m_len(0)
+	, m_nformats(0)
+{
+	memcpy(reserve(sizeof(magic)), magic, sizeof(magic));
+}
+
+unsigned short binary_log::add_format_erased(const format_layout& layout,
+											 const unsigned char *args,
+											 int nargs)
+{
+	unsigned short id;
+	char *p;
+
+	if (m_nformats == max_formats)
+		throw csd::memory_exception("binary_log: too many formats");
+
+	p = reserve(4 * sizeof(unsigned short) + sizeof(unsigned) + layout.text.len
+				+ 2 * nargs + (layout.nfields + 1) * field_size);
+	id = ++m_nformats;
+
+	p = put<unsigned short>(p, 0);
+	p = put<unsigned short>(p, id);
+	p = put<unsigned short>(p, nargs);
+	p = put<unsigned short>(p, layout.nfields);
+	p = put<unsigned>(p, layout.text.len);
+
+	memcpy(p, layout.text.ptr, layout.text.len);
+	p += layout.text.len;
+	memcpy(p, args, 2 * nargs);
+	p += 2 * nargs;
+
+	for (int i = 0; i <= layout.nfields; i++)
+		p = put_field(p, layout.fields[i]);
+
+	return id;
+}
+
+void binary_log::grow(size_t nbytes)
+{
+	size_t size = m_data.size() ? m_data.size() : initial_size;
+
+	while (size - m_len < nbytes)
+		size *= 2;
+
+	if (size > (size_t) str::max_len)
+		throw csd::memory_exception("binary_log: log is too large");
+
+	m_data.alloc(size);
+}
+
+size_t binary_log::write_to(file& out)
+{
+	char *data = (char *) m_data.raw_ptr();
+	size_t written = 0;
+	ssize_t n;
+
+	while (written < (size_t) m_len) {
+		n = (ssize_t) out.write_string(
+			csd::str_view(data + written, m_len - written));
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* Keep the rest, so that writing it again continues the log
+			   where the file ends. */
+			memmove(data, data + written, m_len - written);
+			m_len -= written;
+			throw csd::invalid_operation_exception(
+				"binary_log: failed to write the log");
+		}
+
+		written += n;
+	}
+
+	m_len = 0;
+	return written;
+}
+
+int binary_log::size() const
+{
+	return m_len;
+}
+
+bytes binary_log::to_bytes() const
+{
+	bytes data;
+
+	data.alloc(m_len);
+	data.copy_from(m_data.raw_ptr(), m_len);
+
+	return data;
+}
+
+/* Decoding */
+
+struct decoded_format
+{
+	csd::str_view text;
+	const unsigned char *args; /* the kinds, then the sizes */
+	int nargs;
+	int first_field;
+	int nfields;
+};
+
+struct log_reader
+{
+	const char *p;
+	const char *end;
+
+	bool has(size_t n) const
+	{
+		return (size_t) (end - p) >= n;
+	}
+
+	template <typename T>
+	T get()
+	{
+		T value;
+
+		memcpy(&value, p, sizeof(value));
+		p += sizeof(value);
+		return value;
+	}
+};
+
+static void invalid_log(const char *why)
+{
+	throw csd::invalid_argument_exception(str("binary log: ") + why);
+}
+
+/* The stored size of each kind of argument, see binary_value. */
+static bool valid_arg(format_kind kind, int size)
+{
+	switch (kind) {
+	case format_kind::string:
+		return size == 0;
+	case format_kind::character:
+		return size == 1;
+	case format_kind::signed_integer:
+	case format_kind::unsigned_integer:
+		return size == 1 || size == 2 || size == 4 || size == 8;
+	case format_kind::single:
+		return size == sizeof(float);
+	case format_kind::floating:
+		return size == sizeof(double);
+	case format_kind::pointer:
+		return size == sizeof(void *);
+	default:
+		return false;
+	}
+}
+
+/* Escaped text has each brace doubled, and the formatter relies on it. */
+static bool valid_escapes(const char *text, int len)
+{
+	for (int i = 0; i < len; i++) {
+		if (text[i] != '{' && text[i] != '}')
+			continue;
+		if (i + 1 == len || text[i + 1] != text[i])
+			return false;
+		i++;
+	}
+
+	return true;
+}
+
+static bool valid_spec(const format_spec& spec, format_kind kind)
+{
+	if (spec.width < 0 || spec.precision < -1)
+		return false;
+	if (spec.align && spec.align != '<' && spec.align != '>'
+		&& spec.align != '^')
+		return false;
+	if (spec.sign && spec.sign != '+' && spec.sign != '-' && spec.sign != ' ')
+		return false;
+
+	return format_spec_matches(spec, kind);
+}
+
+static format_field get_field(log_reader& in)
+{
+	format_field field;
+
+	field.text_len = in.get<unsigned short>();
+	field.field_len = in.get<unsigned short>();
+	field.text_escaped = in.get<unsigned char>();
+	field.plain = in.get<unsigned char>();
+	field.arg = in.get<unsigned char>();
+	field.spec.fill = in.get<char>();
+	field.spec.align = in.get<char>();
+	field.spec.sign = in.get<char>();
+	field.spec.type = in.get<char>();
+	field.spec.alternate = in.get<unsigned char>();
+	field.spec.zero_pad = in.get<unsigned char>();
+	field.spec.width = in.get<short>();
+	field.spec.precision = in.get<short>();
+
+	return field;
+}
+
+/* Reads a format definition, with the fields going to the end of `fields`.
+   Returns false if it's cut off. */
+static bool read_format(log_reader& in, list<decoded_format>& formats,
+						bytes& fields, int& nfields)
+{
+	decoded_format format;
+	format_field *field;
+	size_t text_len;
+	size_t used = 0;
+	int id;
+
+	if (!in.has(3 * sizeof(unsigned short) + sizeof(unsigned)))
+		return false;
+
+	id = in.get<unsigned short>();
+	format.nargs = in.get<unsigned short>();
+	format.nfields = in.get<unsigned short>();
+	text_len = in.get<unsigned>();
+
+	if (id != formats.len() + 1)
+		invalid_log("formats are not in order");
+	if (format.nargs > 256)
+		invalid_log("too many arguments");
+	if (text_len > (size_t) str::max_len)
+		invalid_log("format string is too long");
+	if (!in.has(text_len + 2 * format.nargs
+				+ (format.nfields + 1) * field_size))
+		return false;
+
+	format.text = csd::str_view(in.p, text_len);
+	in.p += text_len;
+	format.args = (const unsigned char *) in.p;
+	in.p += 2 * format.nargs;
+	format.first_field = nfields;
+
+	for (int i = 0; i < format.nargs; i++) {
+		if (!valid_arg((format_kind) format.args[i],
+					   format.args[format.nargs + i]))
+			invalid_log("invalid argument type");
+	}
+
+	if ((nfields + format.nfields + 1) * sizeof(format_field)
+		> (size_t) fields.size()) {
+		fields.alloc(2 * (nfields + format.nfields + 1)
+					 * sizeof(format_field));
+	}
+
+	field = (format_field *) fields.raw_ptr() + nfields;
+	for (int i = 0; i <= format.nfields; i++) {
+		field[i] = get_field(in);
+
+		if (field[i].text_len + field[i].field_len > text_len - used)
+			invalid_log("fields do not match the format string");
+		if (field[i].text_escaped
+			&& !valid_escapes(format.text.ptr + used, field[i].text_len))
+			invalid_log("invalid escape in the format string");
+		used += field[i].text_len + field[i].field_len;
+
+		if (i == format.nfields)
+			break;
+		if (field[i].arg >= format.nargs)
+			invalid_log("field without an argument");
+		if (!field[i].plain
+			&& !valid_spec(field[i].spec,
+						   (format_kind) format.args[field[i].arg]))
+			invalid_log("invalid format spec");
+	}
+
+	if (used != text_len || field[format.nfields].field_len)
+		invalid_log("fields do not match the format string");
+
+	nfields += format.nfields + 1;
+	formats.append(format);
+	return true;
+}
+
+/* Reads the arguments of a record into `args`. The kinds and sizes have
+   been checked with the format. Returns false if it's cut off. */
+static bool read_args(log_reader& in, const decoded_format& format,
+					  format_arg *args)
+{
+	format_arg *arg;
+	int size;
+
+	for (int i = 0; i < format.nargs; i++) {
+		arg = &args[i];
+		arg->kind = (format_kind) format.args[i];
+		size = format.args[format.nargs + i];
+
+		if (arg->kind == format_kind::string) {
+			if (!in.has(sizeof(unsigned)))
+				return false;
+			arg->len = in.get<unsigned>();
+			if (!in.has(arg->len))
+				return false;
+			arg->string = in.p;
+			in.p += arg->len;
+			continue;
+		}
+
+		if (!in.has(size))
+			return false;
+
+		switch (arg->kind) {
+		case format_kind::character:
+			arg->character = in.get<char>();
+			break;
+		case format_kind::signed_integer:
+			if (size == 1)
+				arg->integer = in.get<signed char>();
+			else if (size == 2)
+				arg->integer = in.get<short>();
+			else if (size == 4)
+				arg->integer = in.get<int>();
+			else
+				arg->integer = in.get<long long>();
+			break;
+		case format_kind::unsigned_integer:
+			if (size == 1)
+				arg->uinteger = in.get<unsigned char>();
+			else if (size == 2)
+				arg->uinteger = in.get<unsigned short>();
+			else if (size == 4)
+				arg->uinteger = in.get<unsigned>();
+			else
+				arg->uinteger = in.get<unsigned long long>();
+			break;
+		case format_kind::single:
+			arg->single = in.get<float>();
+			break;
+		case format_kind::floating:
+			arg->floating = in.get<double>();
+			break;
+		default:
+			arg->pointer = in.get<const void *>();
+			break;
+		}
+	}
+
+	return true;
+}
+
+str decode_binary_log(const bytes& data)
+{
+	log_reader in{(const char *) data.raw_ptr(),
+				  (const char *) data.raw_ptr() + data.size()};
+	list<decoded_format> formats;
+	bytes fields;
+	int nfields = 0;
+	format_arg args[256];
+	format_layout layout;
+	str_builder out;
+	int id;
+
+	if (!in.has(sizeof(magic)) || memcmp(in.p, magic, sizeof(magic)))
+		invalid_log("missing magic");
+	in.p += sizeof(magic);
+
+	while (in.has(sizeof(unsigned short))) {
+		id = in.get<unsigned short>();
+
+		if (id == 0) {
+			if (!read_format(in, formats, fields, nfields))
+				break;
+			continue;
+		}
+
+		if (id > formats.len())
+			invalid_log("record with an unknown format");
+
+		const decoded_format& format = formats[id - 1];
+		if (!read_args(in, format, args))
+			break;
+
+		layout.text = format.text;
+		layout.fields = (format_field *) fields.raw_ptr() + format.first_field;
+		layout.nfields = format.nfields;
+
+		format_erased_to(out, layout, args);
+		out.append('\n');
+	}
+
+	return out.finish();
+}
+
+} // namespace csd
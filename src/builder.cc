@@ -0,0 +1,192 @@
+/* libcsd/src/builder.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/builder.h>
+#include <libcsd/charconv.h>
+#include <libcsd/error.h>
+#include <new>
+#include <string.h>
+
+str_builder::str_builder(int size_hint)
+	: m_first {nullptr, m_local, 0, local_size}
+	, m_last(&m_first)
+	, m_len(0)
+{
+	if (size_hint > local_size)
+		add_chunk(size_hint);
+}
+
+str_builder::~str_builder()
+{
+	clear();
+}
+
+int str_builder::len() const
+{
+	return m_len;
+}
+
+template <typename T>
+str_builder& str_builder::append_number(T number)
+{
+	char *ptr = reserve(csd::to_chars_max);
+	commit(csd::to_chars(ptr, csd::to_chars_max, number));
+	return *this;
+}
+
+str_builder& str_builder::append(csd::str_view string)
+{
+	int room = m_last->space - m_last->len;
+	int first_part = string.len < room ? string.len : room;
+
+	if (string.len > str::max_len - m_len)
+		throw csd::memory_exception("str_builder: string too long");
+
+	/* Fill up the current chunk, and put the rest in a new one. */
+	memcpy(m_last->data + m_last->len, string.ptr, first_part);
+	m_last->len += first_part;
+	m_len += first_part;
+
+	if (first_part < string.len) {
+		add_chunk(string.len - first_part);
+		memcpy(m_last->data, string.ptr + first_part,
+			   string.len - first_part);
+		m_last->len = string.len - first_part;
+		m_len += m_last->len;
+	}
+
+	return *this;
+}
+
+str_builder& str_builder::append(const char *string)
+{
+	return append(csd::str_view(string));
+}
+
+str_builder& str_builder::append(const str& string)
+{
+	return append(string.view());
+}
+
+str_builder& str_builder::append(char c)
+{
+	*reserve(1) = c;
+	commit(1);
+	return *this;
+}
+
+str_builder& str_builder::append(int number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(unsigned int number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(long number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(unsigned long number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(long long number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(unsigned long long number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(float number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(double number)
+{
+	return append_number(number);
+}
+
+str_builder& str_builder::append(void *pointer)
+{
+	char *ptr = reserve(2 + csd::to_chars_max);
+
+	ptr[0] = '0';
+	ptr[1] = 'x';
+	commit(2 + csd::to_chars_hex(ptr + 2, csd::to_chars_max,
+								 (unsigned long) pointer));
+	return *this;
+}
+
+str str_builder::finish()
+{
+	str result;
+
+	result.reserve(m_len);
+	for (chunk *c = &m_first; c; c = c->next)
+		result.append(csd::str_view(c->data, c->len));
+
+	clear();
+	return result;
+}
+
+void str_builder::clear()
+{
+	chunk *c = m_first.next;
+
+	while (c) {
+		chunk *next = c->next;
+		::operator delete(c);
+		c = next;
+	}
+
+	m_first.next = nullptr;
+	m_first.len = 0;
+	m_last = &m_first;
+	m_len = 0;
+}
+
+char *str_builder::reserve(int nbytes)
+{
+	if (nbytes > str::max_len - m_len)
+		throw csd::memory_exception("str_builder: string too long");
+
+	if (m_last->space - m_last->len < nbytes)
+		add_chunk(nbytes);
+
+	return m_last->data + m_last->len;
+}
+
+void str_builder::commit(int nbytes)
+{
+	m_last->len += nbytes;
+	m_len += nbytes;
+}
+
+void str_builder::add_chunk(int min_space)
+{
+	/* Each chunk is at least as large as all previous ones together, so
+	   there are only O(log n) of them. */
+	int space = m_len > min_space ? m_len : min_space;
+	chunk *c;
+
+	if (space < local_size)
+		space = local_size;
+
+	c = (chunk *) ::operator new(sizeof(chunk) + space);
+	c->next = nullptr;
+	c->data = (char *) (c + 1);
+	c->len = 0;
+	c->space = space;
+
+	m_last->next = c;
+	m_last = c;
+}
@@ -53,6 +53,68 @@ str bytes::as_str() const
 	return str((const char *) m_ptr, null_at);
 }
 
+bool bytes::is_valid_utf8() const
+{
+	return view().is_valid_utf8();
+}
+
+int bytes::count_codepoints() const
+{
+	return view().count_codepoints();
+}
+
+csd::codepoint_range bytes::codepoints() const
+{
+	return view().codepoints();
+}
+
+maybe<bytes> bytes::to_utf16() const
+{
+	return view().to_utf16();
+}
+
+maybe<bytes> bytes::to_utf32() const
+{
+	return view().to_utf32();
+}
+
+str bytes::to_hex() const
+{
+	return view().to_hex();
+}
+
+str bytes::to_base64(csd::base64_variant variant) const
+{
+	return view().to_base64(variant);
+}
+
+maybe<bytes> bytes::from_hex(csd::str_view text)
+{
+	bytes result;
+
+	result.alloc(text.len / 2);
+	if (csd::hex_decode(text.ptr, text.len, result.m_ptr) == -1)
+		return {};
+
+	return result;
+}
+
+maybe<bytes> bytes::from_base64(csd::str_view text,
+								csd::base64_variant variant)
+{
+	bytes result;
+	int decoded;
+
+	/* Padding makes the result up to 2 bytes shorter than the space. */
+	result.alloc(text.len / 4 * 3 + text.len % 4);
+	decoded = csd::base64_decode(text.ptr, text.len, result.m_ptr, variant);
+	if (decoded == -1)
+		return {};
+
+	result.m_size = decoded;
+	return result;
+}
+
 void bytes::alloc(int nbytes)
 {
 	if (m_user_provided) {
@@ -146,6 +208,11 @@ int bytes::resolve_index(int index) const
 	return index;
 }
 
+csd::str_view bytes::view() const
+{
+	return {(const char *) m_ptr, m_size};
+}
+
 bytes::byte& bytes::operator[](int index)
 {
 	return m_ptr[resolve_index(index)];
@@ -0,0 +1,173 @@
+/* libcsd/src/case.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/str.h>
+#include <new>
+#include <string.h>
+
+#if defined __x86_64__ || defined __i386__
+# include <emmintrin.h>
+# define CSD_CASE_X86 1
+#endif
+
+/* ASCII case conversion and case-insensitive comparison. Letters are found
+   16 bytes at a time with two signed compares, which leave out all bytes
+   above 0x7f, so UTF-8 text passes through unchanged. Flipping bit 0x20 of
+   a letter changes its case. */
+
+namespace csd {
+
+static inline char lower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+#ifdef CSD_CASE_X86
+
+/* Returns 0x20 in every byte which lies in [first, last]. */
+static inline __m128i case_bit(__m128i block, char first, char last)
+{
+	__m128i in_range =
+		_mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(first - 1)),
+					  _mm_cmpgt_epi8(_mm_set1_epi8(last + 1), block));
+	return _mm_and_si128(in_range, _mm_set1_epi8(0x20));
+}
+
+static inline __m128i lower_block(__m128i block)
+{
+	return _mm_or_si128(block, case_bit(block, 'A', 'Z'));
+}
+
+#endif
+
+static void flip_case(char *ptr, int len, char first, char last)
+{
+	int i = 0;
+
+#ifdef CSD_CASE_X86
+	for (; i + 16 <= len; i += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *) (ptr + i));
+		_mm_storeu_si128((__m128i *) (ptr + i),
+						 _mm_xor_si128(block, case_bit(block, first, last)));
+	}
+#endif
+
+	for (; i < len; i++) {
+		if (ptr[i] >= first && ptr[i] <= last)
+			ptr[i] ^= 0x20;
+	}
+}
+
+void ascii_to_lower(char *ptr, int len)
+{
+	flip_case(ptr, len, 'A', 'Z');
+}
+
+void ascii_to_upper(char *ptr, int len)
+{
+	flip_case(ptr, len, 'a', 'z');
+}
+
+bool ascii_equal_ignore_case(const char *a, const char *b, int len)
+{
+	int i = 0;
+
+#ifdef CSD_CASE_X86
+	for (; i + 16 <= len; i += 16) {
+		__m128i block_a = _mm_loadu_si128((const __m128i *) (a + i));
+		__m128i block_b = _mm_loadu_si128((const __m128i *) (b + i));
+
+		if (_mm_movemask_epi8(
+				_mm_cmpeq_epi8(lower_block(block_a), lower_block(block_b)))
+			!= 0xffff)
+			return false;
+	}
+#endif
+
+	for (; i < len; i++) {
+		if (lower(a[i]) != lower(b[i]))
+			return false;
+	}
+
+	return true;
+}
+
+/* Lowers both strings and searches with find_bytes(), which is linear for
+   any input. Only used when the quick scan below compares too much. */
+static int find_folded(const char *hay, int hay_len, const char *needle,
+					   int needle_len, int offset)
+{
+	char *folded = (char *) ::operator new(hay_len - offset + needle_len);
+	int found;
+
+	memcpy(folded, hay + offset, hay_len - offset);
+	memcpy(folded + hay_len - offset, needle, needle_len);
+	ascii_to_lower(folded, hay_len - offset + needle_len);
+
+	found = find_bytes(folded, hay_len - offset, folded + hay_len - offset,
+					   needle_len);
+	::operator delete(folded);
+
+	return found == -1 ? -1 : found + offset;
+}
+
+int find_bytes_ignore_case(const char *hay, int hay_len, const char *needle,
+						   int needle_len)
+{
+	char first = lower(needle[0]);
+	char last;
+	long wasted = 0;
+	int i = 0;
+
+	if (needle_len == 0)
+		return 0;
+	if (needle_len > hay_len)
+		return -1;
+
+	last = lower(needle[needle_len - 1]);
+
+	/* Same idea as find_bytes(): only positions where both the first and
+	   the last byte match are compared in full. */
+#ifdef CSD_CASE_X86
+	const __m128i first_block = _mm_set1_epi8(first);
+	const __m128i last_block = _mm_set1_epi8(last);
+
+	for (; i + needle_len - 1 + 16 <= hay_len; i += 16) {
+		__m128i block_first = lower_block(
+			_mm_loadu_si128((const __m128i *) (hay + i)));
+		__m128i block_last = lower_block(
+			_mm_loadu_si128((const __m128i *) (hay + i + needle_len - 1)));
+		unsigned mask = _mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(first_block, block_first),
+						  _mm_cmpeq_epi8(last_block, block_last)));
+
+		while (mask) {
+			int pos = i + __builtin_ctz(mask);
+
+			if (ascii_equal_ignore_case(hay + pos, needle, needle_len))
+				return pos;
+
+			wasted += needle_len;
+			mask &= mask - 1;
+		}
+
+		if (wasted > 2L * i + 1024)
+			return find_folded(hay, hay_len, needle, needle_len, i);
+	}
+#endif
+
+	for (; i + needle_len <= hay_len; i++) {
+		if (lower(hay[i]) != first || lower(hay[i + needle_len - 1]) != last)
+			continue;
+		if (ascii_equal_ignore_case(hay + i, needle, needle_len))
+			return i;
+
+		wasted += needle_len;
+		if (wasted > 2L * i + 1024)
+			return find_folded(hay, hay_len, needle, needle_len, i);
+	}
+
+	return -1;
+}
+
+} // namespace csd
@@ -0,0 +1,1377 @@
+/* libcsd/src/charconv.cc
+   Copyright (c) 2024 bellrise */
+
+#include "lemire_tables.h"
+#include "ryu_tables.h"
+
+#include <libcsd/charconv.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Shortest round-trip formatting of floating point numbers is done with the
+   Ryu algorithm by Ulf Adams, "Ryu: Fast Float-to-String Conversion" (PLDI
+   2018). The binary value and both halfway points to its neighbours are
+   multiplied by a 128-bit power of 5, which gives all three as decimals in
+   one go, and then digits are removed for as long as the result stays
+   between the halfway points. The float variant uses the upper half of the
+   same tables.
+
+   Parsing goes the other way with the Eisel-Lemire algorithm, see Daniel
+   Lemire, "Number Parsing at a Gigabyte per Second" (2021). The first 19
+   significant digits are multiplied by a 128-bit power of 5, which is
+   enough to round correctly in all cases. Only when more digits are given
+   and they change the result, strtod() does the exact conversion. */
+
+namespace csd {
+
+using u64 = unsigned long long;
+using u128 = unsigned __int128;
+
+static const char digit_pairs[] = "00010203040506070809"
+								  "10111213141516171819"
+								  "20212223242526272829"
+								  "30313233343536373839"
+								  "40414243444546474849"
+								  "50515253545556575859"
+								  "60616263646566676869"
+								  "70717273747576777879"
+								  "80818283848586878889"
+								  "90919293949596979899";
+
+static int count_digits(u64 value)
+{
+	int n = 1;
+
+	while (1) {
+		if (value < 10)
+			return n;
+		if (value < 100)
+			return n + 1;
+		if (value < 1000)
+			return n + 2;
+		if (value < 10000)
+			return n + 3;
+		value /= 10000;
+		n += 4;
+	}
+}
+
+/* Write exactly `ndigits` digits of `value`, ending right before `end`. */
+static void write_digits(char *end, u64 value, int ndigits)
+{
+	while (ndigits >= 2) {
+		int pair = (value % 100) * 2;
+
+		value /= 100;
+		*--end = digit_pairs[pair + 1];
+		*--end = digit_pairs[pair];
+		ndigits -= 2;
+	}
+
+	if (ndigits)
+		*--end = '0' + value % 10;
+}
+
+static int format_unsigned(char *buf, int size, u64 value, bool negative)
+{
+	int ndigits = count_digits(value);
+	int len = ndigits + negative;
+
+	if (len > size)
+		return -1;
+
+	if (negative)
+		*buf = '-';
+	write_digits(buf + len, value, ndigits);
+
+	return len;
+}
+
+static int format_signed(char *buf, int size, long long value)
+{
+	/* Negate in unsigned, so LLONG_MIN does not overflow. */
+	if (value < 0)
+		return format_unsigned(buf, size, 0 - (u64) value, true);
+	return format_unsigned(buf, size, value, false);
+}
+
+int to_chars(char *buf, int size, int value)
+{
+	return format_signed(buf, size, value);
+}
+
+int to_chars(char *buf, int size, unsigned int value)
+{
+	return format_unsigned(buf, size, value, false);
+}
+
+int to_chars(char *buf, int size, long value)
+{
+	return format_signed(buf, size, value);
+}
+
+int to_chars(char *buf, int size, unsigned long value)
+{
+	return format_unsigned(buf, size, value, false);
+}
+
+int to_chars(char *buf, int size, long long value)
+{
+	return format_signed(buf, size, value);
+}
+
+int to_chars(char *buf, int size, unsigned long long value)
+{
+	return format_unsigned(buf, size, value, false);
+}
+
+int to_chars_hex(char *buf, int size, unsigned long long value)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	int len = (64 - __builtin_clzll(value | 1) + 3) / 4;
+
+	if (len > size)
+		return -1;
+
+	for (int i = len - 1; i >= 0; i--) {
+		buf[i] = hex_digits[value & 15];
+		value >>= 4;
+	}
+
+	return len;
+}
+
+/* Ryu */
+
+static constexpr int double_mantissa_bits = 52;
+static constexpr int double_exponent_bits = 11;
+static constexpr int double_bias = 1023;
+static constexpr int float_mantissa_bits = 23;
+static constexpr int float_exponent_bits = 8;
+static constexpr int float_bias = 127;
+
+static constexpr int pow5_inv_bitcount = 125;
+static constexpr int pow5_bitcount = 125;
+static constexpr int float_pow5_inv_bitcount = pow5_inv_bitcount - 64;
+static constexpr int float_pow5_bitcount = pow5_bitcount - 64;
+
+struct decimal
+{
+	u64 digits;
+	int exponent;
+};
+
+/* ceil(log2(5^e)), or 1 for e == 0, valid for 0 <= e <= 3528. */
+static inline int pow5_bits(int e)
+{
+	return ((unsigned) e * 1217359 >> 19) + 1;
+}
+
+/* floor(log10(2^e)) for 0 <= e <= 1650. */
+static inline int log10_pow2(int e)
+{
+	return (unsigned) e * 78913 >> 18;
+}
+
+/* floor(log10(5^e)) for 0 <= e <= 2620. */
+static inline int log10_pow5(int e)
+{
+	return (unsigned) e * 732923 >> 20;
+}
+
+static inline int pow5_factor(u64 value)
+{
+	int count = 0;
+
+	while (value % 5 == 0) {
+		value /= 5;
+		count++;
+	}
+
+	return count;
+}
+
+static inline bool multiple_of_pow5(u64 value, int p)
+{
+	return pow5_factor(value) >= p;
+}
+
+static inline bool multiple_of_pow2(u64 value, int p)
+{
+	return (value & ((1ull << p) - 1)) == 0;
+}
+
+static inline u64 mul_shift64(u64 m, const u64 *mul, int shift)
+{
+	u128 low = (u128) m * mul[0];
+	u128 high = (u128) m * mul[1];
+
+	return (u64) (((low >> 64) + high) >> (shift - 64));
+}
+
+static inline unsigned mul_shift32(unsigned m, u64 factor, int shift)
+{
+	return (unsigned) (((u128) m * factor) >> shift);
+}
+
+static decimal double_to_decimal(u64 ieee_mantissa, unsigned ieee_exponent)
+{
+	int e2;
+	u64 m2;
+
+	if (ieee_exponent == 0) {
+		e2 = 1 - double_bias - double_mantissa_bits - 2;
+		m2 = ieee_mantissa;
+	} else {
+		e2 = (int) ieee_exponent - double_bias - double_mantissa_bits - 2;
+		m2 = (1ull << double_mantissa_bits) | ieee_mantissa;
+	}
+
+	const bool accept_bounds = (m2 & 1) == 0;
+	const u64 mv = 4 * m2;
+	const unsigned mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+	/* The value is mv, and the halfway points to the neighbouring doubles
+	   are mv + 2 and mv - 1 - mm_shift, all scaled by 2^e2. Convert all
+	   three to vr, vp and vm, scaled by 10^e10. */
+	u64 vr, vp, vm;
+	int e10;
+	bool vm_trailing_zeros = false;
+	bool vr_trailing_zeros = false;
+
+	if (e2 >= 0) {
+		const int q = log10_pow2(e2) - (e2 > 3);
+		const int k = pow5_inv_bitcount + pow5_bits(q) - 1;
+		const int i = -e2 + q + k;
+
+		e10 = q;
+		vr = mul_shift64(4 * m2, pow5_inv_split[q], i);
+		vp = mul_shift64(4 * m2 + 2, pow5_inv_split[q], i);
+		vm = mul_shift64(4 * m2 - 1 - mm_shift, pow5_inv_split[q], i);
+
+		/* Only a few of the smallest exponents can give a whole number. */
+		if (q <= 21) {
+			if (mv % 5 == 0)
+				vr_trailing_zeros = multiple_of_pow5(mv, q);
+			else if (accept_bounds)
+				vm_trailing_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+			else
+				vp -= multiple_of_pow5(mv + 2, q);
+		}
+	} else {
+		const int q = log10_pow5(-e2) - (-e2 > 1);
+		const int i = -e2 - q;
+		const int k = pow5_bits(i) - pow5_bitcount;
+		const int j = q - k;
+
+		e10 = q + e2;
+		vr = mul_shift64(4 * m2, pow5_split[i], j);
+		vp = mul_shift64(4 * m2 + 2, pow5_split[i], j);
+		vm = mul_shift64(4 * m2 - 1 - mm_shift, pow5_split[i], j);
+
+		if (q <= 1) {
+			vr_trailing_zeros = true;
+			if (accept_bounds)
+				vm_trailing_zeros = mm_shift == 1;
+			else
+				--vp;
+		} else if (q < 63) {
+			vr_trailing_zeros = multiple_of_pow2(mv, q);
+		}
+	}
+
+	/* Remove digits while vp and vm still differ, which gives the shortest
+	   representation in the interval. */
+	int removed = 0;
+	int last_removed_digit = 0;
+	u64 output;
+
+	if (vm_trailing_zeros || vr_trailing_zeros) {
+		/* The rare case, where the bounds and exact ties matter. */
+		while (vp / 10 > vm / 10) {
+			vm_trailing_zeros &= vm % 10 == 0;
+			vr_trailing_zeros &= last_removed_digit == 0;
+			last_removed_digit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+
+		if (vm_trailing_zeros) {
+			while (vm % 10 == 0) {
+				vr_trailing_zeros &= last_removed_digit == 0;
+				last_removed_digit = vr % 10;
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				removed++;
+			}
+		}
+
+		/* Exactly halfway, round to even. */
+		if (vr_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0)
+			last_removed_digit = 4;
+
+		output = vr
+			   + ((vr == vm && (!accept_bounds || !vm_trailing_zeros))
+				  || last_removed_digit >= 5);
+	} else {
+		bool round_up = false;
+
+		if (vp / 100 > vm / 100) {
+			round_up = vr % 100 >= 50;
+			vr /= 100;
+			vp /= 100;
+			vm /= 100;
+			removed += 2;
+		}
+
+		while (vp / 10 > vm / 10) {
+			round_up = vr % 10 >= 5;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+
+		output = vr + (vr == vm || round_up);
+	}
+
+	return {output, e10 + removed};
+}
+
+static decimal float_to_decimal(unsigned ieee_mantissa, unsigned ieee_exponent)
+{
+	int e2;
+	unsigned m2;
+
+	if (ieee_exponent == 0) {
+		e2 = 1 - float_bias - float_mantissa_bits - 2;
+		m2 = ieee_mantissa;
+	} else {
+		e2 = (int) ieee_exponent - float_bias - float_mantissa_bits - 2;
+		m2 = (1u << float_mantissa_bits) | ieee_mantissa;
+	}
+
+	const bool accept_bounds = (m2 & 1) == 0;
+	const unsigned mv = 4 * m2;
+	const unsigned mp = 4 * m2 + 2;
+	const unsigned mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+	const unsigned mm = 4 * m2 - 1 - mm_shift;
+
+	/* The upper halves of the double tables, rounded up for the inverse
+	   ones, are exactly the 64-bit multipliers needed here. */
+	unsigned vr, vp, vm;
+	int e10;
+	bool vm_trailing_zeros = false;
+	bool vr_trailing_zeros = false;
+	int last_removed_digit = 0;
+
+	if (e2 >= 0) {
+		const int q = log10_pow2(e2);
+		const int k = float_pow5_inv_bitcount + pow5_bits(q) - 1;
+		const int i = -e2 + q + k;
+		const u64 mul = pow5_inv_split[q][1] + 1;
+
+		e10 = q;
+		vr = mul_shift32(mv, mul, i);
+		vp = mul_shift32(mp, mul, i);
+		vm = mul_shift32(mm, mul, i);
+
+		/* The loop below may not run at all, but the first removed digit is
+		   still needed for rounding. */
+		if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+			const int l = float_pow5_inv_bitcount + pow5_bits(q - 1) - 1;
+			last_removed_digit = mul_shift32(mv, pow5_inv_split[q - 1][1] + 1,
+											 -e2 + q - 1 + l)
+							   % 10;
+		}
+
+		if (q <= 9) {
+			if (mv % 5 == 0)
+				vr_trailing_zeros = multiple_of_pow5(mv, q);
+			else if (accept_bounds)
+				vm_trailing_zeros = multiple_of_pow5(mm, q);
+			else
+				vp -= multiple_of_pow5(mp, q);
+		}
+	} else {
+		const int q = log10_pow5(-e2);
+		const int i = -e2 - q;
+		const int k = pow5_bits(i) - float_pow5_bitcount;
+		const u64 mul = pow5_split[i][1];
+		int j = q - k;
+
+		e10 = q + e2;
+		vr = mul_shift32(mv, mul, j);
+		vp = mul_shift32(mp, mul, j);
+		vm = mul_shift32(mm, mul, j);
+
+		if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+			j = q - 1 - (pow5_bits(i + 1) - float_pow5_bitcount);
+			last_removed_digit = mul_shift32(mv, pow5_split[i + 1][1], j) % 10;
+		}
+
+		if (q <= 1) {
+			vr_trailing_zeros = true;
+			if (accept_bounds)
+				vm_trailing_zeros = mm_shift == 1;
+			else
+				--vp;
+		} else if (q < 31) {
+			vr_trailing_zeros = multiple_of_pow2(mv, q - 1);
+		}
+	}
+
+	int removed = 0;
+	unsigned output;
+
+	if (vm_trailing_zeros || vr_trailing_zeros) {
+		while (vp / 10 > vm / 10) {
+			vm_trailing_zeros &= vm % 10 == 0;
+			vr_trailing_zeros &= last_removed_digit == 0;
+			last_removed_digit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+
+		if (vm_trailing_zeros) {
+			while (vm % 10 == 0) {
+				vr_trailing_zeros &= last_removed_digit == 0;
+				last_removed_digit = vr % 10;
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+				removed++;
+			}
+		}
+
+		if (vr_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0)
+			last_removed_digit = 4;
+
+		output = vr
+			   + ((vr == vm && (!accept_bounds || !vm_trailing_zeros))
+				  || last_removed_digit >= 5);
+	} else {
+		while (vp / 10 > vm / 10) {
+			last_removed_digit = vr % 10;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+			removed++;
+		}
+
+		output = vr + (vr == vm || last_removed_digit >= 5);
+	}
+
+	return {output, e10 + removed};
+}
+
+/* Lay out the decimal like Python's repr() does: plain notation if the
+   decimal point falls within 16 digits, and scientific otherwise. The
+   buffer needs room for at least 25 characters. */
+static int format_decimal(char *buf, bool negative, decimal d)
+{
+	char digits[20];
+	char *p = buf;
+	int ndigits = count_digits(d.digits);
+	int point = ndigits + d.exponent;
+
+	write_digits(digits + ndigits, d.digits, ndigits);
+
+	if (negative)
+		*p++ = '-';
+
+	if (point > 16 || point <= -4) {
+		int exponent = point - 1;
+
+		*p++ = digits[0];
+		if (ndigits > 1) {
+			*p++ = '.';
+			memcpy(p, digits + 1, ndigits - 1);
+			p += ndigits - 1;
+		}
+
+		*p++ = 'e';
+		*p++ = exponent < 0 ? '-' : '+';
+		if (exponent < 0)
+			exponent = -exponent;
+
+		if (exponent < 10)
+			*p++ = '0';
+		p += format_unsigned(p, 3, exponent, false);
+	} else if (point <= 0) {
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -point);
+		p += -point;
+		memcpy(p, digits, ndigits);
+		p += ndigits;
+	} else if (point >= ndigits) {
+		memcpy(p, digits, ndigits);
+		p += ndigits;
+		memset(p, '0', point - ndigits);
+		p += point - ndigits;
+		*p++ = '.';
+		*p++ = '0';
+	} else {
+		memcpy(p, digits, point);
+		p += point;
+		*p++ = '.';
+		memcpy(p, digits + point, ndigits - point);
+		p += ndigits - point;
+	}
+
+	return p - buf;
+}
+
+static int format_special(char *buf, bool negative, bool mantissa_set)
+{
+	const char *text = mantissa_set ? "nan" : negative ? "-inf" : "inf";
+	int len = strlen(text);
+
+	memcpy(buf, text, len);
+	return len;
+}
+
+static int format_double(char *buf, double value)
+{
+	u64 bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	const bool negative = bits >> 63;
+	const u64 mantissa = bits & ((1ull << double_mantissa_bits) - 1);
+	const unsigned exponent =
+		(bits >> double_mantissa_bits) & ((1u << double_exponent_bits) - 1);
+
+	if (exponent == (1u << double_exponent_bits) - 1)
+		return format_special(buf, negative, mantissa);
+	if (!exponent && !mantissa)
+		return format_decimal(buf, negative, {0, 0});
+
+	return format_decimal(buf, negative, double_to_decimal(mantissa, exponent));
+}
+
+static int format_float(char *buf, float value)
+{
+	unsigned bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	const bool negative = bits >> 31;
+	const unsigned mantissa = bits & ((1u << float_mantissa_bits) - 1);
+	const unsigned exponent =
+		(bits >> float_mantissa_bits) & ((1u << float_exponent_bits) - 1);
+
+	if (exponent == (1u << float_exponent_bits) - 1)
+		return format_special(buf, negative, mantissa);
+	if (!exponent && !mantissa)
+		return format_decimal(buf, negative, {0, 0});
+
+	return format_decimal(buf, negative, float_to_decimal(mantissa, exponent));
+}
+
+int to_chars(char *buf, int size, float value)
+{
+	char tmp[to_chars_max];
+	int len;
+
+	if (size >= to_chars_max)
+		return format_float(buf, value);
+
+	if ((len = format_float(tmp, value)) > size)
+		return -1;
+
+	memcpy(buf, tmp, len);
+	return len;
+}
+
+int to_chars(char *buf, int size, double value)
+{
+	char tmp[to_chars_max];
+	int len;
+
+	if (size >= to_chars_max)
+		return format_double(buf, value);
+
+	if ((len = format_double(tmp, value)) > size)
+		return -1;
+
+	memcpy(buf, tmp, len);
+	return len;
+}
+
+/* Fixed precision */
+
+/* Formatting with a given number of digits has to round the exact binary
+   value, which may have hundreds of decimal digits. When the shortest
+   representation from Ryu fits into the requested digits and the spacing
+   between doubles is finer than the last of them, the exact value rounds to
+   that same representation, so it is only padded with zeros. Otherwise all
+   digits are computed with a small big integer: m * 2^e is m << e for a
+   positive e, and m * 5^-e digits with the point -e digits from the end for
+   a negative one. */
+
+struct exact_decimal
+{
+	/* The digits are written to the end of `buf`, so that the 9 digit
+	   chunks can be produced from the lowest one up. */
+	char buf[792];
+	char *digits;
+	int ndigits;
+	int point; /* number of digits in front of the decimal point */
+};
+
+struct big_integer
+{
+	/* 2^53 * 5^1074 is the largest value, which needs 2548 bits. */
+	unsigned limbs[80];
+	int len;
+};
+
+static void big_multiply(big_integer& n, unsigned factor)
+{
+	u64 carry = 0;
+
+	for (int i = 0; i < n.len; i++) {
+		carry += (u64) n.limbs[i] * factor;
+		n.limbs[i] = (unsigned) carry;
+		carry >>= 32;
+	}
+
+	if (carry)
+		n.limbs[n.len++] = (unsigned) carry;
+}
+
+static void big_shift_left(big_integer& n, int bits)
+{
+	int words = bits / 32;
+
+	bits %= 32;
+	if (bits) {
+		unsigned carry = 0;
+
+		for (int i = 0; i < n.len; i++) {
+			unsigned limb = n.limbs[i];
+			n.limbs[i] = (limb << bits) | carry;
+			carry = limb >> (32 - bits);
+		}
+
+		if (carry)
+			n.limbs[n.len++] = carry;
+	}
+
+	if (words) {
+		memmove(n.limbs + words, n.limbs, n.len * sizeof(unsigned));
+		memset(n.limbs, 0, words * sizeof(unsigned));
+		n.len += words;
+	}
+}
+
+/* Divides in place and returns the remainder. */
+static unsigned big_divide(big_integer& n, unsigned divisor)
+{
+	u64 rem = 0;
+
+	for (int i = n.len - 1; i >= 0; i--) {
+		rem = (rem << 32) | n.limbs[i];
+		n.limbs[i] = (unsigned) (rem / divisor);
+		rem %= divisor;
+	}
+
+	while (n.len && !n.limbs[n.len - 1])
+		n.len--;
+
+	return (unsigned) rem;
+}
+
+/* The exact digits of m2 * 2^e2, where m2 is not zero. */
+static void exact_digits(exact_decimal& out, u64 m2, int e2)
+{
+	big_integer n;
+	char *p = out.buf + sizeof(out.buf);
+	int fraction = 0;
+
+	/* Fewer trailing zero bits mean fewer powers of 5. */
+	while (!(m2 & 1) && e2 < 0) {
+		m2 >>= 1;
+		e2++;
+	}
+
+	n.limbs[0] = (unsigned) m2;
+	n.limbs[1] = (unsigned) (m2 >> 32);
+	n.len = n.limbs[1] ? 2 : 1;
+
+	if (e2 >= 0) {
+		big_shift_left(n, e2);
+	} else {
+		fraction = -e2;
+		for (int left = fraction; left > 0; left -= 13) {
+			unsigned factor = 1;
+
+			for (int i = 0; i < left && i < 13; i++)
+				factor *= 5;
+			big_multiply(n, factor);
+		}
+	}
+
+	while (n.len) {
+		p -= 9;
+		write_digits(p + 9, big_divide(n, 1000000000), 9);
+	}
+
+	while (*p == '0')
+		p++;
+
+	out.digits = p;
+	out.ndigits = out.buf + sizeof(out.buf) - p;
+	out.point = out.ndigits - fraction;
+}
+
+/* Adds one to the last digit. */
+static void increment_digits(exact_decimal& d)
+{
+	for (int i = d.ndigits - 1; i >= 0; i--) {
+		if (d.digits[i] != '9') {
+			d.digits[i]++;
+			return;
+		}
+		d.digits[i] = '0';
+	}
+
+	/* All digits were 9, so the number gets one more in front. */
+	d.digits[0] = '1';
+	d.ndigits = 1;
+	d.point++;
+}
+
+/* Cut the digits down to the first `keep`, rounding the exact value to the
+   nearest, with ties going to the even digit. */
+static void round_digits(exact_decimal& d, int keep)
+{
+	bool up;
+
+	if (keep >= d.ndigits)
+		return;
+	if (keep < 0) {
+		d.ndigits = 0;
+		return;
+	}
+
+	up = d.digits[keep] > '5';
+	if (d.digits[keep] == '5') {
+		up = keep && (d.digits[keep - 1] - '0') & 1;
+		for (int i = keep + 1; i < d.ndigits && !up; i++)
+			up = d.digits[i] != '0';
+	}
+
+	d.ndigits = keep;
+	if (up)
+		increment_digits(d);
+}
+
+/* Fixed notation for values which have at most 120 bits after the binary
+   point. Each digit of the fraction is the integer part of the remaining
+   bits times 10, which stays exact in 128 bits, and the rest is compared to
+   one half at the end. */
+static void fraction_digits(exact_decimal& out, u64 m2, int e2, int precision)
+{
+	const int bits = -e2;
+	const u128 half = (u128) 1 << (bits - 1);
+	u128 fraction = m2 & ((((u128) 1) << bits) - 1);
+	u64 integer = bits < 64 ? m2 >> bits : 0;
+	char *p = out.buf;
+	bool up;
+
+	out.digits = out.buf;
+	out.point = integer ? count_digits(integer) : 0;
+	write_digits(p + out.point, integer, out.point);
+	p += out.point;
+
+	for (int i = 0; i < precision; i++) {
+		fraction *= 10;
+		*p++ = '0' + (int) (fraction >> bits);
+		fraction &= (half << 1) - 1;
+	}
+
+	out.ndigits = p - out.buf;
+	up = fraction > half;
+	if (fraction == half)
+		up = out.ndigits && (p[-1] - '0') & 1;
+	if (up)
+		increment_digits(out);
+}
+
+
+/* True if 2^e2 <= 10^e10. May say false when they are very close. */
+static inline bool pow2_at_most_pow10(int e2, long e10)
+{
+	return e2 <= ((e10 * 1741647) >> 19) - 1;
+}
+
+/* Splits a finite double into m2 * 2^e2, where 2^e2 is the distance to the
+   next double, and its shortest decimal. Returns false for zero. */
+static bool split_double(double value, bool *negative, u64 *m2, int *e2,
+						 decimal *shortest)
+{
+	u64 bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	const u64 mantissa = bits & ((1ull << double_mantissa_bits) - 1);
+	const unsigned exponent =
+		(bits >> double_mantissa_bits) & ((1u << double_exponent_bits) - 1);
+
+	*negative = bits >> 63;
+	if (!exponent && !mantissa)
+		return false;
+
+	if (exponent) {
+		*m2 = (1ull << double_mantissa_bits) | mantissa;
+		*e2 = (int) exponent - double_bias - double_mantissa_bits;
+	} else {
+		*m2 = mantissa;
+		*e2 = 1 - double_bias - double_mantissa_bits;
+	}
+
+	*shortest = double_to_decimal(mantissa, exponent);
+	return true;
+}
+
+static void fill_digits(char *p, const exact_decimal& d, int from, int count)
+{
+	for (int i = 0; i < count; i++) {
+		int at = from + i;
+		p[i] = (at >= 0 && at < d.ndigits) ? d.digits[at] : '0';
+	}
+}
+
+static int write_fixed(char *buf, int size, bool negative,
+					   const exact_decimal& d, int precision)
+{
+	int int_len = d.point > 0 && d.ndigits ? d.point : 1;
+	long len = negative + int_len + (precision ? 1L + precision : 0);
+	char *p = buf;
+
+	if (len > size)
+		return -1;
+
+	if (negative)
+		*p++ = '-';
+
+	if (d.point > 0 && d.ndigits)
+		fill_digits(p, d, 0, int_len);
+	else
+		*p = '0';
+	p += int_len;
+
+	if (precision) {
+		*p++ = '.';
+		if (d.ndigits)
+			fill_digits(p, d, d.point, precision);
+		else
+			memset(p, '0', precision);
+	}
+
+	return len;
+}
+
+static int write_scientific(char *buf, int size, bool negative,
+							const exact_decimal& d, int precision)
+{
+	int exponent = d.ndigits ? d.point - 1 : 0;
+	int exp_abs = exponent < 0 ? -exponent : exponent;
+	int exp_len = exp_abs < 100 ? 2 : 3;
+	long len = negative + 1 + (precision ? 1L + precision : 0) + 2 + exp_len;
+	char *p = buf;
+
+	if (len > size)
+		return -1;
+
+	if (negative)
+		*p++ = '-';
+
+	*p++ = d.ndigits ? d.digits[0] : '0';
+	if (precision) {
+		*p++ = '.';
+		fill_digits(p, d, 1, precision);
+		p += precision;
+	}
+
+	*p++ = 'e';
+	*p++ = exponent < 0 ? '-' : '+';
+	write_digits(p + exp_len, exp_abs, exp_len);
+
+	return len;
+}
+
+static int write_special(char *buf, int size, double value)
+{
+	char tmp[to_chars_max];
+	int len = format_special(tmp, value < 0, __builtin_isnan(value));
+
+	if (len > size)
+		return -1;
+
+	memcpy(buf, tmp, len);
+	return len;
+}
+
+/* Turns the shortest decimal into digits, which are exact enough. */
+static void shortest_digits(exact_decimal& out, decimal d)
+{
+	int ndigits = count_digits(d.digits);
+
+	out.digits = out.buf;
+	out.ndigits = ndigits;
+	out.point = ndigits + d.exponent;
+	write_digits(out.buf + ndigits, d.digits, ndigits);
+}
+
+int to_chars_fixed(char *buf, int size, double value, int precision)
+{
+	exact_decimal d;
+	decimal shortest;
+	bool negative;
+	int e2;
+	u64 m2;
+
+	if (__builtin_isnan(value) || __builtin_isinf(value))
+		return write_special(buf, size, value);
+
+	if (!split_double(value, &negative, &m2, &e2, &shortest)) {
+		d.ndigits = 0;
+		d.point = 0;
+	} else if (-shortest.exponent <= precision
+			   && pow2_at_most_pow10(e2, -precision)) {
+		shortest_digits(d, shortest);
+	} else if (e2 < 0 && e2 >= -120 && precision <= 700) {
+		fraction_digits(d, m2, e2, precision);
+	} else {
+		exact_digits(d, m2, e2);
+		round_digits(d, d.point + precision);
+	}
+
+	return write_fixed(buf, size, negative, d, precision);
+}
+
+int to_chars_scientific(char *buf, int size, double value, int precision)
+{
+	exact_decimal d;
+	decimal shortest;
+	bool negative;
+	int e2;
+	u64 m2;
+
+	if (__builtin_isnan(value) || __builtin_isinf(value))
+		return write_special(buf, size, value);
+
+	if (!split_double(value, &negative, &m2, &e2, &shortest)) {
+		d.ndigits = 0;
+		d.point = 0;
+	} else {
+		/* Rounding the exact value may end up one power of 10 lower, so the
+		   spacing has to be fine enough for that one too. */
+		int ndigits = count_digits(shortest.digits);
+		int exponent = shortest.exponent + ndigits - 1;
+
+		if (ndigits - 1 <= precision
+			&& pow2_at_most_pow10(e2, (long) exponent - 1 - precision)) {
+			shortest_digits(d, shortest);
+		} else {
+			exact_digits(d, m2, e2);
+			round_digits(d, precision + 1);
+		}
+	}
+
+	return write_scientific(buf, size, negative, d, precision);
+}
+
+/* Parsing */
+
+static inline u64 load_u64(const char *p)
+{
+	u64 value;
+
+	memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+	return value;
+}
+
+static inline bool is_digit(char c)
+{
+	return (unsigned char) (c - '0') < 10;
+}
+
+/* Checks all 8 bytes at once: a byte is a digit if adding 0x46 does not
+   carry into the top bit, and subtracting 0x30 does not borrow. */
+static inline bool is_eight_digits(u64 chunk)
+{
+	return !(((chunk + 0x4646464646464646) | (chunk - 0x3030303030303030))
+			 & 0x8080808080808080);
+}
+
+/* Combines 8 digits, the first one in the lowest byte, in pairs, then in
+   fours and then all of them, with three multiplications. */
+static inline unsigned parse_eight_digits(u64 chunk)
+{
+	const u64 mask = 0x000000ff000000ff;
+	const u64 mul1 = 100 + (1000000ull << 32);
+	const u64 mul2 = 1 + (10000ull << 32);
+
+	chunk -= 0x3030303030303030;
+	chunk = chunk * 10 + (chunk >> 8);
+	chunk = ((chunk & mask) * mul1 + ((chunk >> 16) & mask) * mul2) >> 32;
+
+	return (unsigned) chunk;
+}
+
+static bool parse_digits(const char *p, const char *end, u64 *value)
+{
+	const char *safe_end;
+	u64 parsed = 0;
+
+	if (p == end)
+		return false;
+
+	/* Any 19 digits fit in 64 bits, so only the ones after that need to
+	   be checked for overflow. */
+	safe_end = end - p > 19 ? p + 19 : end;
+
+	while (safe_end - p >= 8 && is_eight_digits(load_u64(p))) {
+		parsed = parsed * 100000000 + parse_eight_digits(load_u64(p));
+		p += 8;
+	}
+
+	for (; p < safe_end; p++) {
+		if (!is_digit(*p))
+			return false;
+		parsed = parsed * 10 + (*p - '0');
+	}
+
+	for (; p < end; p++) {
+		if (!is_digit(*p))
+			return false;
+		if (__builtin_mul_overflow(parsed, 10, &parsed)
+			|| __builtin_add_overflow(parsed, *p - '0', &parsed))
+			return false;
+	}
+
+	*value = parsed;
+	return true;
+}
+
+static bool parse_signed(const char *buf, int len, long long max,
+						 long long *value)
+{
+	const char *end = buf + len;
+	bool negative = false;
+	u64 magnitude;
+
+	if (len && (*buf == '-' || *buf == '+'))
+		negative = *buf++ == '-';
+
+	if (!parse_digits(buf, end, &magnitude))
+		return false;
+
+	/* The negative range is one larger. */
+	if (magnitude > (u64) max + negative)
+		return false;
+
+	*value = negative ? (long long) (0 - magnitude) : (long long) magnitude;
+	return true;
+}
+
+bool from_chars(const char *buf, int len, int *value)
+{
+	long long parsed;
+
+	if (!parse_signed(buf, len, __INT_MAX__, &parsed))
+		return false;
+
+	*value = parsed;
+	return true;
+}
+
+bool from_chars(const char *buf, int len, long long *value)
+{
+	return parse_signed(buf, len, __LONG_LONG_MAX__, value);
+}
+
+bool from_chars(const char *buf, int len, unsigned long long *value)
+{
+	if (len && *buf == '+') {
+		buf++;
+		len--;
+	}
+
+	return parse_digits(buf, buf + len, value);
+}
+
+static constexpr int max_exact_pow10 = 22;
+
+static const double exact_pow10[] = {
+	1e0,  1e1,	1e2,  1e3,	1e4,  1e5,	1e6,  1e7,	1e8,  1e9,	1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline double make_double(u64 bits)
+{
+	double value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/* Returns the double closest to w * 10^q. */
+static double decimal_to_double(u64 w, long q)
+{
+	if (w == 0 || q < pow5_128_min)
+		return 0.0;
+	if (q > pow5_128_max)
+		return __builtin_inf();
+
+	/* Both w and 10^q are exact doubles, and so is one operation on them. */
+	if (q >= -max_exact_pow10 && q <= max_exact_pow10
+		&& w <= 1ull << (double_mantissa_bits + 1)) {
+		if (q < 0)
+			return (double) w / exact_pow10[-q];
+		return (double) w * exact_pow10[q];
+	}
+
+	const int lz = __builtin_clzll(w);
+	const u64 *pow5 = pow5_128[q - pow5_128_min];
+	const int shift = 64 - double_mantissa_bits - 3;
+	u128 product;
+	u64 high, low;
+
+	w <<= lz;
+	product = (u128) w * pow5[0];
+	high = product >> 64;
+	low = (u64) product;
+
+	/* If the bits below the ones we keep are all set, the lower half of the
+	   power could still carry into them. */
+	if ((high & ((1ull << shift) - 1)) == (1ull << shift) - 1) {
+		u64 second = ((u128) w * pow5[1]) >> 64;
+
+		low += second;
+		if (second > low)
+			high++;
+	}
+
+	const int upper_bit = high >> 63;
+	u64 mantissa = high >> (upper_bit + shift);
+	int power2 = (int) ((217706 * q) >> 16) + 63 + upper_bit - lz + double_bias;
+
+	if (power2 <= 0) {
+		/* A subnormal number, or zero. */
+		if (-power2 + 1 >= 64)
+			return 0.0;
+
+		mantissa >>= -power2 + 1;
+		mantissa += mantissa & 1;
+		mantissa >>= 1;
+
+		power2 = mantissa < (1ull << double_mantissa_bits) ? 0 : 1;
+		return make_double(mantissa | (u64) power2 << double_mantissa_bits);
+	}
+
+	/* An exact tie between two doubles is only possible for small powers,
+	   and rounds to the even one. */
+	if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1) {
+		if ((mantissa << (upper_bit + shift)) == high)
+			mantissa &= ~1ull;
+	}
+
+	mantissa += mantissa & 1;
+	mantissa >>= 1;
+
+	if (mantissa >= (2ull << double_mantissa_bits)) {
+		mantissa = 1ull << double_mantissa_bits;
+		power2++;
+	}
+
+	mantissa &= ~(1ull << double_mantissa_bits);
+	if (power2 >= (1 << double_exponent_bits) - 1)
+		return __builtin_inf();
+
+	return make_double(mantissa | (u64) power2 << double_mantissa_bits);
+}
+
+/* The exact, slow path for numbers with more than 19 significant digits.
+   They are rewritten as plain digits with an exponent, so strtod() never
+   sees a decimal point, which would depend on the locale. Digits after the
+   first 780 cannot change the result on their own, so they are replaced by
+   a single 1 if any of them are not 0. */
+static double parse_long_decimal(const char *p, const char *end, long exponent)
+{
+	char digits[800];
+	bool after_point = false;
+	bool sticky = false;
+	int n = 0;
+
+	for (; p < end; p++) {
+		if (*p == '.') {
+			after_point = true;
+		} else if (n == 0 && *p == '0') {
+			exponent -= after_point;
+		} else if (n < 780) {
+			digits[n++] = *p;
+			exponent -= after_point;
+		} else {
+			exponent += !after_point;
+			sticky |= *p != '0';
+		}
+	}
+
+	if (sticky) {
+		digits[n++] = '1';
+		exponent--;
+	}
+
+	digits[n++] = 'e';
+	n += to_chars(digits + n, to_chars_max, (long) exponent);
+	digits[n] = 0;
+
+	return strtod(digits, nullptr);
+}
+
+static bool equals_ignore_case(const char *p, const char *end,
+							   const char *lower)
+{
+	for (; p < end && *lower; p++, lower++) {
+		if ((*p | 0x20) != *lower)
+			return false;
+	}
+
+	return p == end && !*lower;
+}
+
+bool from_chars(const char *buf, int len, double *value)
+{
+	const char *end = buf + len;
+	const char *p = buf;
+	const char *mantissa_start;
+	bool negative = false;
+	bool truncated = false;
+	long exponent = 0;
+	long explicit_exponent = 0;
+	int ndigits = 0;
+	u64 w = 0;
+	double result;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	if (p < end && !is_digit(*p) && *p != '.') {
+		if (equals_ignore_case(p, end, "inf")
+			|| equals_ignore_case(p, end, "infinity"))
+			result = __builtin_inf();
+		else if (equals_ignore_case(p, end, "nan"))
+			result = __builtin_nan("");
+		else
+			return false;
+
+		*value = negative ? -result : result;
+		return true;
+	}
+
+	/* Collect up to 19 significant digits into w, keeping track of where
+	   the decimal point goes in the exponent. */
+	mantissa_start = p;
+	while (p < end && *p == '0')
+		p++;
+
+	while (end - p >= 8 && ndigits + 8 <= 19 && is_eight_digits(load_u64(p))) {
+		w = w * 100000000 + parse_eight_digits(load_u64(p));
+		ndigits += 8;
+		p += 8;
+	}
+
+	for (; p < end && is_digit(*p); p++) {
+		if (ndigits < 19) {
+			w = w * 10 + (*p - '0');
+			ndigits++;
+		} else {
+			truncated |= *p != '0';
+			exponent++;
+		}
+	}
+
+	if (p < end && *p == '.') {
+		const char *fraction_start = ++p;
+
+		if (!ndigits) {
+			for (; p < end && *p == '0'; p++)
+				exponent--;
+		}
+
+		while (end - p >= 8 && ndigits + 8 <= 19
+			   && is_eight_digits(load_u64(p))) {
+			w = w * 100000000 + parse_eight_digits(load_u64(p));
+			ndigits += 8;
+			exponent -= 8;
+			p += 8;
+		}
+
+		for (; p < end && is_digit(*p); p++) {
+			if (ndigits < 19) {
+				w = w * 10 + (*p - '0');
+				ndigits++;
+				exponent--;
+			} else {
+				truncated |= *p != '0';
+			}
+		}
+
+		/* A lone "." is not a number. */
+		if (p == fraction_start && fraction_start - 1 == mantissa_start)
+			return false;
+	} else if (p == mantissa_start) {
+		return false;
+	}
+
+	const char *mantissa_end = p;
+
+	if (p < end && (*p | 0x20) == 'e') {
+		const char *exponent_start;
+		bool exponent_negative = false;
+
+		if (++p < end && (*p == '-' || *p == '+'))
+			exponent_negative = *p++ == '-';
+
+		/* Saturate, anything this large is zero or infinity anyway. */
+		for (exponent_start = p; p < end && is_digit(*p); p++) {
+			if (explicit_exponent < 100000)
+				explicit_exponent = explicit_exponent * 10 + (*p - '0');
+		}
+
+		if (p == exponent_start)
+			return false;
+		if (exponent_negative)
+			explicit_exponent = -explicit_exponent;
+	}
+
+	if (p != end)
+		return false;
+
+	exponent += explicit_exponent;
+	result = decimal_to_double(w, exponent);
+
+	/* The dropped digits put the real value somewhere between w and w + 1,
+	   which only matters if those round to different doubles. */
+	if (truncated && result != decimal_to_double(w + 1, exponent))
+		result = parse_long_decimal(mantissa_start, mantissa_end,
+									explicit_exponent);
+
+	*value = negative ? -result : result;
+	return true;
+}
+
+} // namespace csd
@@ -0,0 +1,464 @@
+/* libcsd/src/encode.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/str.h>
+#include <string.h>
+
+#if defined __x86_64__ || defined __i386__
+# include <immintrin.h>
+# define CSD_ENCODE_X86 1
+#endif
+
+/* Hexadecimal and base64 encoding. Hex only needs SSE2: the nibbles of 16
+   bytes are turned into digits with one compare, and interleaved into 32
+   characters. Decoding classifies each character with range compares,
+   which also finds the invalid ones, and merges pairs of nibbles with
+   shifts.
+
+   Base64 uses the SSSE3 algorithms described by Muła and Lemire. Encoding
+   spreads 12 bytes over 16 lanes with a shuffle, cuts out the 6-bit values
+   with two multiplies, and maps them to characters with a small lookup of
+   offsets. Decoding classifies 16 characters with range compares, which
+   works for both alphabets, and packs the values back into 12 bytes with
+   two multiply-adds and a shuffle. The scalar code handles the rest, and
+   the end of the text with its padding. */
+
+namespace csd {
+
+static constexpr char hex_digits[] = "0123456789abcdef";
+static constexpr char standard_alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static constexpr char url_alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/* Maps each character of the alphabet to its value, and the rest to
+   `invalid`. */
+struct decode_table
+{
+	static constexpr unsigned char invalid = 0xff;
+
+	const char *alphabet;
+	unsigned char values[256];
+};
+
+static constexpr decode_table make_table(const char *alphabet, int size)
+{
+	decode_table table {};
+
+	table.alphabet = alphabet;
+	for (int i = 0; i < 256; i++)
+		table.values[i] = decode_table::invalid;
+	for (int i = 0; i < size; i++)
+		table.values[(unsigned char) alphabet[i]] = i;
+
+	return table;
+}
+
+static constexpr decode_table hex_table = [] {
+	decode_table table = make_table(hex_digits, 16);
+
+	for (int i = 10; i < 16; i++)
+		table.values[(unsigned char) ("ABCDEF"[i - 10])] = i;
+	return table;
+}();
+
+static constexpr decode_table standard_table =
+	make_table(standard_alphabet, 64);
+static constexpr decode_table url_table = make_table(url_alphabet, 64);
+
+#ifdef CSD_ENCODE_X86
+
+/* Returns 0xff in every byte which lies in [first, last]. The compares are
+   signed, so bytes above 0x7f never match. */
+static inline __m128i in_range(__m128i block, char first, char last)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(first - 1)),
+						 _mm_cmpgt_epi8(_mm_set1_epi8(last + 1), block));
+}
+
+static inline __m128i nibbles_to_hex(__m128i nibbles)
+{
+	__m128i above_9 = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+
+	return _mm_add_epi8(
+		_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+		_mm_and_si128(above_9, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+/* Returns the value of each hex digit, and sets `valid` to 0xff in the
+   bytes which were digits. */
+static inline __m128i hex_to_nibbles(__m128i block, __m128i& valid)
+{
+	/* Digits already have the 0x20 bit set, so this only lowers letters. */
+	__m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+	__m128i digit = in_range(block, '0', '9');
+	__m128i letter = in_range(lower, 'a', 'f');
+	__m128i offset =
+		_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8('0')),
+					 _mm_andnot_si128(digit, _mm_set1_epi8('a' - 10)));
+
+	valid = _mm_or_si128(digit, letter);
+	return _mm_sub_epi8(lower, offset);
+}
+
+/* Merges each pair of nibbles into a byte, the first one being the high
+   nibble. The results are left in the low byte of each 16-bit lane. */
+static inline __m128i merge_nibbles(__m128i nibbles)
+{
+	return _mm_or_si128(
+		_mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00f0)),
+		_mm_srli_epi16(nibbles, 8));
+}
+
+#endif
+
+long hex_length(int nbytes)
+{
+	return 2L * nbytes;
+}
+
+long hex_encode(const void *data, int len, char *out)
+{
+	const unsigned char *in = (const unsigned char *) data;
+	int i = 0;
+
+#ifdef CSD_ENCODE_X86
+	const __m128i low_mask = _mm_set1_epi8(0x0f);
+
+	for (; i + 16 <= len; i += 16, out += 32) {
+		__m128i block = _mm_loadu_si128((const __m128i *) (in + i));
+		__m128i high = nibbles_to_hex(
+			_mm_and_si128(_mm_srli_epi16(block, 4), low_mask));
+		__m128i low = nibbles_to_hex(_mm_and_si128(block, low_mask));
+
+		_mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi8(high, low));
+	}
+#endif
+
+	for (; i < len; i++, out += 2) {
+		out[0] = hex_digits[in[i] >> 4];
+		out[1] = hex_digits[in[i] & 0x0f];
+	}
+
+	return hex_length(len);
+}
+
+int hex_decode(const char *text, int len, void *out)
+{
+	const unsigned char *in = (const unsigned char *) text;
+	unsigned char *o = (unsigned char *) out;
+	int i = 0;
+
+	if (len % 2)
+		return -1;
+
+#ifdef CSD_ENCODE_X86
+	for (; i + 32 <= len; i += 32, o += 16) {
+		__m128i valid_first;
+		__m128i valid_second;
+		__m128i first = hex_to_nibbles(
+			_mm_loadu_si128((const __m128i *) (in + i)), valid_first);
+		__m128i second = hex_to_nibbles(
+			_mm_loadu_si128((const __m128i *) (in + i + 16)), valid_second);
+
+		if (_mm_movemask_epi8(_mm_and_si128(valid_first, valid_second))
+			!= 0xffff)
+			return -1;
+
+		_mm_storeu_si128((__m128i *) o,
+						 _mm_packus_epi16(merge_nibbles(first),
+										  merge_nibbles(second)));
+	}
+#endif
+
+	for (; i < len; i += 2) {
+		unsigned char high = hex_table.values[in[i]];
+		unsigned char low = hex_table.values[in[i + 1]];
+
+		if ((high | low) == decode_table::invalid)
+			return -1;
+		*o++ = (high << 4) | low;
+	}
+
+	return len / 2;
+}
+
+long base64_length(int nbytes, base64_variant variant)
+{
+	long full = nbytes / 3 * 4L;
+	int rest = nbytes % 3;
+
+	if (!rest)
+		return full;
+	return full + (variant == base64_standard ? 4 : rest + 1);
+}
+
+/* Encodes the last 1 or 2 bytes, and returns the number of characters. */
+static int encode_tail(const unsigned char *in, int len, char *out,
+					   const char *alphabet, bool pad)
+{
+	unsigned value = in[0] << 16 | (len == 2 ? in[1] << 8 : 0);
+
+	out[0] = alphabet[value >> 18];
+	out[1] = alphabet[(value >> 12) & 0x3f];
+	if (len == 2)
+		out[2] = alphabet[(value >> 6) & 0x3f];
+
+	if (!pad)
+		return len + 1;
+
+	if (len == 1)
+		out[2] = '=';
+	out[3] = '=';
+	return 4;
+}
+
+static long encode_scalar(const unsigned char *in, int len, char *out,
+						  const char *alphabet, bool pad)
+{
+	char *start = out;
+	int i = 0;
+
+	for (; i + 3 <= len; i += 3, out += 4) {
+		unsigned value = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+
+		out[0] = alphabet[value >> 18];
+		out[1] = alphabet[(value >> 12) & 0x3f];
+		out[2] = alphabet[(value >> 6) & 0x3f];
+		out[3] = alphabet[value & 0x3f];
+	}
+
+	if (i < len)
+		out += encode_tail(in + i, len - i, out, alphabet, pad);
+
+	return out - start;
+}
+
+/* Decodes groups of 4 characters into 3 bytes. Returns false if any of the
+   characters is not a part of the alphabet. */
+static bool decode_scalar(const unsigned char *in, int len, unsigned char *out,
+						  const decode_table& table)
+{
+	for (int i = 0; i < len; i += 4, out += 3) {
+		unsigned char a = table.values[in[i]];
+		unsigned char b = table.values[in[i + 1]];
+		unsigned char c = table.values[in[i + 2]];
+		unsigned char d = table.values[in[i + 3]];
+		unsigned value;
+
+		if ((a | b | c | d) == decode_table::invalid)
+			return false;
+
+		value = a << 18 | b << 12 | c << 6 | d;
+		out[0] = value >> 16;
+		out[1] = value >> 8;
+		out[2] = value;
+	}
+
+	return true;
+}
+
+using encode_function = long (*)(const unsigned char *, int, char *,
+								  const char *, bool);
+using decode_function = bool (*)(const unsigned char *, int, unsigned char *,
+								 const decode_table&);
+
+#ifdef CSD_ENCODE_X86
+
+__attribute__((target("ssse3"))) static long
+encode_ssse3(const unsigned char *in, int len, char *out, const char *alphabet,
+			 bool pad)
+{
+	/* Offsets added to each 6-bit value to get its character, picked by
+	   the range it falls into: 0-25, 26-51, 52-61, 62 and 63. */
+	const __m128i offsets = _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, alphabet[62] - 62,
+		alphabet[63] - 63, 'A', 0, 0);
+	const __m128i spread =
+		_mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	char *start = out;
+	int i = 0;
+
+	/* Each step reads 16 bytes, but only encodes the first 12. */
+	for (; i + 16 <= len; i += 12, out += 16) {
+		__m128i block = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *) (in + i)), spread);
+		__m128i high = _mm_mulhi_epu16(
+			_mm_and_si128(block, _mm_set1_epi32(0x0fc0fc00)),
+			_mm_set1_epi32(0x04000040));
+		__m128i low = _mm_mullo_epi16(
+			_mm_and_si128(block, _mm_set1_epi32(0x003f03f0)),
+			_mm_set1_epi32(0x01000010));
+		__m128i values = _mm_or_si128(high, low);
+		__m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+
+		range = _mm_or_si128(
+			range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), values),
+								 _mm_set1_epi8(13)));
+		_mm_storeu_si128(
+			(__m128i *) out,
+			_mm_add_epi8(values, _mm_shuffle_epi8(offsets, range)));
+	}
+
+	return (out - start) + encode_scalar(in + i, len - i, out, alphabet, pad);
+}
+
+__attribute__((target("ssse3"))) static bool
+decode_ssse3(const unsigned char *in, int len, unsigned char *out,
+			 const decode_table& table)
+{
+	const char char_62 = table.alphabet[62];
+	const char char_63 = table.alphabet[63];
+	const __m128i pack =
+		_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	int i = 0;
+
+	for (; i + 16 <= len; i += 16, out += 12) {
+		__m128i block = _mm_loadu_si128((const __m128i *) (in + i));
+		__m128i upper = in_range(block, 'A', 'Z');
+		__m128i lower = in_range(block, 'a', 'z');
+		__m128i digit = in_range(block, '0', '9');
+		__m128i is_62 = _mm_cmpeq_epi8(block, _mm_set1_epi8(char_62));
+		__m128i is_63 = _mm_cmpeq_epi8(block, _mm_set1_epi8(char_63));
+		__m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+									 _mm_or_si128(digit,
+												  _mm_or_si128(is_62, is_63)));
+		__m128i offset = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+						 _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+			_mm_or_si128(
+				_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+				_mm_or_si128(
+					_mm_and_si128(is_62, _mm_set1_epi8(62 - char_62)),
+					_mm_and_si128(is_63, _mm_set1_epi8(63 - char_63)))));
+		__m128i values;
+		int last_word;
+
+		if (_mm_movemask_epi8(valid) != 0xffff)
+			return false;
+
+		/* Merge 4 values of 6 bits into 24 bits, and put the 3 bytes of each
+		   group back in order. */
+		values = _mm_add_epi8(block, offset);
+		values = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		values = _mm_madd_epi16(values, _mm_set1_epi32(0x00011000));
+		values = _mm_shuffle_epi8(values, pack);
+
+		_mm_storel_epi64((__m128i *) out, values);
+		last_word = _mm_cvtsi128_si32(_mm_srli_si128(values, 8));
+		memcpy(out + 8, &last_word, 4);
+	}
+
+	return decode_scalar(in + i, len - i, out, table);
+}
+
+static long encode_resolve(const unsigned char *, int, char *, const char *,
+						   bool);
+static bool decode_resolve(const unsigned char *, int, unsigned char *,
+						   const decode_table&);
+static encode_function encode_impl = encode_resolve;
+static decode_function decode_impl = decode_resolve;
+
+/* Pick the best implementations for this CPU on the first call. */
+static long encode_resolve(const unsigned char *in, int len, char *out,
+						   const char *alphabet, bool pad)
+{
+	encode_function impl = encode_scalar;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		impl = encode_ssse3;
+
+	__atomic_store_n(&encode_impl, impl, __ATOMIC_RELAXED);
+	return impl(in, len, out, alphabet, pad);
+}
+
+static bool decode_resolve(const unsigned char *in, int len,
+						   unsigned char *out, const decode_table& table)
+{
+	decode_function impl = decode_scalar;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		impl = decode_ssse3;
+
+	__atomic_store_n(&decode_impl, impl, __ATOMIC_RELAXED);
+	return impl(in, len, out, table);
+}
+
+#endif
+
+long base64_encode(const void *data, int len, char *out,
+				   base64_variant variant)
+{
+	const char *alphabet =
+		variant == base64_url ? url_alphabet : standard_alphabet;
+	bool pad = variant == base64_standard;
+
+#ifdef CSD_ENCODE_X86
+	return __atomic_load_n(&encode_impl, __ATOMIC_RELAXED)(
+		(const unsigned char *) data, len, out, alphabet, pad);
+#else
+	return encode_scalar((const unsigned char *) data, len, out, alphabet,
+						 pad);
+#endif
+}
+
+int base64_decode(const char *text, int len, void *out,
+				  base64_variant variant)
+{
+	const unsigned char *in = (const unsigned char *) text;
+	const decode_table& table =
+		variant == base64_url ? url_table : standard_table;
+	unsigned char *o = (unsigned char *) out;
+	unsigned char a, b, c;
+	int full;
+	int rest;
+
+	/* Standard base64 is always padded, and the URL variant never is, so
+	   any = there is rejected as being outside of the alphabet. */
+	if (variant == base64_standard) {
+		if (len % 4)
+			return -1;
+		if (len && in[len - 1] == '=')
+			len -= in[len - 2] == '=' ? 2 : 1;
+	}
+
+	rest = len % 4;
+	full = len - rest;
+	if (rest == 1)
+		return -1;
+
+#ifdef CSD_ENCODE_X86
+	if (!__atomic_load_n(&decode_impl, __ATOMIC_RELAXED)(in, full, o, table))
+		return -1;
+#else
+	if (!decode_scalar(in, full, o, table))
+		return -1;
+#endif
+
+	if (!rest)
+		return full / 4 * 3;
+
+	/* The last 2 or 3 characters hold 1 or 2 bytes, and the bits left over
+	   have to be zero, so that every text has only one valid encoding. */
+	o += full / 4 * 3;
+	a = table.values[in[full]];
+	b = table.values[in[full + 1]];
+	c = rest == 3 ? table.values[in[full + 2]] : 0;
+
+	if ((a | b | c) == decode_table::invalid)
+		return -1;
+	if (rest == 2 ? (b & 0x0f) : (c & 0x03))
+		return -1;
+
+	o[0] = a << 2 | b >> 4;
+	if (rest == 3)
+		o[1] = b << 4 | c >> 2;
+
+	return full / 4 * 3 + rest - 1;
+}
+
+} // namespace csd
@@ -3,6 +3,7 @@
 
 #include <libcsd/error.h>
 #include <libcsd/format.h>
+#include <libcsd/maybe.h>
 
 namespace csd {
 
@@ -27,15 +28,24 @@ index_exception::index_exception(int index, int min, int max)
 
 str index_exception::message() const
 {
-	str err = "index_exception: index ";
+	str_builder err;
 
-	err += m_str_index.empty() ? m_index : m_str_index;
-	err += " is out of bounds";
+	err.append("index_exception: index ");
+	if (m_str_index.empty())
+		err.append(m_index);
+	else
+		err.append(m_str_index);
+	err.append(" is out of bounds");
 
 	if (m_has_bounds)
-		err += csd::format(" for a range of [{}, {}]", m_min, m_max);
+		csd::format_to(err, " for a range of [{}, {}]", m_min, m_max);
 
-	return err;
+	return err.finish();
+}
+
+void throw_unpack_exception()
+{
+	throw unpack_exception();
 }
 
 str unpack_exception::message() const
@@ -66,7 +76,7 @@ memory_exception::memory_exception(const str& message)
 
 str memory_exception::message() const
 {
-	return str("memory_exception: ") + m_message;
+	return csd::format("memory_exception: {}", m_message);
 }
 
 invalid_operation_exception::invalid_operation_exception(const str& message)
@@ -75,7 +85,7 @@ invalid_operation_exception::invalid_operation_exception(const str& message)
 
 str invalid_operation_exception::message() const
 {
-	return str("invalid_operation_exception: ") + m_message;
+	return csd::format("invalid_operation_exception: {}", m_message);
 }
 
 invalid_argument_exception::invalid_argument_exception(const str& message)
@@ -84,7 +94,7 @@ invalid_argument_exception::invalid_argument_exception(const str& message)
 
 str invalid_argument_exception::message() const
 {
-	return str("invalid_argument_exception: ") + m_message;
+	return csd::format("invalid_argument_exception: {}", m_message);
 }
 
 stream_exception::stream_exception(const str& message)
@@ -93,7 +103,7 @@ stream_exception::stream_exception(const str& message)
 
 str stream_exception::message() const
 {
-	return str("stream_exception: ") + m_message;
+	return csd::format("stream_exception: {}", m_message);
 }
 
 } // namespace csd
@@ -110,9 +110,11 @@ bytes file::read(int size)
 	return res;
 }
 
-size_t file::write_string(const str& s)
+size_t file::write_string(csd::str_view s)
 {
-	return write(csd::move(s.to_bytes()));
+	if (!is_writable())
+		throw csd::invalid_operation_exception("not writable");
+	return ::write(m_fd, s.ptr, s.len);
 }
 
 str file::read_string(int size)
@@ -149,6 +151,10 @@ stream file::stream()
 			::write(this->m_fd, &b, 1);
 		});
 
+		s.set_write_batch([this](const bytes& buf) {
+			return (int) ::write(this->m_fd, buf.raw_ptr(), buf.size());
+		});
+
 		s.set_is_open([this]() {
 			return this->is_open();
 		});
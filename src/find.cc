@@ -0,0 +1,328 @@
+/* libcsd/src/find.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/str.h>
+#include <string.h>
+
+#if defined __x86_64__ || defined __i386__
+# include <immintrin.h>
+# define CSD_FIND_X86 1
+#endif
+
+/* Substring search. On x86, the haystack is scanned 16 or 32 bytes at a time
+   for positions where both the first and last byte of the needle match, and
+   only those positions are compared in full. This skips most of the input
+   with two vector compares, independently of the needle length.
+
+   Some inputs (like searching for "aaab" in "aaaa...") make almost every
+   position a candidate. To stay linear, the scan keeps count of the bytes
+   compared in vain, and hands the rest of the search over to memmem(), which
+   uses the Two-Way algorithm, once that exceeds the amount of input scanned.
+   The reverse search does the same, with its own Two-Way search running on
+   the needle and haystack read backwards, as there is no memrmem(). */
+
+namespace csd {
+
+using find_function = int (*)(const char *, int, const char *, int);
+
+static int find_fallback(const char *hay, int hay_len, const char *needle,
+						 int needle_len, int offset)
+{
+	const char *found;
+
+	found = (const char *) memmem(hay + offset, hay_len - offset, needle,
+								  needle_len);
+	return found ? found - hay : -1;
+}
+
+static inline bool too_much_work(long wasted, int scanned)
+{
+	return wasted > 2L * scanned + 1024;
+}
+
+/* Bytes of a string read from its end, so that a forward search over them
+   finds the last match. */
+struct reversed_bytes
+{
+	const unsigned char *end;
+
+	unsigned char operator[](int i) const
+	{
+		return end[-1 - i];
+	}
+};
+
+/* Returns the start of the maximal suffix of `x`, by the byte order or its
+   inverse, and its period in `period`. */
+static int maximal_suffix(reversed_bytes x, int len, int *period,
+						  bool inverse)
+{
+	int start = -1;
+	int j = 0;
+	int k = 1;
+	unsigned char a;
+	unsigned char b;
+
+	*period = 1;
+
+	while (j + k < len) {
+		a = x[j + k];
+		b = x[start + k];
+
+		if (inverse ? a > b : a < b) {
+			j += k;
+			k = 1;
+			*period = j - start;
+		} else if (a == b) {
+			if (k != *period) {
+				k++;
+			} else {
+				j += *period;
+				k = 1;
+			}
+		} else {
+			start = j;
+			j = start + 1;
+			k = *period = 1;
+		}
+	}
+
+	return start;
+}
+
+/* Two-Way search for `x` in `y`, returning the first match. */
+static int two_way(reversed_bytes x, int m, reversed_bytes y, int n)
+{
+	int split_period;
+	int period;
+	int split;
+	int memory;
+	int i;
+	int j;
+	bool periodic = true;
+
+	split = maximal_suffix(x, m, &period, false);
+	i = maximal_suffix(x, m, &split_period, true);
+	if (i > split) {
+		split = i;
+		period = split_period;
+	}
+
+	for (i = 0; i <= split && periodic; i++)
+		periodic = x[i] == x[i + period];
+
+	if (!periodic)
+		period = (split + 1 > m - split - 1 ? split + 1 : m - split - 1) + 1;
+
+	memory = -1;
+	for (j = 0; j <= n - m;) {
+		i = (split > memory ? split : memory) + 1;
+		while (i < m && x[i] == y[i + j])
+			i++;
+
+		if (i < m) {
+			j += i - split;
+			memory = -1;
+			continue;
+		}
+
+		for (i = split; i > memory && x[i] == y[i + j]; i--)
+			;
+		if (i <= memory)
+			return j;
+
+		j += period;
+		if (periodic)
+			memory = m - period - 1;
+	}
+
+	return -1;
+}
+
+/* Finds the last match starting at or before `last`. */
+static int rfind_fallback(const char *hay, const char *needle,
+						  int needle_len, int last)
+{
+	int end = last + needle_len;
+	int found;
+
+	if (last < 0)
+		return -1;
+
+	found = two_way({(const unsigned char *) needle + needle_len}, needle_len,
+					{(const unsigned char *) hay + end}, end);
+	return found < 0 ? -1 : end - found - needle_len;
+}
+
+#ifdef CSD_FIND_X86
+
+static int find_sse2(const char *hay, int hay_len, const char *needle,
+					 int needle_len)
+{
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+	long wasted = 0;
+	int i;
+
+	for (i = 0; i + needle_len - 1 + 16 <= hay_len; i += 16) {
+		__m128i block_first = _mm_loadu_si128((const __m128i *) (hay + i));
+		__m128i block_last =
+			_mm_loadu_si128((const __m128i *) (hay + i + needle_len - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(first, block_first),
+			_mm_cmpeq_epi8(last, block_last)));
+
+		while (mask) {
+			int pos = i + __builtin_ctz(mask);
+
+			if (!memcmp(hay + pos + 1, needle + 1, needle_len - 2))
+				return pos;
+
+			wasted += needle_len;
+			mask &= mask - 1;
+		}
+
+		if (too_much_work(wasted, i))
+			break;
+	}
+
+	return find_fallback(hay, hay_len, needle, needle_len, i);
+}
+
+__attribute__((target("avx2"))) static int
+find_avx2(const char *hay, int hay_len, const char *needle, int needle_len)
+{
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+	long wasted = 0;
+	int i;
+
+	for (i = 0; i + needle_len - 1 + 32 <= hay_len; i += 32) {
+		__m256i block_first =
+			_mm256_loadu_si256((const __m256i *) (hay + i));
+		__m256i block_last =
+			_mm256_loadu_si256((const __m256i *) (hay + i + needle_len - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(first, block_first),
+			_mm256_cmpeq_epi8(last, block_last)));
+
+		while (mask) {
+			int pos = i + __builtin_ctz(mask);
+
+			if (!memcmp(hay + pos + 1, needle + 1, needle_len - 2))
+				return pos;
+
+			wasted += needle_len;
+			mask &= mask - 1;
+		}
+
+		if (too_much_work(wasted, i))
+			break;
+	}
+
+	return find_fallback(hay, hay_len, needle, needle_len, i);
+}
+
+static int find_resolve(const char *, int, const char *, int);
+static find_function find_impl = find_resolve;
+
+/* Picks the best implementation for this CPU on the first call. */
+static int find_resolve(const char *hay, int hay_len, const char *needle,
+						int needle_len)
+{
+	find_function impl = find_sse2;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		impl = find_avx2;
+
+	__atomic_store_n(&find_impl, impl, __ATOMIC_RELAXED);
+	return impl(hay, hay_len, needle, needle_len);
+}
+
+#endif
+
+int find_bytes(const char *hay, int hay_len, const char *needle,
+			   int needle_len)
+{
+	const char *found;
+
+	if (needle_len == 0)
+		return 0;
+	if (needle_len > hay_len)
+		return -1;
+
+	if (needle_len == 1) {
+		found = (const char *) memchr(hay, needle[0], hay_len);
+		return found ? found - hay : -1;
+	}
+
+#ifdef CSD_FIND_X86
+	return __atomic_load_n(&find_impl, __ATOMIC_RELAXED)(hay, hay_len, needle,
+														 needle_len);
+#else
+	return find_fallback(hay, hay_len, needle, needle_len, 0);
+#endif
+}
+
+int rfind_bytes(const char *hay, int hay_len, const char *needle,
+				int needle_len)
+{
+	int i;
+
+	if (needle_len == 0)
+		return hay_len;
+	if (needle_len > hay_len)
+		return -1;
+
+	i = hay_len - needle_len;
+
+#ifdef CSD_FIND_X86
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+	long wasted = 0;
+
+	/* Same filter as find_sse2, but walking backwards, so the highest set
+	   bit is the closest candidate. */
+	for (; i >= 15; i -= 16) {
+		int base = i - 15;
+		__m128i block_first = _mm_loadu_si128((const __m128i *) (hay + base));
+		__m128i block_last =
+			_mm_loadu_si128((const __m128i *) (hay + base + needle_len - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(first, block_first),
+			_mm_cmpeq_epi8(last, block_last)));
+
+		if (too_much_work(wasted, hay_len - needle_len - i))
+			return rfind_fallback(hay, needle, needle_len, i);
+
+		while (mask) {
+			int bit = 31 - __builtin_clz(mask);
+
+			if (!memcmp(hay + base + bit, needle, needle_len))
+				return base + bit;
+
+			wasted += needle_len;
+			mask &= ~(1u << bit);
+		}
+	}
+
+	/* At most 15 positions are left. */
+	for (; i >= 0; i--) {
+		if (hay[i] == needle[0] && !memcmp(hay + i, needle, needle_len))
+			return i;
+	}
+
+	return -1;
+#else
+	return rfind_fallback(hay, needle, needle_len, i);
+#endif
+}
+
+int find_byte(const char *hay, int hay_len, char c)
+{
+	const char *found = (const char *) memchr(hay, c, hay_len);
+	return found ? found - hay : -1;
+}
+
+} // namespace csd
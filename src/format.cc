@@ -0,0 +1,506 @@
+/* libcsd/src/format.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/charconv.h>
+#include <libcsd/error.h>
+#include <libcsd/format.h>
+#include <new>
+#include <string.h>
+
+/* The formatting behind csd::format() and format_to(). The text is written
+   to a buffer, where everything past its end is only counted, or appended
+   to a str which already has room for all of it. Results which fit on the
+   stack are written there first, and then copied once; longer ones are
+   measured that way, and formatted again straight into the result, so it
+   is allocated only once either way. */
+
+namespace csd {
+
+static constexpr size_t stack_size = 256;
+
+/* A plain buffer, of which everything past `cap` is only counted. */
+struct buffer_output
+{
+	char *buf;
+	size_t cap;
+	size_t len;
+
+	inline void put(const char *ptr, size_t n)
+	{
+		if (len + n <= cap) {
+			memcpy(buf + len, ptr, n);
+		} else if (len < cap) {
+			memcpy(buf + len, ptr, cap - len);
+		}
+
+		len += n;
+	}
+
+	inline void fill(char c, size_t n)
+	{
+		if (len + n <= cap) {
+			memset(buf + len, c, n);
+		} else if (len < cap) {
+			memset(buf + len, c, cap - len);
+		}
+
+		len += n;
+	}
+};
+
+/* A str which already has room for the whole text. */
+struct str_output
+{
+	str& text;
+	size_t len;
+
+	inline void put(const char *ptr, size_t n)
+	{
+		text.append(csd::str_view(ptr, n));
+		len += n;
+	}
+
+	void fill(char c, size_t n)
+	{
+		char chunk[64];
+
+		memset(chunk, c, sizeof(chunk));
+		while (n) {
+			size_t part = n < sizeof(chunk) ? n : sizeof(chunk);
+			put(chunk, part);
+			n -= part;
+		}
+	}
+};
+
+/* Literal text, where each {{ and }} is written as a single brace. */
+template <typename Output>
+static void put_text(Output& out, const char *ptr, int len,
+					 bool escaped)
+{
+	int start = 0;
+
+	if (!escaped)
+		return out.put(ptr, len);
+
+	for (int i = 0; i < len; i++) {
+		if (ptr[i] != '{' && ptr[i] != '}')
+			continue;
+		out.put(ptr + start, i + 1 - start);
+		start = ++i + 1;
+	}
+
+	out.put(ptr + start, len - start);
+}
+
+/* Writes the prefix, the zero padding and the body, with the fill around
+   them to make up the width. The body is `body_width` columns wide, which
+   for strings is the number of code points. */
+template <typename Output>
+static void put_padded(Output& out, const format_spec& spec,
+					   char default_align, csd::str_view prefix,
+					   csd::str_view body, int body_width)
+{
+	int width = prefix.len + body_width;
+	int pad = spec.width > width ? spec.width - width : 0;
+	char align = spec.align ? spec.align : default_align;
+	int zeros = 0;
+	int left = 0;
+
+	if (spec.zero_pad && !spec.align) {
+		zeros = pad;
+		pad = 0;
+	} else if (align == '>') {
+		left = pad;
+	} else if (align == '^') {
+		left = pad / 2;
+	}
+
+	out.fill(spec.fill, left);
+	if (prefix.len)
+		out.put(prefix.ptr, prefix.len);
+	out.fill('0', zeros);
+	out.put(body.ptr, body.len);
+	out.fill(spec.fill, pad - left);
+}
+
+/* Returns the byte length of the first `count` code points. */
+static int codepoint_prefix(const char *ptr, int len, int count)
+{
+	for (int i = 0; i < len; i++) {
+		if ((ptr[i] & 0xc0) != 0x80 && count-- == 0)
+			return i;
+	}
+
+	return len;
+}
+
+template <typename Output>
+static void format_text(Output& out, const char *ptr, int len,
+						  const format_spec& spec)
+{
+	int width = len;
+
+	if (spec.precision != -1)
+		len = codepoint_prefix(ptr, len, spec.precision);
+	if (spec.width)
+		width = csd::count_codepoints(ptr, len);
+
+	put_padded(out, spec, '<', {}, {ptr, len}, width);
+}
+
+/* Digits in base 2^shift, for binary and octal. */
+static int to_chars_pow2(char *buf, unsigned long long value, int shift)
+{
+	int bits = 64 - __builtin_clzll(value | 1);
+	int len = (bits + shift - 1) / shift;
+
+	for (int i = len - 1; i >= 0; i--) {
+		buf[i] = '0' + (value & ((1 << shift) - 1));
+		value >>= shift;
+	}
+
+	return len;
+}
+
+template <typename Output>
+static void format_integer(Output& out, unsigned long long value,
+						   bool negative, const format_spec& spec)
+{
+	char digits[64];
+	char prefix[3];
+	int prefix_len = 0;
+	int len;
+
+	if (negative)
+		prefix[prefix_len++] = '-';
+	else if (spec.sign)
+		prefix[prefix_len++] = spec.sign;
+
+	switch (spec.type) {
+	case 'x':
+	case 'X':
+		len = csd::to_chars_hex(digits, sizeof(digits), value);
+		if (spec.type == 'X')
+			csd::ascii_to_upper(digits, len);
+		if (spec.alternate) {
+			prefix[prefix_len++] = '0';
+			prefix[prefix_len++] = spec.type;
+		}
+		break;
+	case 'b':
+		len = to_chars_pow2(digits, value, 1);
+		if (spec.alternate) {
+			prefix[prefix_len++] = '0';
+			prefix[prefix_len++] = 'b';
+		}
+		break;
+	case 'o':
+		len = to_chars_pow2(digits, value, 3);
+		if (spec.alternate && value)
+			prefix[prefix_len++] = '0';
+		break;
+	default:
+		len = csd::to_chars(digits, sizeof(digits), value);
+		break;
+	}
+
+	put_padded(out, spec, '>', {prefix, prefix_len}, {digits, len}, len);
+}
+
+/* Like printf("%g"): scientific notation if the exponent is below -4 or
+   not below the precision, and fixed otherwise, without trailing zeros. */
+static int to_chars_general(char *buf, int size, double value, int precision)
+{
+	int len;
+	int exponent;
+	int point;
+	int end;
+
+	if (!precision)
+		precision = 1;
+
+	len = csd::to_chars_scientific(buf, size, value, precision - 1);
+	for (end = len; end > 0 && buf[end - 1] != 'e'; end--)
+		;
+	if (!end)
+		return len; /* inf or nan */
+
+	csd::from_chars(buf + end, len - end, &exponent);
+	end--;
+
+	if (exponent >= -4 && exponent < precision) {
+		len = csd::to_chars_fixed(buf, size, value, precision - 1 - exponent);
+		end = len;
+	}
+
+	for (point = 0; point < end && buf[point] != '.'; point++)
+		;
+	if (point == end)
+		return len;
+
+	int cut = end;
+	while (buf[cut - 1] == '0')
+		cut--;
+	if (cut - 1 == point)
+		cut--;
+
+	memmove(buf + cut, buf + end, len - end);
+	return len - (end - cut);
+}
+
+template <typename Output>
+static void format_floating(Output& out, double value, bool single,
+							const format_spec& spec)
+{
+	/* Enough for any fixed or scientific number with this precision. */
+	int precision = spec.precision;
+	int size = 330 + (precision > 6 ? precision : 6);
+	char local[384];
+	char *buf = size <= (int) sizeof(local) ? local
+											: (char *) ::operator new(size);
+	format_spec padding = spec;
+	char prefix = 0;
+	int len;
+
+	switch (spec.type) {
+	case 'f':
+	case 'F':
+		len = csd::to_chars_fixed(buf, size, value,
+								  precision == -1 ? 6 : precision);
+		break;
+	case 'e':
+	case 'E':
+		len = csd::to_chars_scientific(buf, size, value,
+									   precision == -1 ? 6 : precision);
+		break;
+	case 'g':
+	case 'G':
+		len = to_chars_general(buf, size, value,
+							   precision == -1 ? 6 : precision);
+		break;
+	default:
+		if (precision != -1)
+			len = to_chars_general(buf, size, value, precision);
+		else if (single)
+			len = csd::to_chars(buf, size, (float) value);
+		else
+			len = csd::to_chars(buf, size, value);
+		break;
+	}
+
+	if (spec.type == 'F' || spec.type == 'E' || spec.type == 'G')
+		csd::ascii_to_upper(buf, len);
+
+	/* Zero padding would make "000inf", so that gets the fill instead. */
+	if (__builtin_isnan(value) || __builtin_isinf(value))
+		padding.zero_pad = false;
+
+	csd::str_view body(buf, len);
+	if (buf[0] == '-') {
+		prefix = '-';
+		body = {buf + 1, len - 1};
+	} else if (spec.sign) {
+		prefix = spec.sign;
+	}
+
+	put_padded(out, padding, '>', {&prefix, prefix ? 1 : 0}, body, body.len);
+
+	if (buf != local)
+		::operator delete(buf);
+}
+
+template <typename Output>
+static void format_pointer(Output& out, const void *pointer,
+						   const format_spec *spec)
+{
+	char buf[csd::to_chars_max];
+	int len;
+
+	len = csd::to_chars_hex(buf, sizeof(buf), (unsigned long) pointer);
+	if (!spec) {
+		out.put("0x", 2);
+		out.put(buf, len);
+		return;
+	}
+
+	put_padded(out, *spec, '>', "0x", {buf, len}, len);
+}
+
+/* Arguments without a spec. */
+template <typename Output>
+static void format_plain(Output& out, const format_arg& arg)
+{
+	char buf[csd::to_chars_max];
+
+	switch (arg.kind) {
+	case format_kind::string:
+	case format_kind::converted:
+		out.put(arg.string, arg.len);
+		break;
+	case format_kind::character:
+		out.put(&arg.character, 1);
+		break;
+	case format_kind::signed_integer:
+		out.put(buf, csd::to_chars(buf, sizeof(buf), arg.integer));
+		break;
+	case format_kind::unsigned_integer:
+		out.put(buf, csd::to_chars(buf, sizeof(buf), arg.uinteger));
+		break;
+	case format_kind::single:
+		out.put(buf, csd::to_chars(buf, sizeof(buf), arg.single));
+		break;
+	case format_kind::floating:
+		out.put(buf, csd::to_chars(buf, sizeof(buf), arg.floating));
+		break;
+	case format_kind::pointer:
+		format_pointer(out, arg.pointer, nullptr);
+		break;
+	}
+}
+
+template <typename Output>
+static void format_with_spec(Output& out, const format_arg& arg,
+							 const format_spec& spec)
+{
+	switch (arg.kind) {
+	case format_kind::string:
+	case format_kind::converted:
+		format_text(out, arg.string, arg.len, spec);
+		break;
+	case format_kind::character:
+		if (spec.type && spec.type != 'c')
+			format_integer(out, (unsigned char) arg.character, false, spec);
+		else
+			put_padded(out, spec, '<', {}, {&arg.character, 1}, 1);
+		break;
+	case format_kind::signed_integer:
+		format_integer(out,
+					   arg.integer < 0 ? 0 - (unsigned long long) arg.integer
+									   : arg.integer,
+					   arg.integer < 0, spec);
+		break;
+	case format_kind::unsigned_integer:
+		format_integer(out, arg.uinteger, false, spec);
+		break;
+	case format_kind::single:
+		format_floating(out, arg.single, true, spec);
+		break;
+	case format_kind::floating:
+		format_floating(out, arg.floating, false, spec);
+		break;
+	case format_kind::pointer:
+		format_pointer(out, arg.pointer, &spec);
+		break;
+	}
+}
+
+template <typename Output>
+static void format_fields(Output& out, const format_layout& layout,
+						  const format_arg *args)
+{
+	const char *text = layout.text.ptr;
+
+	for (int i = 0;; i++) {
+		const format_field& field = layout.fields[i];
+
+		put_text(out, text, field.text_len, field.text_escaped);
+		if (i == layout.nfields)
+			break;
+		text += field.text_len + field.field_len;
+
+		if (field.plain)
+			format_plain(out, args[field.arg]);
+		else
+			format_with_spec(out, args[field.arg], field.spec);
+	}
+}
+
+static void check_length(size_t len)
+{
+	if (len > (size_t) str::max_len)
+		throw csd::memory_exception("format: text too long");
+}
+
+str format_erased(const format_layout& layout, const format_arg *args)
+{
+	char buf[stack_size];
+	buffer_output out = {buf, sizeof(buf), 0};
+
+	format_fields(out, layout, args);
+	if (out.len <= sizeof(buf))
+		return str(csd::str_view(buf, out.len));
+
+	check_length(out.len);
+
+	str result;
+	str_output text = {result, 0};
+
+	result.reserve(out.len);
+	format_fields(text, layout, args);
+	return result;
+}
+
+size_t formatted_size_erased(const format_layout& layout,
+							 const format_arg *args)
+{
+	char nothing;
+	buffer_output out = {&nothing, 0, 0};
+
+	format_fields(out, layout, args);
+	return out.len;
+}
+
+void format_erased_to(str_builder& out, const format_layout& layout,
+					  const format_arg *args)
+{
+	char buf[stack_size];
+	size_t len = format_erased_to(buf, sizeof(buf), layout, args);
+
+	if (len <= sizeof(buf))
+		out.append(csd::str_view(buf, len));
+	else
+		out.append(format_erased(layout, args));
+}
+
+size_t format_erased_to(str& out, const format_layout& layout,
+						const format_arg *args)
+{
+	char buf[stack_size];
+	size_t len = format_erased_to(buf, sizeof(buf), layout, args);
+
+	check_length(out.len() + len);
+	out.reserve(out.len() + len);
+
+	if (len <= sizeof(buf)) {
+		out.append(csd::str_view(buf, len));
+		return len;
+	}
+
+	str_output text = {out, 0};
+	format_fields(text, layout, args);
+	return text.len;
+}
+
+size_t format_erased_to(bytes& out, const format_layout& layout,
+						const format_arg *args)
+{
+	size_t len = formatted_size_erased(layout, args);
+
+	check_length(len);
+	if (len > (size_t) out.size())
+		out.alloc(len);
+
+	return format_erased_to((char *) out.raw_ptr(), out.size(), layout, args);
+}
+
+size_t format_erased_to(char *buf, size_t cap, const format_layout& layout,
+						const format_arg *args)
+{
+	buffer_output out = {buf, cap, 0};
+
+	format_fields(out, layout, args);
+	return out.len;
+}
+
+} // namespace csd
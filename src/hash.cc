@@ -0,0 +1,56 @@
+/* libcsd/src/hash.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/hash.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace csd {
+
+static const uint64_t hash_k0 = 0xa0761d6478bd642fULL;
+static const uint64_t hash_k1 = 0xe7037ed1a0b428dbULL;
+static const uint64_t hash_k2 = 0x8ebc6af09c88c6e3ULL;
+
+/* Multiply two 64-bit numbers into a 128-bit result, and fold the halves
+   together. This is the main mixing step, every input bit affects the
+   whole output. */
+static inline uint64_t hash_fold(uint64_t a, uint64_t b)
+{
+	__uint128_t r = (__uint128_t) a * b;
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t hash_read64(const unsigned char *ptr)
+{
+	uint64_t v;
+	memcpy(&v, ptr, 8);
+	return v;
+}
+
+size_t hash_bytes(const void *ptr, size_t len, size_t seed)
+{
+	const unsigned char *p = (const unsigned char *) ptr;
+	uint64_t h = seed ^ hash_k0 ^ len;
+	uint64_t tail = 0;
+
+	while (len >= 16) {
+		h = hash_fold(hash_read64(p) ^ hash_k1, hash_read64(p + 8) ^ h);
+		p += 16;
+		len -= 16;
+	}
+
+	if (len >= 8) {
+		h = hash_fold(hash_read64(p) ^ hash_k1, h ^ hash_k2);
+		p += 8;
+		len -= 8;
+	}
+
+	/* Up to 7 trailing bytes. */
+	if (len)
+		memcpy(&tail, p, len);
+	h = hash_fold(tail ^ hash_k1, h ^ hash_k2 ^ len);
+
+	return hash_fold(h, hash_k0);
+}
+
+} // namespace csd
@@ -0,0 +1,65 @@
+/* libcsd/src/hashed_str.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/detail.h>
+#include <libcsd/hashed_str.h>
+
+hashed_str::hashed_str()
+	: m_str()
+	, m_hash(m_str.hash())
+{ }
+
+hashed_str::hashed_str(const char *string)
+	: m_str(string)
+	, m_hash(m_str.hash())
+{ }
+
+hashed_str::hashed_str(const str& string)
+	: m_str(string)
+	, m_hash(m_str.hash())
+{ }
+
+hashed_str::hashed_str(str&& moved)
+	: m_str(csd::move(moved))
+	, m_hash(m_str.hash())
+{ }
+
+hashed_str::hashed_str(csd::str_view view)
+	: m_str(view)
+	, m_hash(m_str.hash())
+{ }
+
+int hashed_str::len() const
+{
+	return m_str.len();
+}
+
+bool hashed_str::empty() const
+{
+	return m_str.empty();
+}
+
+size_t hashed_str::hash() const
+{
+	return m_hash;
+}
+
+csd::str_view hashed_str::view() const
+{
+	return m_str.view();
+}
+
+str hashed_str::to_str() const
+{
+	return m_str.copy();
+}
+
+bool hashed_str::operator==(const hashed_str& other) const
+{
+	return m_hash == other.m_hash && view() == other.view();
+}
+
+hashed_str::operator csd::str_view() const
+{
+	return view();
+}
@@ -0,0 +1,231 @@
+/* libcsd/src/interner.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/error.h>
+#include <libcsd/format.h>
+#include <libcsd/interner.h>
+#include <string.h>
+
+namespace csd {
+
+str symbol::to_str() const
+{
+	return csd::format("<symbol {}>", (int) id);
+}
+
+interner::interner()
+	: m_arena()
+	, m_entries(nullptr)
+	, m_slots(nullptr)
+	, m_len(0)
+	, m_entries_space(0)
+	, m_slots_mask(-1)
+{ }
+
+interner::~interner()
+{
+	delete[] m_entries;
+	delete[] m_slots;
+}
+
+symbol interner::intern(str_view string)
+{
+	return intern(string.ptr, string.len);
+}
+
+symbol interner::intern(const char *ptr, int len)
+{
+	size_t h = csd::hash_bytes(ptr, len);
+	int slot;
+
+	if (m_slots) {
+		slot = find_slot(ptr, len, h);
+		if (m_slots[slot])
+			return {m_slots[slot] - 1};
+	}
+
+	/* Keep the load factor of the table under 3/4. */
+	if ((m_len + 1) * 4 > (m_slots_mask + 1) * 3) {
+		grow_slots();
+	}
+
+	if (m_len == m_entries_space) {
+		entry *old_entries = m_entries;
+
+		m_entries_space = m_entries_space ? m_entries_space * 2 : 64;
+		m_entries = new entry[m_entries_space];
+
+		if (old_entries)
+			memcpy(m_entries, old_entries, m_len * sizeof(entry));
+		delete[] old_entries;
+	}
+
+	m_entries[m_len] = {m_arena.copy(ptr, len), len, h};
+	m_slots[find_slot(ptr, len, h)] = m_len + 1;
+
+	return {(unsigned int) m_len++};
+}
+
+maybe<symbol> interner::lookup(str_view string) const
+{
+	return lookup(string.ptr, string.len);
+}
+
+maybe<symbol> interner::lookup(const char *ptr, int len) const
+{
+	symbol sym;
+
+	if (!lookup(ptr, len, &sym))
+		return {};
+	return sym;
+}
+
+bool interner::lookup(const char *ptr, int len, symbol *sym) const
+{
+	int slot;
+
+	if (!m_slots)
+		return false;
+
+	slot = find_slot(ptr, len, csd::hash_bytes(ptr, len));
+	if (!m_slots[slot])
+		return false;
+
+	sym->id = m_slots[slot] - 1;
+	return true;
+}
+
+str_view interner::resolve(symbol sym) const
+{
+	if (sym.id >= (unsigned int) m_len)
+		throw csd::index_exception(sym.id, 0, m_len - 1);
+	return {m_entries[sym.id].ptr, m_entries[sym.id].len};
+}
+
+int interner::len() const
+{
+	return m_len;
+}
+
+int interner::find_slot(const char *ptr, int len, size_t h) const
+{
+	int slot = h & m_slots_mask;
+
+	/* Linear probing, stop at the first empty slot or a match. */
+	while (m_slots[slot]) {
+		const entry& e = m_entries[m_slots[slot] - 1];
+
+		if (e.hash == h && e.len == len && !memcmp(e.ptr, ptr, len))
+			return slot;
+
+		slot = (slot + 1) & m_slots_mask;
+	}
+
+	return slot;
+}
+
+void interner::grow_slots()
+{
+	int nslots = m_slots ? (m_slots_mask + 1) * 2 : 128;
+
+	delete[] m_slots;
+	m_slots = new unsigned int[nslots];
+	m_slots_mask = nslots - 1;
+	memset(m_slots, 0, nslots * sizeof(*m_slots));
+
+	for (int i = 0; i < m_len; i++) {
+		int slot = m_entries[i].hash & m_slots_mask;
+
+		while (m_slots[slot])
+			slot = (slot + 1) & m_slots_mask;
+		m_slots[slot] = i + 1;
+	}
+}
+
+concurrent_interner::concurrent_interner()
+	: m_interner()
+{
+	pthread_rwlock_init(&m_lock, NULL);
+}
+
+concurrent_interner::~concurrent_interner()
+{
+	pthread_rwlock_destroy(&m_lock);
+}
+
+symbol concurrent_interner::intern(str_view string)
+{
+	return intern(string.ptr, string.len);
+}
+
+symbol concurrent_interner::intern(const char *ptr, int len)
+{
+	symbol sym;
+
+	/* Most strings are already interned, so try with the shared lock
+	   first, and only then take the exclusive one. */
+	if (lookup(ptr, len, &sym))
+		return sym;
+
+	pthread_rwlock_wrlock(&m_lock);
+	try {
+		sym = m_interner.intern(ptr, len);
+	} catch (...) {
+		pthread_rwlock_unlock(&m_lock);
+		throw;
+	}
+	pthread_rwlock_unlock(&m_lock);
+
+	return sym;
+}
+
+maybe<symbol> concurrent_interner::lookup(str_view string) const
+{
+	return lookup(string.ptr, string.len);
+}
+
+maybe<symbol> concurrent_interner::lookup(const char *ptr, int len) const
+{
+	symbol sym;
+
+	if (!lookup(ptr, len, &sym))
+		return {};
+	return sym;
+}
+
+bool concurrent_interner::lookup(const char *ptr, int len, symbol *sym) const
+{
+	bool found;
+
+	pthread_rwlock_rdlock(&m_lock);
+	found = m_interner.lookup(ptr, len, sym);
+	pthread_rwlock_unlock(&m_lock);
+
+	return found;
+}
+
+str_view concurrent_interner::resolve(symbol sym) const
+{
+	str_view view;
+
+	pthread_rwlock_rdlock(&m_lock);
+	try {
+		view = m_interner.resolve(sym);
+	} catch (...) {
+		pthread_rwlock_unlock(&m_lock);
+		throw;
+	}
+	pthread_rwlock_unlock(&m_lock);
+
+	return view;
+}
+
+int concurrent_interner::len() const
+{
+	pthread_rwlock_rdlock(&m_lock);
+	int n = m_interner.len();
+	pthread_rwlock_unlock(&m_lock);
+	return n;
+}
+
+} // namespace csd
@@ -2,23 +2,16 @@
    Copyright (c) 2023 bellrise */
 
 #include <libcsd/list.h>
+#include <libcsd/split.h>
 
 namespace csd {
 
-list<str> split_str(str to_split, const str& by)
+list<str> split_str(str_view to_split, str_view by)
 {
 	list<str> parts;
-	int index;
 
-	while (1) {
-		if ((index = to_split.find(by)) == str::invalid_index) {
-			parts.append(to_split);
-			break;
-		}
-
-		parts.append(to_split.substr(0, index));
-		to_split = to_split.substr(index + by.len());
-	}
+	for (str_view part : split(to_split, by))
+		parts.append(str(part));
 
 	return parts;
 }
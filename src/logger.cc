@@ -0,0 +1,563 @@
+/* libcsd/src/logger.cc
+   Copyright (c) 2024 bellrise */
+
+#include <errno.h>
+#include <libcsd/error.h>
+#include <libcsd/logger.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+/* Each ring has a single producer, the thread which logs, and a single
+   consumer, the background thread, so it only needs two counters: `head`,
+   moved by the producer after it wrote a record, and `tail`, moved by the
+   consumer after the records before it are written to the file. Both only
+   grow, and are masked to get the position in the ring. A record is a
+   header followed by the text, aligned to 8 bytes, and never wraps around;
+   if it does not fit before the end of the ring, the rest of the ring is
+   skipped, marked by a wrap header if there is room for it. */
+
+namespace csd {
+
+static constexpr size_t record_align = 8;
+static constexpr size_t output_size = 64 * 1024;
+static constexpr unsigned char kind_message = 1;
+static constexpr unsigned char kind_wrap = 2;
+
+static unsigned long next_logger_id = 1;
+
+struct log_header
+{
+	unsigned len;
+	unsigned char kind;
+	log_level level;
+	unsigned short unused;
+	unsigned long long time; /* nanoseconds since the epoch */
+};
+
+struct log_ring
+{
+	/* Written by the thread which logs. */
+	alignas(64) size_t head;
+	size_t cached_tail;
+
+	/* Written by the background thread. */
+	alignas(64) size_t tail;
+	size_t read;
+	size_t end;
+	log_ring *next;
+
+	alignas(64) char *data;
+	size_t mask;
+	int refs; /* the logger, the thread while it's alive, and flush() */
+};
+
+static void release_ring(log_ring *ring)
+{
+	if (__atomic_sub_fetch(&ring->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		delete[] ring->data;
+		delete ring;
+	}
+}
+
+/* The rings of the current thread, one for each logger it used. */
+struct ring_entry
+{
+	unsigned long logger_id;
+	log_ring *ring;
+	ring_entry *next;
+};
+
+struct thread_rings
+{
+	ring_entry *first = nullptr;
+
+	~thread_rings()
+	{
+		while (first) {
+			ring_entry *entry = first;
+			first = entry->next;
+			release_ring(entry->ring);
+			delete entry;
+		}
+	}
+};
+
+static thread_local thread_rings local_rings;
+
+static size_t record_size(size_t len)
+{
+	return (sizeof(log_header) + len + record_align - 1) & ~(record_align - 1);
+}
+
+logger::logger(file& out, log_overflow overflow, int ring_size)
+	: m_out(out)
+	, m_overflow(overflow)
+	, m_level((char) log_level::debug)
+	, m_stop(false)
+	, m_ring_size(4096)
+	, m_id(__atomic_fetch_add(&next_logger_id, 1, __ATOMIC_RELAXED))
+	, m_dropped(0)
+	, m_failed_writes(0)
+	, m_rings(nullptr)
+	, m_rings_lock()
+	, m_buffer(nullptr)
+	, m_thread()
+{
+	if (!out.is_open())
+		throw csd::invalid_argument_exception("logger: file is not open");
+	if (ring_size > 0x40000000)
+		throw csd::invalid_argument_exception("logger: ring is too large");
+
+	while (m_ring_size < ring_size)
+		m_ring_size *= 2;
+
+	m_buffer = new char[output_size];
+	m_thread((thread::fptr_t) drain_thread, this);
+}
+
+logger::~logger()
+{
+	log_ring *ring;
+
+	__atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+	m_thread.join();
+
+	while (m_rings) {
+		ring = m_rings;
+		m_rings = ring->next;
+		release_ring(ring);
+	}
+
+	delete[] m_buffer;
+}
+
+void logger::set_level(log_level level)
+{
+	__atomic_store_n(&m_level, (char) level, __ATOMIC_RELAXED);
+}
+
+log_level logger::level() const
+{
+	return (log_level) __atomic_load_n(&m_level, __ATOMIC_RELAXED);
+}
+
+size_t logger::dropped() const
+{
+	return __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+}
+
+size_t logger::failed_writes() const
+{
+	return __atomic_load_n(&m_failed_writes, __ATOMIC_RELAXED);
+}
+
+void logger::flush()
+{
+	struct timespec wait = {0, 100 * 1000};
+	struct flushed_ring
+	{
+		log_ring *ring;
+		size_t head;
+	};
+	flushed_ring *rings;
+	log_ring *ring;
+	int nrings = 0;
+
+	/* Only note the heads under the lock, with a reference on each ring so
+	   it is not freed meanwhile, and then wait without it, so that threads
+	   logging for the first time are not held up by the flush. */
+	{
+		scoped_lock guard(m_rings_lock);
+
+		for (ring = m_rings; ring; ring = ring->next)
+			nrings++;
+
+		rings = new flushed_ring[nrings];
+		ring = m_rings;
+
+		for (int i = 0; i < nrings; i++, ring = ring->next) {
+			__atomic_add_fetch(&ring->refs, 1, __ATOMIC_RELAXED);
+			rings[i] = {ring, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)};
+		}
+	}
+
+	for (int i = 0; i < nrings; i++) {
+		ring = rings[i].ring;
+		while ((long) (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)
+					   - rings[i].head)
+			   < 0)
+			nanosleep(&wait, NULL);
+		release_ring(ring);
+	}
+
+	delete[] rings;
+}
+
+log_ring *logger::local_ring()
+{
+	ring_entry *entry;
+	log_ring *ring;
+
+	/* Rings which only this thread holds belong to loggers which are gone,
+	   so they are released on the way. */
+	for (ring_entry **link = &local_rings.first; *link;) {
+		entry = *link;
+
+		if (entry->logger_id == m_id)
+			return entry->ring;
+
+		if (__atomic_load_n(&entry->ring->refs, __ATOMIC_ACQUIRE) == 1) {
+			*link = entry->next;
+			release_ring(entry->ring);
+			delete entry;
+		} else {
+			link = &entry->next;
+		}
+	}
+
+	ring = new log_ring;
+	ring->head = 0;
+	ring->cached_tail = 0;
+	ring->tail = 0;
+	ring->read = 0;
+	ring->end = 0;
+	ring->mask = m_ring_size - 1;
+	ring->refs = 2;
+
+	/* A message which does not fit is still formatted as far as it goes,
+	   so leave room for a header past the end. */
+	ring->data = new char[m_ring_size + sizeof(log_header)];
+
+	{
+		scoped_lock guard(m_rings_lock);
+		ring->next = m_rings;
+		__atomic_store_n(&m_rings, ring, __ATOMIC_RELEASE);
+	}
+
+	local_rings.first = new ring_entry{m_id, ring, local_rings.first};
+	return ring;
+}
+
+char *logger::begin_record(log_ring *ring, size_t *space)
+{
+	size_t size = ring->mask + 1;
+	size_t pos = ring->head & ring->mask;
+	size_t room = size - (ring->head - ring->cached_tail);
+
+	if (room < size / 2) {
+		ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		room = size - (ring->head - ring->cached_tail);
+	}
+
+	if (room > size - pos)
+		room = size - pos;
+	if (room > size / 2)
+		room = size / 2;
+
+	*space = room > sizeof(log_header) ? room - sizeof(log_header) : 0;
+	return ring->data + pos + sizeof(log_header);
+}
+
+char *logger::reserve_record(log_ring *ring, size_t *len)
+{
+	struct timespec wait = {0, 50 * 1000};
+	size_t size = ring->mask + 1;
+	size_t need;
+	size_t pos;
+	size_t room;
+	size_t to_end;
+	log_header *wrap;
+
+	if (*len > size / 2 - sizeof(log_header))
+		*len = size / 2 - sizeof(log_header);
+	need = record_size(*len);
+
+	for (int tries = 0;; tries++) {
+		pos = ring->head & ring->mask;
+		to_end = size - pos;
+		ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		room = size - (ring->head - ring->cached_tail);
+
+		if (need <= to_end && need <= room)
+			return ring->data + pos + sizeof(log_header);
+
+		if (need > to_end && to_end + need <= room) {
+			if (to_end >= sizeof(log_header)) {
+				wrap = (log_header *) (ring->data + pos);
+				wrap->kind = kind_wrap;
+			}
+
+			__atomic_store_n(&ring->head, ring->head + to_end,
+							 __ATOMIC_RELEASE);
+			return ring->data + sizeof(log_header);
+		}
+
+		if (m_overflow == log_overflow::drop) {
+			__atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+
+		if (tries < 64)
+			sched_yield();
+		else
+			nanosleep(&wait, NULL);
+	}
+}
+
+void logger::commit_record(log_ring *ring, log_level level, size_t len)
+{
+	size_t pos = ring->head & ring->mask;
+	log_header *header = (log_header *) (ring->data + pos);
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	header->len = len;
+	header->kind = kind_message;
+	header->level = level;
+	header->time = now.tv_sec * 1000000000ull + now.tv_nsec;
+
+	__atomic_store_n(&ring->head, ring->head + record_size(len),
+					 __ATOMIC_RELEASE);
+}
+
+/* Returns the next record the background thread has not written yet, or
+   NULL if there is none. */
+static log_header *peek_record(log_ring *ring)
+{
+	size_t to_end;
+	log_header *header;
+
+	while (ring->read != ring->end) {
+		to_end = ring->mask + 1 - (ring->read & ring->mask);
+		header = (log_header *) (ring->data + (ring->read & ring->mask));
+
+		if (to_end < sizeof(log_header) || header->kind == kind_wrap) {
+			ring->read += to_end;
+			continue;
+		}
+
+		return header;
+	}
+
+	return NULL;
+}
+
+static char *put_digits(char *p, unsigned value, int n)
+{
+	for (int i = n - 1; i >= 0; i--) {
+		p[i] = '0' + value % 10;
+		value /= 10;
+	}
+
+	return p + n;
+}
+
+/* Writes the UTC time as "YYYY-MM-DD HH:MM:SS.uuuuuu", which is 26 bytes.
+   The date is computed from the number of days since the epoch, as in
+   http://howardhinnant.github.io/date_algorithms.html#civil_from_days */
+static char *put_time(char *p, unsigned long long ns)
+{
+	unsigned long long secs = ns / 1000000000;
+	unsigned long long days = secs / 86400 + 719468;
+	unsigned seconds = secs % 86400;
+	unsigned era = days / 146097;
+	unsigned doe = days - era * 146097ull;
+	unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned mp = (5 * doy + 2) / 153;
+	unsigned day = doy - (153 * mp + 2) / 5 + 1;
+	unsigned month = mp < 10 ? mp + 3 : mp - 9;
+	unsigned year = yoe + era * 400 + (month <= 2);
+
+	p = put_digits(p, year, 4);
+	*p++ = '-';
+	p = put_digits(p, month, 2);
+	*p++ = '-';
+	p = put_digits(p, day, 2);
+	*p++ = ' ';
+	p = put_digits(p, seconds / 3600, 2);
+	*p++ = ':';
+	p = put_digits(p, seconds / 60 % 60, 2);
+	*p++ = ':';
+	p = put_digits(p, seconds % 60, 2);
+	*p++ = '.';
+	return put_digits(p, ns % 1000000000 / 1000, 6);
+}
+
+static const char *level_name(log_level level)
+{
+	switch (level) {
+	case log_level::debug:
+		return "debug: ";
+	case log_level::info:
+		return "info: ";
+	case log_level::warning:
+		return "warning: ";
+	default:
+		return "error: ";
+	}
+}
+
+/* Writes all of `len` bytes, retrying after short writes and signals.
+   Returns false if the file reports an error. */
+static bool write_all(file& out, const char *ptr, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		try {
+			n = (ssize_t) out.write_string(csd::str_view(ptr, len));
+		} catch (const csd::any_exception&) {
+			return false;
+		}
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		ptr += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/* Collects the lines for the file. Once they are written, the records they
+   came from are released back to their rings. Failed writes are counted in
+   `failed_writes`, as there is nobody to throw to. */
+struct drain_output
+{
+	file& out;
+	char *data;
+	size_t len;
+	log_ring *rings;
+	size_t *failed_writes;
+
+	void write_out(const char *ptr, size_t n)
+	{
+		if (!write_all(out, ptr, n))
+			__atomic_add_fetch(failed_writes, 1, __ATOMIC_RELAXED);
+	}
+
+	void write()
+	{
+		if (len)
+			write_out(data, len);
+
+		len = 0;
+		for (log_ring *ring = rings; ring; ring = ring->next)
+			__atomic_store_n(&ring->tail, ring->read, __ATOMIC_RELEASE);
+	}
+
+	void put(const char *ptr, size_t n)
+	{
+		if (n > output_size - len) {
+			write();
+			if (n > output_size) {
+				write_out(ptr, n);
+				return;
+			}
+		}
+
+		memcpy(data + len, ptr, n);
+		len += n;
+	}
+};
+
+bool logger::drain()
+{
+	drain_output output{m_out, m_buffer, 0, nullptr, &m_failed_writes};
+	log_ring *first = __atomic_load_n(&m_rings, __ATOMIC_ACQUIRE);
+	log_ring *ring;
+	log_ring *oldest;
+	log_header *header;
+	log_header *oldest_header;
+	const char *name;
+	char prefix[40];
+	char *p;
+	bool any = false;
+
+	output.rings = first;
+	for (ring = first; ring; ring = ring->next)
+		ring->end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	/* Always take the oldest record of all rings, so the lines from
+	   different threads are in order within this pass. Records committed
+	   after the heads were read wait for the next one, even if they are
+	   older than some of the records written now. */
+	for (;;) {
+		oldest = nullptr;
+		oldest_header = nullptr;
+
+		for (ring = first; ring; ring = ring->next) {
+			header = peek_record(ring);
+			if (header
+				&& (!oldest_header || header->time < oldest_header->time)) {
+				oldest = ring;
+				oldest_header = header;
+			}
+		}
+
+		if (!oldest)
+			break;
+
+		name = level_name(oldest_header->level);
+		p = put_time(prefix, oldest_header->time);
+		*p++ = ' ';
+		memcpy(p, name, strlen(name));
+		p += strlen(name);
+
+		output.put(prefix, p - prefix);
+		output.put((char *) (oldest_header + 1), oldest_header->len);
+		output.put("\n", 1);
+
+		oldest->read += record_size(oldest_header->len);
+		any = true;
+	}
+
+	output.write();
+
+	/* Rings of threads which have exited can go, once they are empty and
+	   no flush() holds them. If the lock is taken, try again later. */
+	if (m_rings_lock.try_lock()) {
+		for (log_ring **link = &m_rings; *link;) {
+			ring = *link;
+			if (__atomic_load_n(&ring->refs, __ATOMIC_ACQUIRE) == 1
+				&& ring->read
+					   == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+				*link = ring->next;
+				release_ring(ring);
+			} else {
+				link = &ring->next;
+			}
+		}
+
+		m_rings_lock.unlock();
+	}
+
+	return any;
+}
+
+void *logger::drain_thread(void *self)
+{
+	logger *log = (logger *) self;
+	struct timespec idle = {0, drain_interval_us * 1000};
+	bool stop;
+
+	for (;;) {
+		stop = __atomic_load_n(&log->m_stop, __ATOMIC_ACQUIRE);
+		if (log->drain())
+			continue;
+		if (stop)
+			break;
+		nanosleep(&idle, NULL);
+	}
+
+	return NULL;
+}
+
+} // namespace csd
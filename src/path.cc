@@ -62,18 +62,16 @@ path path::operator/(const char *part)
 
 str path::to_str() const
 {
-	str res = m_root ? "/" : "./";
+	str_builder res;
 
-	if (m_parts.len() == 0)
-		return res;
-
-	for (int i = 0; i < m_parts.len() - 1; i++) {
-		res += m_parts[i];
-		res += '/';
+	res.append(m_root ? "/" : "./");
+	for (int i = 0; i < m_parts.len(); i++) {
+		if (i)
+			res.append('/');
+		res.append(m_parts[i]);
 	}
 
-	res += m_parts[-1];
-	return res;
+	return res.finish();
 }
 
 str path::filename() const
@@ -186,7 +184,7 @@ list<str> path::resolve_parts(str path)
 
 	resolved = split_str(path, "/");
 	resolved.filter([](const str& p) {
-		return p != '.' && !p.empty();
+		return p != "." && !p.empty();
 	});
 
 	return resolved;
@@ -0,0 +1,1056 @@
+/* libcsd/src/pattern.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/error.h>
+#include <libcsd/format.h>
+#include <libcsd/pattern.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The source is parsed into a syntax tree, which is compiled into a Thompson
+   NFA twice: once as it is, and once reading the pattern backwards. The
+   NFAs are never simulated directly. Instead, each set of NFA states the
+   input can lead to becomes a DFA state, created the first time the input
+   reaches it, along with its transitions.
+
+   A search runs the reversed automaton over the input from the end, which
+   finds the leftmost position a match can start at, and then the forward
+   automaton from there, which finds where the longest match ends. */
+
+namespace csd {
+
+static constexpr int max_repeat = 1000;
+static constexpr int max_nesting = 500;
+static constexpr int max_nfa_states = 200000;
+
+struct byte_set
+{
+	unsigned long long bits[4];
+};
+
+static inline bool set_has(const byte_set& set, unsigned char c)
+{
+	return (set.bits[c >> 6] >> (c & 63)) & 1;
+}
+
+static inline void set_add(byte_set& set, unsigned char c)
+{
+	set.bits[c >> 6] |= 1ULL << (c & 63);
+}
+
+static void set_add_range(byte_set& set, int first, int last)
+{
+	for (int c = first; c <= last; c++)
+		set_add(set, c);
+}
+
+static void set_invert(byte_set& set)
+{
+	for (int i = 0; i < 4; i++)
+		set.bits[i] = ~set.bits[i];
+}
+
+static void set_merge(byte_set& into, const byte_set& from)
+{
+	for (int i = 0; i < 4; i++)
+		into.bits[i] |= from.bits[i];
+}
+
+template <typename T>
+static void grow(T *& array, int *capacity, int needed)
+{
+	int new_capacity = *capacity ? *capacity : 16;
+	T *new_array;
+
+	if (needed <= *capacity)
+		return;
+
+	while (new_capacity < needed)
+		new_capacity *= 2;
+
+	new_array = new T[new_capacity];
+	if (*capacity)
+		memcpy(new_array, array, *capacity * sizeof(T));
+
+	delete[] array;
+	array = new_array;
+	*capacity = new_capacity;
+}
+
+[[noreturn]] static void fail(const char *reason)
+{
+	throw csd::invalid_argument_exception(csd::format("pattern: {}", reason));
+}
+
+/* Syntax tree */
+
+enum node_type
+{
+	node_empty,
+	node_set,
+	node_concat,
+	node_alt,
+	node_repeat,
+};
+
+struct node
+{
+	node_type type;
+	int left;
+	int right;
+	int set;
+	int min;
+	int max; /* -1 for no limit */
+};
+
+struct syntax_tree
+{
+	node *nodes;
+	int nnodes;
+	int nodes_space;
+	byte_set *sets;
+	int nsets;
+	int sets_space;
+	int root;
+
+	syntax_tree()
+		: nodes(nullptr)
+		, nnodes(0)
+		, nodes_space(0)
+		, sets(nullptr)
+		, nsets(0)
+		, sets_space(0)
+		, root(-1)
+	{ }
+
+	~syntax_tree()
+	{
+		delete[] nodes;
+		delete[] sets;
+	}
+
+	int add(node_type type, int left = -1, int right = -1)
+	{
+		grow(nodes, &nodes_space, nnodes + 1);
+		nodes[nnodes] = {type, left, right, -1, 0, 0};
+		return nnodes++;
+	}
+
+	int add_set(const byte_set& set)
+	{
+		int n = add(node_set);
+
+		grow(sets, &sets_space, nsets + 1);
+		sets[nsets] = set;
+		nodes[n].set = nsets++;
+		return n;
+	}
+
+	int add_byte(unsigned char c)
+	{
+		byte_set set = {};
+
+		set_add(set, c);
+		return add_set(set);
+	}
+
+	int add_repeat(int child, int min, int max)
+	{
+		int n = add(node_repeat, child);
+
+		nodes[n].min = min;
+		nodes[n].max = max;
+		return n;
+	}
+
+	int join(node_type type, int left, int right)
+	{
+		return left == -1 ? right : add(type, left, right);
+	}
+};
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static int hex_value(char c)
+{
+	if (is_digit(c))
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+struct regex_parser
+{
+	syntax_tree& tree;
+	const char *src;
+	int len;
+	int pos;
+	int nesting;
+
+	/* alt = concat ('|' concat)* */
+	int parse_alt()
+	{
+		int result = parse_concat();
+
+		while (pos < len && src[pos] == '|') {
+			pos++;
+			result = tree.add(node_alt, result, parse_concat());
+		}
+
+		return result;
+	}
+
+	/* concat = repeat* */
+	int parse_concat()
+	{
+		int result = -1;
+
+		while (pos < len && src[pos] != '|' && src[pos] != ')')
+			result = tree.join(node_concat, result, parse_repeat());
+
+		return result == -1 ? tree.add(node_empty) : result;
+	}
+
+	/* repeat = atom ('*' | '+' | '?' | '{' n [',' [m]] '}')* */
+	int parse_repeat()
+	{
+		int result = parse_atom();
+		int quantifiers = 0;
+		int min;
+		int max;
+
+		while (pos < len) {
+			char c = src[pos];
+
+			if (c == '*') {
+				min = 0;
+				max = -1;
+			} else if (c == '+') {
+				min = 1;
+				max = -1;
+			} else if (c == '?') {
+				min = 0;
+				max = 1;
+			} else if (c == '{') {
+				parse_braces(&min, &max);
+			} else {
+				break;
+			}
+
+			if (c != '{')
+				pos++;
+			if (++quantifiers > max_nesting)
+				fail("too many repetitions in a row");
+
+			result = tree.add_repeat(result, min, max);
+		}
+
+		return result;
+	}
+
+	void parse_braces(int *min, int *max)
+	{
+		pos++;
+		*min = parse_number();
+		*max = *min;
+
+		if (pos < len && src[pos] == ',') {
+			pos++;
+			*max = (pos < len && src[pos] == '}') ? -1 : parse_number();
+		}
+
+		if (pos >= len || src[pos] != '}')
+			fail("expected '}' after a repetition count");
+		pos++;
+
+		if (*max != -1 && *max < *min)
+			fail("repetition range is backwards");
+	}
+
+	int parse_number()
+	{
+		int value = 0;
+
+		if (pos >= len || !is_digit(src[pos]))
+			fail("expected a repetition count");
+
+		while (pos < len && is_digit(src[pos])) {
+			value = value * 10 + (src[pos++] - '0');
+			if (value > max_repeat)
+				fail("repetition count is too large");
+		}
+
+		return value;
+	}
+
+	int parse_atom()
+	{
+		byte_set set = {};
+		int inner;
+		int c;
+
+		switch (src[pos]) {
+		case '(':
+			if (++nesting > max_nesting)
+				fail("too deeply nested");
+			pos++;
+			if (len - pos >= 2 && src[pos] == '?' && src[pos + 1] == ':')
+				pos += 2;
+
+			inner = parse_alt();
+			if (pos >= len || src[pos] != ')')
+				fail("missing ')'");
+			pos++;
+			nesting--;
+			return inner;
+		case '[':
+			pos++;
+			parse_class(set);
+			return tree.add_set(set);
+		case '.':
+			pos++;
+			set_add(set, '\n');
+			set_invert(set);
+			return tree.add_set(set);
+		case '\\':
+			pos++;
+			if ((c = parse_escape(set)) != -1)
+				return tree.add_byte(c);
+			return tree.add_set(set);
+		case '*':
+		case '+':
+		case '?':
+		case '{':
+			fail("nothing to repeat");
+		case '^':
+		case '$':
+			fail("anchors are only allowed at the start and the end");
+		default:
+			return tree.add_byte(src[pos++]);
+		}
+	}
+
+	/* Parses the escape after a backslash. Returns the byte it stands for,
+	   or -1 if it's a class, which is then added to `set`. */
+	int parse_escape(byte_set& set)
+	{
+		byte_set group = {};
+		char c;
+		int high;
+		int low;
+
+		if (pos >= len)
+			fail("trailing backslash");
+
+		c = src[pos++];
+		switch (c) {
+		case 'n':
+			return '\n';
+		case 't':
+			return '\t';
+		case 'r':
+			return '\r';
+		case 'f':
+			return '\f';
+		case 'v':
+			return '\v';
+		case '0':
+			return 0;
+		case 'x':
+			if (len - pos < 2 || (high = hex_value(src[pos])) == -1
+				|| (low = hex_value(src[pos + 1])) == -1)
+				fail("expected two hex digits after \\x");
+			pos += 2;
+			return high * 16 + low;
+		case 'd':
+		case 'D':
+			set_add_range(group, '0', '9');
+			break;
+		case 'w':
+		case 'W':
+			set_add_range(group, 'a', 'z');
+			set_add_range(group, 'A', 'Z');
+			set_add_range(group, '0', '9');
+			set_add(group, '_');
+			break;
+		case 's':
+		case 'S':
+			set_add(group, ' ');
+			set_add_range(group, '\t', '\r');
+			break;
+		default:
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c))
+				fail("unknown escape sequence");
+			return (unsigned char) c;
+		}
+
+		if (c >= 'A' && c <= 'Z')
+			set_invert(group);
+		set_merge(set, group);
+		return -1;
+	}
+
+	/* Parses a byte class, after the opening bracket. */
+	void parse_class(byte_set& set)
+	{
+		bool negate = false;
+		bool first = true;
+		int low;
+		int high;
+
+		if (pos < len && src[pos] == '^') {
+			negate = true;
+			pos++;
+		}
+
+		while (pos < len && (first || src[pos] != ']')) {
+			first = false;
+
+			if ((low = parse_class_byte(set)) == -1)
+				continue;
+
+			high = low;
+			if (len - pos >= 2 && src[pos] == '-' && src[pos + 1] != ']') {
+				pos++;
+				if ((high = parse_class_byte(set)) == -1)
+					fail("byte class range ends with a class");
+				if (high < low)
+					fail("byte class range is backwards");
+			}
+
+			set_add_range(set, low, high);
+		}
+
+		if (pos >= len)
+			fail("missing ']'");
+		pos++;
+
+		if (negate)
+			set_invert(set);
+	}
+
+	int parse_class_byte(byte_set& set)
+	{
+		if (src[pos] == '\\') {
+			pos++;
+			return parse_escape(set);
+		}
+		return (unsigned char) src[pos++];
+	}
+};
+
+/* Parses a glob into the tree. An unterminated [ and a trailing backslash
+   are taken literally, and classes use the same rules as in a regex. */
+static int parse_glob(syntax_tree& tree, const char *src, int len)
+{
+	byte_set set;
+	int result = -1;
+	int end;
+	int i = 0;
+
+	while (i < len) {
+		set = {};
+
+		switch (src[i]) {
+		case '*':
+			while (i < len && src[i] == '*')
+				i++;
+			set_invert(set);
+			result = tree.join(node_concat, result,
+							   tree.add_repeat(tree.add_set(set), 0, -1));
+			continue;
+		case '?':
+			set_invert(set);
+			result = tree.join(node_concat, result, tree.add_set(set));
+			i++;
+			continue;
+		case '[':
+			/* Find the closing bracket first, a ] right after [ or [! is a
+			   part of the class. */
+			end = i + 1;
+			if (end < len && (src[end] == '!' || src[end] == '^'))
+				end++;
+			if (end < len && src[end] == ']')
+				end++;
+			while (end < len && src[end] != ']')
+				end += (src[end] == '\\' && end + 1 < len) ? 2 : 1;
+
+			if (end < len) {
+				regex_parser parser {tree, src, end + 1, i + 1, 0};
+
+				if (src[i + 1] == '!')
+					parser.pos++;
+				parser.parse_class(set);
+				if (src[i + 1] == '!')
+					set_invert(set);
+
+				result = tree.join(node_concat, result, tree.add_set(set));
+				i = end + 1;
+				continue;
+			}
+			break;
+		case '\\':
+			if (i + 1 < len)
+				i++;
+			break;
+		}
+
+		result = tree.join(node_concat, result, tree.add_byte(src[i++]));
+	}
+
+	return result == -1 ? tree.add(node_empty) : result;
+}
+
+/* Automaton */
+
+enum state_type
+{
+	state_byte,
+	state_split,
+	state_match,
+};
+
+struct nfa_state
+{
+	state_type type;
+	int set;
+	int out;
+	int out1;
+};
+
+struct dfa_state
+{
+	int offset; /* of the NFA state list in the pool */
+	int len;
+	unsigned hash;
+	bool is_match;
+};
+
+struct pattern::program
+{
+	static constexpr int dead = 0;
+
+	nfa_state *states;
+	int nstates;
+	int states_space;
+	byte_set *sets;
+	int start;
+	bool unanchored;
+
+	/* Bytes which no part of the pattern can tell apart share a class,
+	   and each DFA state has a row of m_nclasses transitions. */
+	unsigned char classes[256];
+	int nclasses;
+
+	dfa_state *dstates;
+	int ndstates;
+	int dstates_space;
+	int *next; /* -1 for a transition which was not computed yet */
+	int next_space;
+	int *pool;
+	int pool_len;
+	int pool_space;
+	int *table; /* hash table of DFA states */
+	int start_state;
+	int flushes;
+
+	/* Scratch space for building new states. */
+	int *stack;
+	int *scratch;
+	unsigned *marks;
+	unsigned generation;
+
+	program(const syntax_tree& tree, bool reverse, bool unanchored_)
+		: states(nullptr)
+		, nstates(0)
+		, states_space(0)
+		, sets(nullptr)
+		, start(-1)
+		, unanchored(unanchored_)
+		, nclasses(0)
+		, dstates(nullptr)
+		, ndstates(0)
+		, dstates_space(0)
+		, next(nullptr)
+		, next_space(0)
+		, pool(nullptr)
+		, pool_len(0)
+		, pool_space(0)
+		, table(nullptr)
+		, start_state(-1)
+		, flushes(0)
+		, stack(nullptr)
+		, scratch(nullptr)
+		, marks(nullptr)
+		, generation(0)
+	{
+		try {
+			sets = new byte_set[tree.nsets ? tree.nsets : 1];
+			if (tree.nsets)
+				memcpy(sets, tree.sets, tree.nsets * sizeof(byte_set));
+
+			start = compile(tree, tree.root,
+							add_state(state_match, -1, -1, -1), reverse);
+			compute_classes(tree.nsets);
+
+			stack = new int[2 * nstates + 2];
+			scratch = new int[nstates];
+			marks = new unsigned[nstates];
+			table = new int[2 * max_cached_states];
+			memset(marks, 0, nstates * sizeof(unsigned));
+			grow(pool, &pool_space, nstates);
+			flush();
+		} catch (...) {
+			release();
+			throw;
+		}
+	}
+
+	~program()
+	{
+		release();
+	}
+
+	void release()
+	{
+		delete[] states;
+		delete[] sets;
+		delete[] dstates;
+		delete[] next;
+		delete[] pool;
+		delete[] table;
+		delete[] stack;
+		delete[] scratch;
+		delete[] marks;
+	}
+
+	int add_state(state_type type, int set, int out, int out1)
+	{
+		if (nstates >= max_nfa_states)
+			fail("pattern is too large");
+
+		grow(states, &states_space, nstates + 1);
+		states[nstates] = {type, set, out, out1};
+		return nstates++;
+	}
+
+	/* Compiles the node, so that it continues to `cont` after matching, and
+	   returns the state it starts at. Long chains of concatenations and
+	   alternatives are walked in a loop, as the tree leans to the left. */
+	int compile(const syntax_tree& tree, int n, int cont, bool reverse)
+	{
+		const node& nd = tree.nodes[n];
+		int body;
+		int loop;
+
+		switch (nd.type) {
+		case node_empty:
+			return cont;
+		case node_set:
+			return add_state(state_byte, nd.set, cont, -1);
+		case node_concat:
+			return compile_chain(tree, n, cont, reverse);
+		case node_alt:
+			return compile_chain(tree, n, cont, reverse);
+		case node_repeat:
+			break;
+		}
+
+		if (nd.max == -1) {
+			loop = add_state(state_split, -1, -1, cont);
+			body = compile(tree, nd.left, loop, reverse);
+			states[loop].out = body;
+			cont = loop;
+		} else {
+			for (int i = nd.min; i < nd.max; i++) {
+				body = compile(tree, nd.left, cont, reverse);
+				cont = add_state(state_split, -1, body, cont);
+			}
+		}
+
+		for (int i = 0; i < nd.min; i++)
+			cont = compile(tree, nd.left, cont, reverse);
+
+		return cont;
+	}
+
+	int compile_chain(const syntax_tree& tree, int n, int cont, bool reverse)
+	{
+		node_type type = tree.nodes[n].type;
+		int *parts;
+		int nparts = 0;
+		int result;
+
+		/* Collect the chain, from the rightmost part to the leftmost. */
+		for (int i = n; tree.nodes[i].type == type; i = tree.nodes[i].left)
+			nparts++;
+		parts = new int[nparts + 1];
+
+		nparts = 0;
+		for (int i = n;; i = tree.nodes[i].left) {
+			if (tree.nodes[i].type != type) {
+				parts[nparts++] = i;
+				break;
+			}
+			parts[nparts++] = tree.nodes[i].right;
+		}
+
+		try {
+			if (type == node_alt) {
+				result = compile(tree, parts[0], cont, reverse);
+				for (int i = 1; i < nparts; i++) {
+					int other = compile(tree, parts[i], cont, reverse);
+					result = add_state(state_split, -1, other, result);
+				}
+			} else {
+				/* Forwards, the last part is compiled first, as it's the
+				   one continuing to `cont`. */
+				result = cont;
+				for (int i = 0; i < nparts; i++) {
+					int part = reverse ? parts[nparts - 1 - i] : parts[i];
+					result = compile(tree, part, result, reverse);
+				}
+			}
+		} catch (...) {
+			delete[] parts;
+			throw;
+		}
+
+		delete[] parts;
+		return result;
+	}
+
+	void compute_classes(int nsets)
+	{
+		unsigned char refined[256];
+		int ids[512];
+
+		memset(classes, 0, sizeof(classes));
+		nclasses = 1;
+
+		/* Split the classes by each set, so that two bytes end up in the
+		   same class only if they are in exactly the same sets. */
+		for (int s = 0; s < nsets && nclasses < 256; s++) {
+			int count = 0;
+
+			memset(ids, -1, sizeof(ids));
+			for (int c = 0; c < 256; c++) {
+				int key = classes[c] * 2 + set_has(sets[s], c);
+
+				if (ids[key] == -1)
+					ids[key] = count++;
+				refined[c] = ids[key];
+			}
+
+			memcpy(classes, refined, sizeof(classes));
+			nclasses = count;
+		}
+	}
+
+	/* Adds the NFA states reachable from `s` without reading anything to
+	   the scratch set. Only states which read a byte or match are kept. */
+	void add_closure(int s, int *count)
+	{
+		int top = 0;
+
+		stack[top++] = s;
+		while (top) {
+			int i = stack[--top];
+
+			if (i < 0 || marks[i] == generation)
+				continue;
+			marks[i] = generation;
+
+			if (states[i].type == state_split) {
+				stack[top++] = states[i].out1;
+				stack[top++] = states[i].out;
+			} else {
+				scratch[(*count)++] = i;
+			}
+		}
+	}
+
+	void next_generation()
+	{
+		if (++generation == 0) {
+			memset(marks, 0, nstates * sizeof(unsigned));
+			generation = 1;
+		}
+	}
+
+	static int compare_ints(const void *a, const void *b)
+	{
+		return *(const int *) a - *(const int *) b;
+	}
+
+	/* Returns the DFA state for the set in scratch, creating it if needed.
+	   If the cache is full, it's flushed first. */
+	int intern(int count)
+	{
+		unsigned hash = 2166136261u;
+		int mask = 2 * max_cached_states - 1;
+		int slot;
+		int d;
+
+		qsort(scratch, count, sizeof(int), compare_ints);
+		for (int i = 0; i < count; i++)
+			hash = (hash ^ scratch[i]) * 16777619u;
+
+		for (slot = hash & mask; (d = table[slot]) != -1;
+			 slot = (slot + 1) & mask) {
+			if (dstates[d].hash == hash && dstates[d].len == count
+				&& !memcmp(pool + dstates[d].offset, scratch,
+						   count * sizeof(int)))
+				return d;
+		}
+
+		if (ndstates == max_cached_states) {
+			flush();
+			return intern(count);
+		}
+
+		grow(pool, &pool_space, pool_len + count);
+		memcpy(pool + pool_len, scratch, count * sizeof(int));
+
+		grow(dstates, &dstates_space, ndstates + 1);
+		dstates[ndstates] = {pool_len, count, hash, false};
+		for (int i = 0; i < count; i++) {
+			if (states[scratch[i]].type == state_match)
+				dstates[ndstates].is_match = true;
+		}
+
+		grow(next, &next_space, (ndstates + 1) * nclasses);
+		memset(next + ndstates * nclasses, -1, nclasses * sizeof(int));
+
+		pool_len += count;
+		table[slot] = ndstates;
+		return ndstates++;
+	}
+
+	/* Drops all DFA states, leaving only the dead one. */
+	void flush()
+	{
+		ndstates = 0;
+		pool_len = 0;
+		start_state = -1;
+		flushes++;
+		memset(table, -1, 2 * max_cached_states * sizeof(int));
+		intern(0);
+	}
+
+	/* The scanning loops work with handles instead of state indices. A
+	   handle is the offset of the state's row in the transition table,
+	   shifted left by one, with the lowest bit set if the state matches.
+	   This saves a multiplication and a lookup for each byte. */
+	int handle(int d)
+	{
+		return (d * nclasses) << 1 | dstates[d].is_match;
+	}
+
+	int begin()
+	{
+		int count = 0;
+
+		if (start_state == -1) {
+			next_generation();
+			add_closure(start, &count);
+			start_state = intern(count);
+		}
+
+		return handle(start_state);
+	}
+
+	/* Computes the transition from state `h` on byte c. Note that this may
+	   flush the cache, after which only the returned state is valid. */
+	int step(int h, unsigned char c)
+	{
+		int d = (h >> 1) / nclasses;
+		int old_flushes = flushes;
+		int count = 0;
+		int target;
+
+		next_generation();
+		for (int i = 0; i < dstates[d].len; i++) {
+			const nfa_state& s = states[pool[dstates[d].offset + i]];
+
+			if (s.type == state_byte && set_has(sets[s.set], c))
+				add_closure(s.out, &count);
+		}
+
+		if (unanchored)
+			add_closure(start, &count);
+
+		target = handle(intern(count));
+		if (flushes == old_flushes)
+			next[(h >> 1) + classes[c]] = target;
+
+		return target;
+	}
+
+	inline int advance(int h, unsigned char c)
+	{
+		int target = next[(h >> 1) + classes[c]];
+		return target != -1 ? target : step(h, c);
+	}
+
+	/* Returns the length of the longest match at the start of the input,
+	   or -1 if there is none. */
+	int longest(const char *ptr, int len)
+	{
+		int h = begin();
+		int found = (h & 1) ? 0 : -1;
+
+		for (int i = 0; i < len; i++) {
+			if ((h = advance(h, ptr[i])) == dead)
+				break;
+			if (h & 1)
+				found = i + 1;
+		}
+
+		return found;
+	}
+
+	/* Reads the input backwards, and calls `found(i)` for each index a match
+	   starts at, from the last one to the first. */
+	template <typename F>
+	void find_starts(const char *ptr, int len, F found)
+	{
+		int h = begin();
+
+		if (h & 1)
+			found(len);
+
+		for (int i = len - 1; i >= 0; i--) {
+			if ((h = advance(h, ptr[i])) == dead)
+				break;
+			if (h & 1)
+				found(i);
+		}
+	}
+};
+
+pattern::pattern(str_view source, syntax kind)
+	: m_forward(nullptr)
+	, m_reverse(nullptr)
+	, m_anchor_start(false)
+	, m_anchor_end(false)
+{
+	syntax_tree tree;
+	int backslashes = 0;
+
+	if (kind == glob) {
+		tree.root = parse_glob(tree, source.ptr, source.len);
+		m_anchor_start = true;
+		m_anchor_end = true;
+	} else {
+		if (source.len && source.ptr[0] == '^') {
+			m_anchor_start = true;
+			source = source.substr(1);
+		}
+
+		/* A trailing $ is an anchor, unless it's escaped. */
+		while (backslashes < source.len - 1
+			   && source.ptr[source.len - 2 - backslashes] == '\\')
+			backslashes++;
+		if (source.len && source.ptr[source.len - 1] == '$'
+			&& backslashes % 2 == 0) {
+			m_anchor_end = true;
+			source.len--;
+		}
+
+		regex_parser parser {tree, source.ptr, source.len, 0, 0};
+
+		tree.root = parser.parse_alt();
+		if (parser.pos < source.len)
+			fail("unmatched ')'");
+	}
+
+	/* Matches of a pattern anchored at the start can only start at 0, so
+	   it does not need the reversed automaton. */
+	m_forward = new program(tree, false, false);
+	if (m_anchor_start)
+		return;
+
+	try {
+		m_reverse = new program(tree, true, !m_anchor_end);
+	} catch (...) {
+		delete m_forward;
+		throw;
+	}
+}
+
+pattern::~pattern()
+{
+	delete m_forward;
+	delete m_reverse;
+}
+
+bool pattern::match(str_view input)
+{
+	return m_forward->longest(input.ptr, input.len) == input.len;
+}
+
+maybe<str_view> pattern::search(str_view input)
+{
+	int start = 0;
+	int length;
+
+	if (!m_anchor_start) {
+		start = -1;
+		m_reverse->find_starts(input.ptr, input.len,
+							   [&start](int index) { start = index; });
+		if (start == -1)
+			return {};
+	}
+
+	length = m_forward->longest(input.ptr + start, input.len - start);
+	if (length == -1 || (m_anchor_end && start + length != input.len))
+		return {};
+
+	return str_view(input.ptr + start, length);
+}
+
+list<str_view> pattern::find_all(str_view input)
+{
+	list<str_view> found;
+	char *starts;
+	char *next_start;
+	int length;
+	int pos = 0;
+
+	if (m_anchor_start) {
+		maybe<str_view> only = search(input);
+		if (only.is_ok())
+			found.append(only.unpack());
+		return found;
+	}
+
+	/* Mark every index a match starts at in one pass, and then take the
+	   longest match at each mark which is not covered by the previous. */
+	starts = new char[input.len + 1];
+	memset(starts, 0, input.len + 1);
+	m_reverse->find_starts(input.ptr, input.len,
+						   [starts](int index) { starts[index] = 1; });
+
+	while (pos <= input.len) {
+		next_start = (char *) memchr(starts + pos, 1, input.len + 1 - pos);
+		if (!next_start)
+			break;
+
+		pos = next_start - starts;
+		length = m_forward->longest(input.ptr + pos, input.len - pos);
+		found.append(str_view(input.ptr + pos, length));
+		pos += length ? length : 1;
+	}
+
+	delete[] starts;
+	return found;
+}
+
+} // namespace csd
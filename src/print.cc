@@ -1,79 +1,435 @@
 /* libcsd/src/print.cc
    Copyright (c) 2022-2023 bellrise */
 
+#include <errno.h>
+#include <libcsd/charconv.h>
 #include <libcsd/print.h>
-#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* print() and println() format the whole call into a buffer owned by the
+   calling thread, so no shared locks are taken, and the text is written to
+   stdout with as few write(2) calls as possible. print_to() does the same
+   with a buffer on the stack, which is written out at the end of each
+   call. */
 
 namespace csd {
 
+/* Negative until the first call, which picks line buffering for terminals,
+   and block buffering for everything else, like stdio does. */
+static int buffering_policy = -1;
+
+/* Writes all of `len` bytes, retrying after short writes and signals. */
+static void write_all(int fd, const char *ptr, size_t len)
+{
+	while (len) {
+		ssize_t n = ::write(fd, ptr, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+
+		ptr += n;
+		len -= n;
+	}
+}
+
+/* Collects the text in `data`, and hands it to `sink` when it's full.
+   Only whole lines are handed over then, if there are any, so that a line
+   is not split between two writes. Pieces larger than the whole buffer
+   skip it. */
+struct print_output
+{
+	char *data;
+	int len;
+	int line_end; /* just past the last newline, or 0 */
+	void (*sink)(void *target, const char *ptr, size_t len);
+	void *target;
+
+	void put(const char *ptr, size_t n)
+	{
+		if (n > (size_t) (print_buffer_size - len)) {
+			if (n > (size_t) print_buffer_size) {
+				flush();
+				sink(target, ptr, n);
+				return;
+			}
+
+			make_room(n);
+		}
+
+		memcpy(data + len, ptr, n);
+		len += n;
+	}
+
+	void put_text(const char *ptr, size_t n)
+	{
+		const char *newline = (const char *) memrchr(ptr, '\n', n);
+
+		put(ptr, n);
+		if (newline && n <= (size_t) print_buffer_size)
+			line_end = len - n + (newline - ptr) + 1;
+	}
+
+	void put_char(char c)
+	{
+		if (len == print_buffer_size)
+			make_room(1);
+		data[len++] = c;
+		if (c == '\n')
+			line_end = len;
+	}
+
+	void make_room(size_t n)
+	{
+		if (!line_end || len - line_end + n > (size_t) print_buffer_size) {
+			flush();
+			return;
+		}
+
+		sink(target, data, line_end);
+		memmove(data, data + line_end, len - line_end);
+		len -= line_end;
+		line_end = 0;
+	}
+
+	void flush()
+	{
+		if (len)
+			sink(target, data, len);
+		len = 0;
+		line_end = 0;
+	}
+};
+
+static void fd_sink(void *target, const char *ptr, size_t len)
+{
+	write_all(*(int *) target, ptr, len);
+}
+
+static void file_sink(void *target, const char *ptr, size_t len)
+{
+	((file *) target)->write_string(csd::str_view(ptr, len));
+}
+
+static void stream_sink(void *target, const char *ptr, size_t len)
+{
+	((stream *) target)->write_string(csd::str_view(ptr, len));
+}
+
+/* The stdout buffer of each thread, which is written out when the thread
+   exits. All buffers are kept in a list, so that the ones of threads still
+   running when the process exits are written out by flush_all_buffers().
+   The owning thread holds `busy` while printing, which is only ever
+   contended by that exit hook. */
+struct stdout_buffer
+{
+	int fd;
+	bool busy;
+	print_output out;
+	stdout_buffer *prev;
+	stdout_buffer *next;
+	char data[print_buffer_size];
+
+	stdout_buffer();
+	~stdout_buffer();
+
+	void lock()
+	{
+		while (__atomic_exchange_n(&busy, true, __ATOMIC_ACQUIRE))
+			sched_yield();
+	}
+
+	void unlock()
+	{
+		__atomic_store_n(&busy, false, __ATOMIC_RELEASE);
+	}
+};
+
+static pthread_mutex_t stdout_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static stdout_buffer *stdout_buffers;
+static bool stdout_buffers_hooked;
+
+static thread_local stdout_buffer stdout_local;
+
+/* Set once stdout_local is destroyed, so that anything printed later from
+   other destructors on the same thread goes straight to stdout. */
+static thread_local bool stdout_local_gone;
+
+static void flush_all_buffers()
+{
+	pthread_mutex_lock(&stdout_buffers_lock);
+
+	for (stdout_buffer *buf = stdout_buffers; buf; buf = buf->next) {
+		buf->lock();
+		buf->out.flush();
+		buf->unlock();
+	}
+
+	pthread_mutex_unlock(&stdout_buffers_lock);
+}
+
+stdout_buffer::stdout_buffer()
+	: fd(STDOUT_FILENO)
+	, busy(false)
+	, out{data, 0, 0, fd_sink, &fd}
+	, prev(nullptr)
+	, next(nullptr)
+{
+	pthread_mutex_lock(&stdout_buffers_lock);
+
+	if (!stdout_buffers_hooked) {
+		atexit(flush_all_buffers);
+		stdout_buffers_hooked = true;
+	}
+
+	next = stdout_buffers;
+	if (next)
+		next->prev = this;
+	stdout_buffers = this;
+
+	pthread_mutex_unlock(&stdout_buffers_lock);
+}
+
+stdout_buffer::~stdout_buffer()
+{
+	stdout_local_gone = true;
+
+	pthread_mutex_lock(&stdout_buffers_lock);
+
+	if (prev)
+		prev->next = next;
+	else
+		stdout_buffers = next;
+	if (next)
+		next->prev = prev;
+
+	pthread_mutex_unlock(&stdout_buffers_lock);
+
+	out.flush();
+}
+
+/* Writes out the buffer of the calling thread, if it still has one. */
+static void flush_local()
+{
+	if (stdout_local_gone)
+		return;
+
+	stdout_local.lock();
+	stdout_local.out.flush();
+	stdout_local.unlock();
+}
+
+static void print_arg(print_output& out, const format_arg& arg)
+{
+	char buf[csd::to_chars_max];
+	int len;
+
+	switch (arg.kind) {
+	case format_kind::string:
+	case format_kind::converted:
+		out.put_text(arg.string, arg.len);
+		return;
+	case format_kind::character:
+		out.put_char(arg.character);
+		return;
+	case format_kind::signed_integer:
+		len = csd::to_chars(buf, sizeof(buf), arg.integer);
+		break;
+	case format_kind::unsigned_integer:
+		len = csd::to_chars(buf, sizeof(buf), arg.uinteger);
+		break;
+	case format_kind::single:
+		len = csd::to_chars(buf, sizeof(buf), arg.single);
+		break;
+	case format_kind::floating:
+		len = csd::to_chars(buf, sizeof(buf), arg.floating);
+		break;
+	case format_kind::pointer:
+		buf[0] = '0';
+		buf[1] = 'x';
+		len = 2
+			+ csd::to_chars_hex(buf + 2, sizeof(buf) - 2,
+								(unsigned long long) arg.pointer);
+		break;
+	default:
+		return;
+	}
+
+	out.put(buf, len);
+}
+
+static void print_args(print_output& out, const format_arg *args, int nargs,
+					   bool newline)
+{
+	for (int i = 0; i < nargs; i++) {
+		if (i)
+			out.put_char(' ');
+		print_arg(out, args[i]);
+	}
+
+	if (newline)
+		out.put_char('\n');
+}
+
+void set_print_buffering(print_buffering policy)
+{
+	flush_local();
+	__atomic_store_n(&buffering_policy, (int) policy, __ATOMIC_RELAXED);
+}
+
+print_buffering get_print_buffering()
+{
+	int policy = __atomic_load_n(&buffering_policy, __ATOMIC_RELAXED);
+
+	if (policy < 0) {
+		policy = (int) (isatty(STDOUT_FILENO) ? print_buffering::line
+											  : print_buffering::block);
+		__atomic_store_n(&buffering_policy, policy, __ATOMIC_RELAXED);
+	}
+
+	return (print_buffering) policy;
+}
+
+void flush()
+{
+	flush_local();
+}
+
+void print_erased(const format_arg *args, int nargs, bool newline)
+{
+	print_buffering policy = get_print_buffering();
+
+	if (stdout_local_gone) {
+		print_erased_to(STDOUT_FILENO, args, nargs, newline);
+		return;
+	}
+
+	stdout_local.lock();
+	print_output& out = stdout_local.out;
+
+	print_args(out, args, nargs, newline);
+
+	switch (policy) {
+	case print_buffering::line:
+		if (out.line_end)
+			out.flush();
+		break;
+	case print_buffering::none:
+		out.flush();
+		break;
+	default:
+		break;
+	}
+
+	stdout_local.unlock();
+}
+
+void print_erased_to(int fd, const format_arg *args, int nargs, bool newline)
+{
+	char data[print_buffer_size];
+	print_output out{data, 0, 0, fd_sink, &fd};
+
+	if (fd == STDOUT_FILENO)
+		flush();
+
+	print_args(out, args, nargs, newline);
+	out.flush();
+}
+
+void print_erased_to(file& target, const format_arg *args, int nargs,
+					 bool newline)
+{
+	char data[print_buffer_size];
+	print_output out{data, 0, 0, file_sink, &target};
+
+	print_args(out, args, nargs, newline);
+	out.flush();
+}
+
+void print_erased_to(stream& target, const format_arg *args, int nargs,
+					 bool newline)
+{
+	char data[print_buffer_size];
+	print_output out{data, 0, 0, stream_sink, &target};
+
+	print_args(out, args, nargs, newline);
+	out.flush();
+}
+
 void print_single(const void *val)
 {
-	printf("%p", val);
+	print(val);
 }
 
 void print_single(const char *val)
 {
-	printf("%s", val);
+	print(val);
 }
 
 void print_single(const str& val)
 {
-	val.print();
+	print(val);
 }
 
 void print_single(const char val)
 {
-	printf("%c", val);
+	print(val);
 }
 
 void print_single(const unsigned char val)
 {
-	printf("%uc", val);
+	print(val);
 }
 
 void print_single(const short val)
 {
-	printf("%d", val);
+	print(val);
 }
 
 void print_single(const unsigned short val)
 {
-	printf("%ud", val);
+	print(val);
 }
 
 void print_single(const int val)
 {
-	printf("%d", val);
+	print(val);
 }
 
 void print_single(const unsigned int val)
 {
-	printf("%du", val);
+	print(val);
 }
 
 void print_single(const long val)
 {
-	printf("%ld", val);
+	print(val);
 }
 
 void print_single(const unsigned long val)
 {
-	printf("%lu", val);
+	print(val);
 }
 
 void print_single(const float val)
 {
-	printf("%f", val);
+	print(val);
 }
 
 void print_single(const double val)
 {
-	printf("%lf", val);
+	print(val);
 }
 
 void print_single(const bool val)
 {
-	fputs(val ? "true" : "false", stdout);
+	print(val);
 }
 
 } // namespace csd
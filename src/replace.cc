@@ -0,0 +1,237 @@
+/* libcsd/src/replace.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/error.h>
+#include <libcsd/replace.h>
+#include <string.h>
+
+namespace csd {
+
+multi_replacer::multi_replacer()
+	: m_patterns()
+	, m_replacements()
+	, m_next(nullptr)
+	, m_depth(nullptr)
+	, m_match(nullptr)
+	, m_fail(nullptr)
+	, m_output(nullptr)
+	, m_pending(nullptr)
+	, m_window(0)
+	, m_nstates(0)
+	, m_nclasses(0)
+	, m_compiled(false)
+{ }
+
+multi_replacer::~multi_replacer()
+{
+	free_automaton();
+}
+
+multi_replacer& multi_replacer::add(str_view pattern, str_view replacement)
+{
+	if (pattern.empty())
+		throw csd::invalid_argument_exception("pattern cannot be empty");
+
+	for (int i = 0; i < m_patterns.len(); i++) {
+		if (m_patterns[i] == pattern) {
+			m_replacements[i] = replacement.to_str();
+			return *this;
+		}
+	}
+
+	m_patterns.append(pattern.to_str());
+	m_replacements.append(replacement.to_str());
+	m_compiled = false;
+
+	return *this;
+}
+
+/* The automaton is only ever moved forward. Each state spells the input
+   from pos - depth, which is the earliest start any match still to come can
+   have, so every start before that has its longest match by now. The longest
+   match at each start is remembered in m_pending, and the starts are taken
+   in order as they become final. After a replacement, the state is cut
+   back along its failure links to the part after the replaced text, instead
+   of reading that part again. */
+str multi_replacer::apply(str_view input)
+{
+	str result;
+	int copied = 0;
+	int state = 0;
+	int start = 0;
+	int live = 0;
+	int pos = 0;
+
+	if (!m_compiled)
+		compile();
+
+	result.reserve(input.len);
+
+	while (start < input.len) {
+		if (pos < input.len) {
+			unsigned char c = input.ptr[pos++];
+
+			m_pending[(pos - 1) % m_window] = -1;
+			state = m_next[state * m_nclasses + m_class[c]];
+
+			/* The states on the output chain are the matches ending here,
+			   from the longest one, so each overwrites a shorter match at
+			   the same start. */
+			for (int s = m_output[state]; s; s = m_output[m_fail[s]])
+				m_pending[(pos - m_depth[s]) % m_window] = m_match[s];
+
+			live = pos - m_depth[state];
+		} else {
+			live = input.len;
+		}
+
+		for (; start < live; start++) {
+			int match = m_pending[start % m_window];
+
+			if (match == -1)
+				continue;
+
+			result.append(str_view(input.ptr + copied, start - copied));
+			result.append(m_replacements[match].view());
+			copied = start + m_patterns[match].len();
+			start = copied - 1;
+
+			/* Drop the part of the state covered by the replacement. */
+			while (pos - m_depth[state] < copied)
+				state = m_fail[state];
+		}
+	}
+
+	result.append(str_view(input.ptr + copied, input.len - copied));
+	return result;
+}
+
+int multi_replacer::len() const
+{
+	return m_patterns.len();
+}
+
+void multi_replacer::compile()
+{
+	int *queue;
+	int max_states = 1;
+	int max_len = 0;
+	int head = 0;
+	int tail = 0;
+
+	free_automaton();
+
+	/* Only bytes which appear in the patterns need their own column in
+	   the transition table, all others always lead back to the root. */
+	memset(m_class, 0, sizeof(m_class));
+	m_nclasses = 1;
+
+	for (const str& pattern : m_patterns) {
+		for (unsigned char c : pattern.view()) {
+			if (!m_class[c])
+				m_class[c] = m_nclasses++;
+		}
+		max_states += pattern.len();
+		if (pattern.len() > max_len)
+			max_len = pattern.len();
+	}
+
+	m_next = new int[max_states * m_nclasses];
+	m_depth = new int[max_states];
+	m_match = new int[max_states];
+	m_fail = new int[max_states];
+	m_output = new int[max_states];
+	queue = new int[max_states];
+
+	memset(m_next, -1, max_states * m_nclasses * sizeof(int));
+	m_depth[0] = 0;
+	m_match[0] = -1;
+	m_fail[0] = 0;
+	m_output[0] = 0;
+	m_nstates = 1;
+
+	/* Pending starts are never further back than the longest pattern. */
+	m_window = max_len + 1;
+	m_pending = new int[m_window];
+
+	/* Build the trie of all patterns. */
+	for (int i = 0; i < m_patterns.len(); i++) {
+		int state = 0;
+
+		for (unsigned char c : m_patterns[i].view()) {
+			int *next = &m_next[state * m_nclasses + m_class[c]];
+
+			if (*next == -1) {
+				*next = m_nstates;
+				m_depth[m_nstates] = m_depth[state] + 1;
+				m_match[m_nstates] = -1;
+				m_nstates++;
+			}
+
+			state = *next;
+		}
+
+		m_match[state] = i;
+	}
+
+	/* Walk the trie breadth first, finding the failure link of each state,
+	   which is the longest proper suffix of it that is also in the trie.
+	   Missing transitions are filled in from the failure state, turning the
+	   trie into a DFA, so reading a byte never has to follow the links. */
+	for (int c = 0; c < m_nclasses; c++) {
+		int next = m_next[c];
+
+		if (next == -1) {
+			m_next[c] = 0;
+		} else {
+			m_fail[next] = 0;
+			queue[tail++] = next;
+		}
+	}
+
+	while (head < tail) {
+		int state = queue[head++];
+
+		if (m_match[state] == -1)
+			m_output[state] = m_output[m_fail[state]];
+		else
+			m_output[state] = state;
+
+		for (int c = 0; c < m_nclasses; c++) {
+			int *next = &m_next[state * m_nclasses + c];
+			int fallback = m_next[m_fail[state] * m_nclasses + c];
+
+			if (*next == -1) {
+				*next = fallback;
+			} else {
+				m_fail[*next] = fallback;
+				queue[tail++] = *next;
+			}
+		}
+	}
+
+	delete[] queue;
+	m_compiled = true;
+}
+
+void multi_replacer::free_automaton()
+{
+	delete[] m_next;
+	delete[] m_depth;
+	delete[] m_match;
+	delete[] m_fail;
+	delete[] m_output;
+	delete[] m_pending;
+
+	m_next = nullptr;
+	m_depth = nullptr;
+	m_match = nullptr;
+	m_fail = nullptr;
+	m_output = nullptr;
+	m_pending = nullptr;
+	m_window = 0;
+	m_nstates = 0;
+	m_compiled = false;
+}
+
+} // namespace csd
@@ -0,0 +1,463 @@
+/* libcsd/src/rope.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/error.h>
+#include <libcsd/rope.h>
+#include <new>
+#include <string.h>
+
+/* The rope is an AVL tree, where the text is only stored in the leaves and
+   each branch knows the total length below it. Nodes are never modified
+   after they are created, all edits build new nodes along the changed path
+   and share the rest, which is what makes copies and substr() cheap. Leaves
+   keep their text right after the node itself, in the same allocation.
+
+   The helpers below pass references around explicitly: a function which
+   "takes" a node consumes one reference to it, and any node returned comes
+   with one reference for the caller. */
+
+struct rope::node
+{
+	csd::__arc refs;
+	int len;
+	int height; /* 0 for leaves */
+	node *left;
+	node *right;
+
+	bool is_leaf() const
+	{
+		return height == 0;
+	}
+
+	const char *data() const
+	{
+		return (const char *) (this + 1);
+	}
+
+	char *data()
+	{
+		return (char *) (this + 1);
+	}
+};
+
+using node = rope::node;
+
+static node *new_node(int len, int height, node *left, node *right,
+					  int data_len)
+{
+	node *n = new (::operator new(sizeof(node) + data_len)) node;
+
+	csd::__arc_init(n->refs, 1);
+	n->len = len;
+	n->height = height;
+	n->left = left;
+	n->right = right;
+
+	return n;
+}
+
+static node *retain(node *n)
+{
+	if (n)
+		csd::__arc_inc(n->refs);
+	return n;
+}
+
+static void release(node *n)
+{
+	if (!n || csd::__arc_dec(n->refs))
+		return;
+
+	release(n->left);
+	release(n->right);
+	n->~node();
+	::operator delete(n);
+}
+
+static int height_of(const node *n)
+{
+	return n ? n->height : -1;
+}
+
+static node *make_leaf(const char *ptr, int len)
+{
+	node *leaf = new_node(len, 0, nullptr, nullptr, len);
+
+	memcpy(leaf->data(), ptr, len);
+	return leaf;
+}
+
+/* Takes l and r. */
+static node *make_branch(node *l, node *r)
+{
+	int height = l->height > r->height ? l->height : r->height;
+	return new_node(l->len + r->len, height + 1, l, r, 0);
+}
+
+/* Takes l and r, which may differ in height by 2 at most, and joins them
+   with a rotation if needed. */
+static node *balance(node *l, node *r)
+{
+	node *joined;
+
+	if (l->height > r->height + 1) {
+		if (height_of(l->left) >= height_of(l->right)) {
+			joined = make_branch(retain(l->left),
+								 make_branch(retain(l->right), r));
+		} else {
+			node *lr = l->right;
+			joined = make_branch(
+				make_branch(retain(l->left), retain(lr->left)),
+				make_branch(retain(lr->right), r));
+		}
+		release(l);
+		return joined;
+	}
+
+	if (r->height > l->height + 1) {
+		if (height_of(r->right) >= height_of(r->left)) {
+			joined = make_branch(make_branch(l, retain(r->left)),
+								 retain(r->right));
+		} else {
+			node *rl = r->left;
+			joined = make_branch(make_branch(l, retain(rl->left)),
+								 make_branch(retain(rl->right),
+											 retain(r->right)));
+		}
+		release(r);
+		return joined;
+	}
+
+	return make_branch(l, r);
+}
+
+static bool fits_in_leaf(const node *a, const node *b)
+{
+	return a->is_leaf() && b->is_leaf() && a->len + b->len <= rope::max_chunk;
+}
+
+/* Takes a and b, and returns them joined. The shorter tree is hung into
+   the taller one at the matching height, so this costs the difference of
+   their heights. Small neighbouring leaves are merged, so that many small
+   appends do not leave a tree of tiny chunks. */
+static node *concat(node *a, node *b)
+{
+	node *left;
+	node *right;
+	node *merged;
+
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+
+	if (fits_in_leaf(a, b)) {
+		merged = new_node(a->len + b->len, 0, nullptr, nullptr,
+						  a->len + b->len);
+		memcpy(merged->data(), a->data(), a->len);
+		memcpy(merged->data() + a->len, b->data(), b->len);
+		release(a);
+		release(b);
+		return merged;
+	}
+
+	if (a->height > b->height + 1
+		|| (!a->is_leaf() && fits_in_leaf(a->right, b))) {
+		left = retain(a->left);
+		right = retain(a->right);
+		release(a);
+		return balance(left, concat(right, b));
+	}
+
+	if (b->height > a->height + 1
+		|| (!b->is_leaf() && fits_in_leaf(a, b->left))) {
+		left = retain(b->left);
+		right = retain(b->right);
+		release(b);
+		return balance(concat(a, left), right);
+	}
+
+	return make_branch(a, b);
+}
+
+/* Builds a balanced tree of full chunks, with only the last one shorter. */
+static node *build(const char *ptr, int len)
+{
+	int nchunks;
+	int left_len;
+
+	if (len == 0)
+		return nullptr;
+	if (len <= rope::max_chunk)
+		return make_leaf(ptr, len);
+
+	nchunks = (len + rope::max_chunk - 1) / rope::max_chunk;
+	left_len = nchunks / 2 * rope::max_chunk;
+
+	return make_branch(build(ptr, left_len),
+					   build(ptr + left_len, len - left_len));
+}
+
+/* Splits the text of n before `index`, without taking n. */
+static void split(node *n, int index, node **left, node **right)
+{
+	node *part;
+
+	if (!n || index <= 0) {
+		*left = nullptr;
+		*right = retain(n);
+		return;
+	}
+
+	if (index >= n->len) {
+		*left = retain(n);
+		*right = nullptr;
+		return;
+	}
+
+	if (n->is_leaf()) {
+		*left = make_leaf(n->data(), index);
+		*right = make_leaf(n->data() + index, n->len - index);
+		return;
+	}
+
+	if (index < n->left->len) {
+		split(n->left, index, left, &part);
+		*right = concat(part, retain(n->right));
+	} else {
+		split(n->right, index - n->left->len, &part, right);
+		*left = concat(retain(n->left), part);
+	}
+}
+
+rope::rope()
+	: m_root(nullptr)
+{ }
+
+rope::rope(csd::str_view string)
+	: m_root(build(string.ptr, string.len))
+{ }
+
+rope::rope(const rope& other)
+	: m_root(retain(other.m_root))
+{ }
+
+rope::rope(rope&& moved)
+	: m_root(moved.m_root)
+{
+	moved.m_root = nullptr;
+}
+
+rope::rope(node *root)
+	: m_root(root)
+{ }
+
+rope::~rope()
+{
+	release(m_root);
+}
+
+int rope::len() const
+{
+	return m_root ? m_root->len : 0;
+}
+
+bool rope::empty() const
+{
+	return len() == 0;
+}
+
+rope::chunk_range rope::chunks() const
+{
+	return {m_root};
+}
+
+rope rope::substr(int start_index, int length) const
+{
+	node *before;
+	node *rest;
+	node *middle;
+	node *after;
+
+	if (start_index < 0 || start_index >= len())
+		return rope();
+	if (length < 0 || length > len() - start_index)
+		length = len() - start_index;
+
+	split(m_root, start_index, &before, &rest);
+	split(rest, length, &middle, &after);
+	release(before);
+	release(rest);
+	release(after);
+
+	return rope(middle);
+}
+
+rope& rope::insert(int index, csd::str_view string)
+{
+	return replace(index, 0, string);
+}
+
+rope& rope::insert(int index, const rope& other)
+{
+	node *before;
+	node *after;
+
+	check_range(index, 0);
+	if (other.len() > str::max_len - len())
+		throw csd::memory_exception("rope: string too long");
+
+	split(m_root, index, &before, &after);
+	before = concat(before, retain(other.m_root));
+
+	release(m_root);
+	m_root = concat(before, after);
+	return *this;
+}
+
+rope& rope::erase(int index, int length)
+{
+	return replace(index, length, csd::str_view());
+}
+
+rope& rope::replace(int index, int length, csd::str_view replacement)
+{
+	node *before;
+	node *rest;
+	node *middle;
+	node *after;
+
+	check_range(index, length);
+	if (replacement.len > str::max_len - (len() - length))
+		throw csd::memory_exception("rope: string too long");
+
+	split(m_root, index, &before, &rest);
+	split(rest, length, &middle, &after);
+	release(rest);
+	release(middle);
+
+	/* The replacement may point into this rope, so it has to be copied
+	   before the old tree is released. */
+	before = concat(before, build(replacement.ptr, replacement.len));
+
+	release(m_root);
+	m_root = concat(before, after);
+	return *this;
+}
+
+rope& rope::append(csd::str_view string)
+{
+	return insert(len(), string);
+}
+
+rope& rope::append(const rope& other)
+{
+	return insert(len(), other);
+}
+
+str rope::to_str() const
+{
+	str flat;
+
+	flat.reserve(len());
+	for (csd::str_view chunk : chunks())
+		flat.append(chunk);
+
+	return flat;
+}
+
+rope& rope::operator=(const rope& other)
+{
+	node *old_root = m_root;
+
+	m_root = retain(other.m_root);
+	release(old_root);
+	return *this;
+}
+
+rope& rope::operator=(rope&& other)
+{
+	if (this != &other) {
+		release(m_root);
+		m_root = other.m_root;
+		other.m_root = nullptr;
+	}
+	return *this;
+}
+
+rope& rope::operator+=(csd::str_view string)
+{
+	return append(string);
+}
+
+rope& rope::operator+=(const rope& other)
+{
+	return append(other);
+}
+
+char rope::operator[](int index) const
+{
+	const node *n = m_root;
+
+	if (index < 0 || index >= len())
+		throw csd::index_exception(index, 0, len() - 1);
+
+	while (!n->is_leaf()) {
+		if (index < n->left->len) {
+			n = n->left;
+		} else {
+			index -= n->left->len;
+			n = n->right;
+		}
+	}
+
+	return n->data()[index];
+}
+
+void rope::check_range(int index, int length) const
+{
+	if (index < 0 || index > len())
+		throw csd::index_exception(index, 0, len());
+	if (length < 0 || length > len() - index)
+		throw csd::index_exception(index + length, index, len());
+}
+
+rope::chunk_iterator::chunk_iterator(const node *root)
+	: m_depth(0)
+{
+	if (root)
+		descend_left(root);
+}
+
+csd::str_view rope::chunk_iterator::operator*() const
+{
+	const node *leaf = m_stack[m_depth - 1];
+	return {leaf->data(), leaf->len};
+}
+
+rope::chunk_iterator& rope::chunk_iterator::operator++()
+{
+	if (--m_depth)
+		descend_left(m_stack[--m_depth]);
+	return *this;
+}
+
+void rope::chunk_iterator::descend_left(const node *from)
+{
+	while (!from->is_leaf()) {
+		m_stack[m_depth++] = from->right;
+		from = from->left;
+	}
+
+	m_stack[m_depth++] = from;
+}
+
+rope::chunk_iterator rope::chunk_range::begin() const
+{
+	return chunk_iterator(root);
+}
+
+rope::chunk_iterator rope::chunk_range::end() const
+{
+	return chunk_iterator(nullptr);
+}
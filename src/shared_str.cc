@@ -0,0 +1,222 @@
+/* libcsd/src/shared_str.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/error.h>
+#include <libcsd/shared_str.h>
+#include <new>
+#include <string.h>
+
+/* The text is stored right after the block, in the same allocation. It is
+   NUL-terminated, even though substrings cannot rely on that. */
+struct shared_str::block
+{
+	csd::__arc refs;
+
+	char *data()
+	{
+		return (char *) (this + 1);
+	}
+};
+
+using block = shared_str::block;
+
+static block *new_block(const char *ptr, int len)
+{
+	block *b;
+
+	if (len < 0 || len > str::max_len)
+		throw csd::memory_exception("shared_str: string too long");
+
+	b = new (::operator new(sizeof(block) + len + 1)) block;
+	csd::__arc_init(b->refs, 1);
+	memcpy(b->data(), ptr, len);
+	b->data()[len] = 0;
+
+	return b;
+}
+
+static block *retain(block *b)
+{
+	if (b)
+		csd::__arc_inc(b->refs);
+	return b;
+}
+
+static void release(block *b)
+{
+	if (!b || csd::__arc_dec(b->refs))
+		return;
+
+	b->~block();
+	::operator delete(b);
+}
+
+shared_str::shared_str()
+	: m_block(nullptr)
+	, m_ptr("")
+	, m_len(0)
+{ }
+
+shared_str::shared_str(const char *string)
+	: shared_str(csd::str_view(string))
+{ }
+
+shared_str::shared_str(const str& string)
+	: shared_str(string.view())
+{ }
+
+shared_str::shared_str(csd::str_view view)
+	: shared_str()
+{
+	if (view.len == 0)
+		return;
+
+	m_block = new_block(view.ptr, view.len);
+	m_ptr = m_block->data();
+	m_len = view.len;
+}
+
+shared_str::shared_str(const shared_str& other)
+	: m_block(retain(other.m_block))
+	, m_ptr(other.m_ptr)
+	, m_len(other.m_len)
+{ }
+
+shared_str::shared_str(shared_str&& moved)
+	: m_block(moved.m_block)
+	, m_ptr(moved.m_ptr)
+	, m_len(moved.m_len)
+{
+	moved.m_block = nullptr;
+	moved.m_ptr = "";
+	moved.m_len = 0;
+}
+
+shared_str::shared_str(block *shared_block, const char *ptr, int len)
+	: m_block(shared_block)
+	, m_ptr(ptr)
+	, m_len(len)
+{ }
+
+shared_str::~shared_str()
+{
+	release(m_block);
+}
+
+int shared_str::len() const
+{
+	return m_len;
+}
+
+bool shared_str::empty() const
+{
+	return m_len == 0;
+}
+
+size_t shared_str::hash() const
+{
+	return view().hash();
+}
+
+csd::str_view shared_str::view() const
+{
+	return {m_ptr, m_len};
+}
+
+str shared_str::to_str() const
+{
+	return str(view());
+}
+
+long shared_str::use_count() const
+{
+	return m_block ? csd::__arc_load(m_block->refs) : 0;
+}
+
+int shared_str::find(csd::str_view substr) const
+{
+	return view().find(substr);
+}
+
+int shared_str::rfind(csd::str_view substr) const
+{
+	return view().rfind(substr);
+}
+
+int shared_str::find_char(char c, int start_index) const
+{
+	return view().find_char(c, start_index);
+}
+
+bool shared_str::contains(csd::str_view substr) const
+{
+	return view().contains(substr);
+}
+
+bool shared_str::begins_with(csd::str_view other) const
+{
+	return view().begins_with(other);
+}
+
+bool shared_str::ends_with(csd::str_view other) const
+{
+	return view().ends_with(other);
+}
+
+shared_str shared_str::substr(int start_index, int length) const
+{
+	csd::str_view slice = view().substr(start_index, length);
+
+	if (slice.len == 0)
+		return shared_str();
+
+	return shared_str(retain(m_block), slice.ptr, slice.len);
+}
+
+shared_str& shared_str::operator=(const shared_str& other)
+{
+	block *old_block = m_block;
+
+	m_block = retain(other.m_block);
+	m_ptr = other.m_ptr;
+	m_len = other.m_len;
+	release(old_block);
+
+	return *this;
+}
+
+shared_str& shared_str::operator=(shared_str&& other)
+{
+	if (this != &other) {
+		release(m_block);
+		m_block = other.m_block;
+		m_ptr = other.m_ptr;
+		m_len = other.m_len;
+
+		other.m_block = nullptr;
+		other.m_ptr = "";
+		other.m_len = 0;
+	}
+
+	return *this;
+}
+
+shared_str::operator csd::str_view() const
+{
+	return view();
+}
+
+const char& shared_str::operator[](int index) const
+{
+	return view()[index];
+}
+
+shared_str::iterator shared_str::begin() const
+{
+	return m_ptr;
+}
+
+shared_str::iterator shared_str::end() const
+{
+	return m_ptr + m_len;
+}
@@ -0,0 +1,154 @@
+/* libcsd/src/split.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/split.h>
+#include <string.h>
+
+namespace csd {
+
+/* ASCII whitespace, the same set str_view::lstrip() skips, independent of
+   the locale. */
+static inline bool is_space(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+splitter::splitter(str_view input, str_view separator, split_mode mode,
+				   int max_splits)
+	: m_input(input)
+	, m_separator(separator)
+	, m_mode(mode)
+	, m_max_splits(max_splits)
+{
+	memset(m_any, 0, sizeof(m_any));
+
+	/* A bitmap of separator bytes, so split_any() checks each byte of the
+	   input with a single lookup. */
+	if (mode == split_by_any) {
+		for (unsigned char c : separator)
+			m_any[c >> 3] |= 1 << (c & 7);
+	}
+}
+
+splitter::iterator splitter::begin() const
+{
+	return iterator(this, false);
+}
+
+splitter::iterator splitter::end() const
+{
+	return iterator(this, true);
+}
+
+splitter::iterator::iterator(const splitter *parent, bool at_end)
+	: m_parent(parent)
+	, m_rest(parent->m_input)
+	, m_token()
+	, m_splits(0)
+	, m_last(false)
+	, m_at_end(at_end)
+{
+	if (!at_end)
+		advance();
+}
+
+str_view splitter::iterator::operator*() const
+{
+	return m_token;
+}
+
+splitter::iterator& splitter::iterator::operator++()
+{
+	advance();
+	return *this;
+}
+
+void splitter::iterator::advance()
+{
+	int sep_len = 0;
+	int index;
+
+	if (m_last) {
+		m_at_end = true;
+		return;
+	}
+
+	/* Whitespace at the start is not a part of its own. */
+	if (m_parent->m_mode == split_by_whitespace) {
+		m_rest = m_rest.lstrip();
+		if (m_rest.empty()) {
+			m_at_end = true;
+			return;
+		}
+	}
+
+	if (m_parent->m_max_splits >= 0 && m_splits == m_parent->m_max_splits)
+		index = -1;
+	else
+		index = find_separator(&sep_len);
+
+	if (index == -1) {
+		m_token = m_rest;
+		m_last = true;
+		return;
+	}
+
+	m_token = str_view(m_rest.ptr, index);
+	m_rest = str_view(m_rest.ptr + index + sep_len,
+					  m_rest.len - index - sep_len);
+	m_splits++;
+}
+
+int splitter::iterator::find_separator(int *sep_len) const
+{
+	const unsigned char *any = m_parent->m_any;
+
+	switch (m_parent->m_mode) {
+	case split_by_string:
+		*sep_len = m_parent->m_separator.len;
+		return m_rest.find(m_parent->m_separator);
+
+	case split_by_any:
+		*sep_len = 1;
+		for (int i = 0; i < m_rest.len; i++) {
+			unsigned char c = m_rest.ptr[i];
+			if (any[c >> 3] & (1 << (c & 7)))
+				return i;
+		}
+		return -1;
+
+	case split_by_whitespace:
+		for (int i = 0; i < m_rest.len; i++) {
+			if (!is_space(m_rest.ptr[i]))
+				continue;
+
+			/* Swallow the whole run of whitespace. */
+			*sep_len = 1;
+			while (i + *sep_len < m_rest.len
+				   && is_space(m_rest.ptr[i + *sep_len]))
+				(*sep_len)++;
+			return i;
+		}
+		return -1;
+	}
+
+	return -1;
+}
+
+splitter split(str_view input, str_view separator, int max_splits)
+{
+	return splitter(input, separator, splitter::split_by_string, max_splits);
+}
+
+splitter split_any(str_view input, str_view separators, int max_splits)
+{
+	return splitter(input, separators, splitter::split_by_any, max_splits);
+}
+
+splitter split_whitespace(str_view input, int max_splits)
+{
+	return splitter(input, str_view(), splitter::split_by_whitespace,
+					max_splits);
+}
+
+} // namespace csd
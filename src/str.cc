@@ -1,119 +1,384 @@
 /* libcsd/src/str.cc
    Copyright (c) 2022-2023 bellrise */
 
-#include <ctype.h>
 #include <libcsd/bytes.h>
+#include <libcsd/charconv.h>
 #include <libcsd/error.h>
+#include <libcsd/hash.h>
+#include <libcsd/print.h>
 #include <new>
-#include <stdio.h>
 #include <string.h>
 
+namespace csd {
+
+str_view::str_view(const str& string)
+	: str_view(string.view())
+{ }
+
+bool str_view::empty() const
+{
+	return len == 0;
+}
+
+str str_view::to_str() const
+{
+	return str(*this);
+}
+
+size_t str_view::hash() const
+{
+	return csd::hash_bytes(ptr, len);
+}
+
+int str_view::find(str_view substr) const
+{
+	return find_from(substr, 0);
+}
+
+int str_view::find_from(str_view substr, int start_index) const
+{
+	int index;
+
+	if (start_index < 0 || start_index > len || substr.len == 0)
+		return invalid_index;
+
+	index = csd::find_bytes(ptr + start_index, len - start_index, substr.ptr,
+							substr.len);
+	return index == -1 ? invalid_index : index + start_index;
+}
+
+int str_view::rfind(str_view substr) const
+{
+	int index;
+
+	if (substr.len == 0)
+		return invalid_index;
+
+	index = csd::rfind_bytes(ptr, len, substr.ptr, substr.len);
+	return index == -1 ? invalid_index : index;
+}
+
+int str_view::find_char(char c, int start_index) const
+{
+	int index;
+
+	if (start_index < 0 || start_index >= len)
+		return invalid_index;
+
+	index = csd::find_byte(ptr + start_index, len - start_index, c);
+	return index == -1 ? invalid_index : index + start_index;
+}
+
+bool str_view::contains(str_view substr) const
+{
+	return find(substr) != invalid_index;
+}
+
+bool str_view::begins_with(str_view other) const
+{
+	return len >= other.len && !memcmp(ptr, other.ptr, other.len);
+}
+
+bool str_view::ends_with(str_view other) const
+{
+	return len >= other.len
+		&& !memcmp(ptr + len - other.len, other.ptr, other.len);
+}
+
+str_view str_view::substr(int start_index, int length) const
+{
+	if (start_index < 0 || start_index >= len)
+		return {};
+
+	if (length < 0 || length > len - start_index)
+		length = len - start_index;
+
+	return {ptr + start_index, length};
+}
+
+/* Same as isspace() in the C locale, without the locale lookup. */
+static inline bool is_space(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+str_view str_view::lstrip() const
+{
+	int i = 0;
+
+	while (i < len && is_space(ptr[i]))
+		i++;
+
+	return {ptr + i, len - i};
+}
+
+str_view str_view::rstrip() const
+{
+	int i = len;
+
+	while (i > 0 && is_space(ptr[i - 1]))
+		i--;
+
+	return {ptr, i};
+}
+
+str_view str_view::strip() const
+{
+	return lstrip().rstrip();
+}
+
+bool str_view::equals_ignore_case(str_view other) const
+{
+	return len == other.len
+		&& csd::ascii_equal_ignore_case(ptr, other.ptr, len);
+}
+
+int str_view::find_ignore_case(str_view substr) const
+{
+	if (substr.len == 0)
+		return invalid_index;
+	return csd::find_bytes_ignore_case(ptr, len, substr.ptr, substr.len);
+}
+
+int str_view::compare(str_view other) const
+{
+	int shorter = len < other.len ? len : other.len;
+	int diff = memcmp(ptr, other.ptr, shorter);
+
+	if (diff)
+		return diff;
+	return len - other.len;
+}
+
+maybe<int> str_view::to_int() const
+{
+	int value;
+
+	if (!csd::from_chars(ptr, len, &value))
+		return {};
+	return value;
+}
+
+maybe<long long> str_view::to_int64() const
+{
+	long long value;
+
+	if (!csd::from_chars(ptr, len, &value))
+		return {};
+	return value;
+}
+
+maybe<unsigned long long> str_view::to_uint64() const
+{
+	unsigned long long value;
+
+	if (!csd::from_chars(ptr, len, &value))
+		return {};
+	return value;
+}
+
+maybe<double> str_view::to_double() const
+{
+	double value;
+
+	if (!csd::from_chars(ptr, len, &value))
+		return {};
+	return value;
+}
+
+bool str_view::is_valid_utf8() const
+{
+	return csd::is_valid_utf8(ptr, len);
+}
+
+int str_view::count_codepoints() const
+{
+	return csd::count_codepoints(ptr, len);
+}
+
+codepoint_range str_view::codepoints() const
+{
+	return {ptr, len};
+}
+
+maybe<bytes> str_view::to_utf16() const
+{
+	bytes units;
+
+	if (!csd::is_valid_utf8(ptr, len))
+		return {};
+
+	units.alloc(csd::utf16_length(ptr, len) * sizeof(char16_t));
+	csd::utf8_to_utf16(ptr, len, (char16_t *) units.raw_ptr());
+	return units;
+}
+
+maybe<bytes> str_view::to_utf32() const
+{
+	bytes units;
+
+	if (!csd::is_valid_utf8(ptr, len))
+		return {};
+
+	units.alloc(csd::count_codepoints(ptr, len) * sizeof(char32_t));
+	csd::utf8_to_utf32(ptr, len, (char32_t *) units.raw_ptr());
+	return units;
+}
+
+str str_view::to_hex() const
+{
+	str result;
+
+	result.append_hex(ptr, len);
+	return result;
+}
+
+str str_view::to_base64(base64_variant variant) const
+{
+	str result;
+
+	result.append_base64(ptr, len, variant);
+	return result;
+}
+
+const char& str_view::operator[](int index) const
+{
+	if (index < 0)
+		index = len + index;
+	if (index < 0 || index >= len)
+		throw csd::index_exception(index, 0, len - 1);
+	return ptr[index];
+}
+
+str_view::iterator str_view::begin() const
+{
+	return ptr;
+}
+
+str_view::iterator str_view::end() const
+{
+	return ptr + len;
+}
+
+} // namespace csd
+
 str::str()
-	: m_ptr(nullptr)
-	, m_space(0)
+	: m_ptr(m_local)
+	, m_space(sso_capacity + 1)
 	, m_len(0)
-{ }
+{
+	m_local[0] = 0;
+}
 
 str::str(const str& other)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+	: str()
 {
 	copy_from(other);
 }
 
 str::str(str&& moved)
-	: m_ptr(moved.m_ptr)
-	, m_space(moved.m_space)
-	, m_len(moved.m_len)
+	: str()
 {
-	moved.m_ptr = nullptr;
-	moved.m_space = 0;
-	moved.m_len = 0;
+	move_from(moved);
 }
 
 str::str(const char *string)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+	: str()
 {
 	if (string == nullptr)
 		return;
-
-	m_len = strlen(string);
-	m_space = m_len + 1;
-	m_ptr = new char[m_space];
-	memcpy(m_ptr, string, m_len);
-	m_ptr[m_space - 1] = 0;
+	copy_from_raw(string, strlen(string));
 }
 
 str::str(const char *string, int maxlen)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+	: str()
 {
 	copy_from_raw(string, maxlen);
 }
 
+str::str(csd::str_view view)
+	: str()
+{
+	copy_from_raw(view.ptr, view.len);
+}
+
 str::str(void *pointer)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+	: str()
 {
-	char buf[16];
-	memset(buf, 0, 16);
+	char buf[csd::to_chars_max];
 
-	snprintf(buf, 16, "%p", pointer);
-	copy_from_raw(buf, strlen(buf));
+	buf[0] = '0';
+	buf[1] = 'x';
+	copy_from_raw(buf, 2 + csd::to_chars_hex(buf + 2, sizeof(buf) - 2,
+											 (unsigned long) pointer));
 }
 
-str::str(size_t number)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+str::str(int number)
+	: str()
 {
-	char buf[16];
-	memset(buf, 0, 16);
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
+}
 
-	snprintf(buf, 16, "%zu", number);
-	copy_from_raw(buf, strlen(buf));
+str::str(unsigned int number)
+	: str()
+{
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
 }
 
-str::str(float number)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+str::str(long number)
+	: str()
 {
-	char buf[16];
-	memset(buf, 0, 16);
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
+}
 
-	snprintf(buf, 16, "%f", number);
-	copy_from_raw(buf, strlen(buf));
+str::str(unsigned long number)
+	: str()
+{
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
 }
 
-str::str(int number)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+str::str(long long number)
+	: str()
+{
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
+}
+
+str::str(unsigned long long number)
+	: str()
+{
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
+}
+
+str::str(float number)
+	: str()
 {
-	char buf[16];
-	memset(buf, 0, 16);
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
+}
 
-	snprintf(buf, 16, "%d", number);
-	copy_from_raw(buf, strlen(buf));
+str::str(double number)
+	: str()
+{
+	char buf[csd::to_chars_max];
+	copy_from_raw(buf, csd::to_chars(buf, sizeof(buf), number));
 }
 
 str::str(char c)
-	: m_ptr(nullptr)
-	, m_space(0)
-	, m_len(0)
+	: str()
 {
 	copy_from_raw(&c, 1);
 }
 
 str::~str()
 {
-	delete[] m_ptr;
+	if (!is_local())
+		delete[] m_ptr;
 }
 
 int str::len() const
@@ -139,9 +404,7 @@ bytes str::to_bytes() const
 
 void str::print() const
 {
-	if (len() == 0)
-		return;
-	printf("%.*s", (int) len(), m_ptr);
+	::print(*this);
 }
 
 bool str::empty() const
@@ -149,23 +412,19 @@ bool str::empty() const
 	return len() == 0;
 }
 
-bool str::contains(const str& substr) const
+bool str::contains(csd::str_view substr) const
 {
-	return find(substr) != invalid_index;
+	return view().contains(substr);
 }
 
-bool str::begins_with(const str& other) const
+bool str::begins_with(csd::str_view other) const
 {
-	if (len() < other.len())
-		return false;
-	return other == substr(0, other.len());
+	return view().begins_with(other);
 }
 
-bool str::ends_with(const str& other) const
+bool str::ends_with(csd::str_view other) const
 {
-	if (len() < other.len())
-		return false;
-	return other == substr(len() - other.len());
+	return view().ends_with(other);
 }
 
 str str::copy() const
@@ -175,17 +434,121 @@ str str::copy() const
 	return s;
 }
 
-int str::find(const str& substr) const
+size_t str::hash() const
 {
-	if (len() < substr.len() || substr.len() == 0)
-		return invalid_index;
+	return csd::hash_bytes(m_ptr, m_len);
+}
 
-	for (int i = 0; i <= len() - substr.len(); i++) {
-		if (!strncmp(m_ptr + i, substr.m_ptr, substr.len()))
-			return i;
-	}
+int str::compare(csd::str_view other) const
+{
+	return view().compare(other);
+}
+
+maybe<int> str::to_int() const
+{
+	return view().to_int();
+}
+
+maybe<long long> str::to_int64() const
+{
+	return view().to_int64();
+}
+
+maybe<unsigned long long> str::to_uint64() const
+{
+	return view().to_uint64();
+}
+
+maybe<double> str::to_double() const
+{
+	return view().to_double();
+}
+
+bool str::is_valid_utf8() const
+{
+	return view().is_valid_utf8();
+}
+
+int str::count_codepoints() const
+{
+	return view().count_codepoints();
+}
 
-	return invalid_index;
+csd::codepoint_range str::codepoints() const
+{
+	return view().codepoints();
+}
+
+maybe<bytes> str::to_utf16() const
+{
+	return view().to_utf16();
+}
+
+maybe<bytes> str::to_utf32() const
+{
+	return view().to_utf32();
+}
+
+maybe<str> str::from_utf16(const char16_t *units, int len)
+{
+	long utf8_len = csd::utf8_length(units, len);
+	str result;
+
+	if (utf8_len < 0)
+		return {};
+	if (utf8_len > max_len)
+		throw csd::memory_exception("str: string too long");
+
+	result.reserve(utf8_len);
+	result.m_len = csd::utf16_to_utf8(units, len, result.m_ptr);
+	result.m_ptr[result.m_len] = 0;
+	return result;
+}
+
+maybe<str> str::from_utf32(const char32_t *units, int len)
+{
+	long utf8_len = csd::utf8_length(units, len);
+	str result;
+
+	if (utf8_len < 0)
+		return {};
+	if (utf8_len > max_len)
+		throw csd::memory_exception("str: string too long");
+
+	result.reserve(utf8_len);
+	result.m_len = csd::utf32_to_utf8(units, len, result.m_ptr);
+	result.m_ptr[result.m_len] = 0;
+	return result;
+}
+
+str str::to_hex() const
+{
+	return view().to_hex();
+}
+
+str str::to_base64(csd::base64_variant variant) const
+{
+	return view().to_base64(variant);
+}
+
+int str::find(csd::str_view substr) const
+{
+	return view().find(substr);
+}
+
+int str::find_from(csd::str_view substr, int start_index) const
+{
+	return view().find_from(substr, start_index);
+}
+
+int str::rfind(csd::str_view substr) const
+{
+	return view().rfind(substr);
+}
+
+int str::find_char(char c, int start_index) const
+{
+	return view().find_char(c, start_index);
 }
 
 str str::substr(int start_index, int length) const
@@ -206,38 +569,39 @@ str str::substr(int start_index, int length) const
 
 str& str::lstrip()
 {
-	int i = 0;
-	while (i < m_len - 1) {
-		if (!isspace(m_ptr[i]))
-			break;
-		++i;
-	}
+	csd::str_view stripped = view().lstrip();
 
-	*this = substr(i);
+	memmove(m_ptr, stripped.ptr, stripped.len);
+	m_len = stripped.len;
+	m_ptr[m_len] = 0;
 	return *this;
 }
 
 str& str::rstrip()
 {
-	int i = m_len;
-	while (i > 0) {
-		if (!isspace(m_ptr[i]))
-			break;
-		--i;
-	}
-
-	*this = substr(0, i + 1);
+	m_len = view().rstrip().len;
+	m_ptr[m_len] = 0;
 	return *this;
 }
 
 str& str::strip()
 {
-	lstrip();
 	rstrip();
+	lstrip();
 	return *this;
 }
 
-const csd::str_view str::view()
+bool str::equals_ignore_case(csd::str_view other) const
+{
+	return view().equals_ignore_case(other);
+}
+
+int str::find_ignore_case(csd::str_view substr) const
+{
+	return view().find_ignore_case(substr);
+}
+
+const csd::str_view str::view() const
 {
 	return {m_ptr, m_len};
 }
@@ -252,7 +616,19 @@ str& str::replace(char from, char to)
 	return *this;
 }
 
-str& str::replace(const str& substr, const str& replacement)
+str& str::to_lower()
+{
+	csd::ascii_to_lower(m_ptr, m_len);
+	return *this;
+}
+
+str& str::to_upper()
+{
+	csd::ascii_to_upper(m_ptr, m_len);
+	return *this;
+}
+
+str& str::replace(csd::str_view substr, csd::str_view replacement)
 {
 	str new_str;
 	int index;
@@ -260,74 +636,196 @@ str& str::replace(const str& substr, const str& replacement)
 	if ((index = find(substr)) == invalid_index)
 		return *this;
 
-	*this = this->substr(0, index) + replacement
-		  + this->substr(index + substr.len());
+	new_str.reserve(m_len - substr.len + replacement.len);
+	new_str.append_raw(m_ptr, index);
+	new_str.append_raw(replacement.ptr, replacement.len);
+	new_str.append_raw(m_ptr + index + substr.len, m_len - index - substr.len);
+
+	move_from(new_str);
 	return *this;
 }
 
-str& str::append(const str& next)
+str& str::replace_all(csd::str_view substr, csd::str_view replacement)
 {
-	int old_len = len();
-	int bytes_to_copy = next.len();
-	int required_bytes = len() + next.len() + 1;
+	str new_str;
+	long new_len;
+	int matches = 0;
+	int index = 0;
+	int from;
 
-	if (resize(required_bytes) < required_bytes) {
-		bytes_to_copy = next.len() - (m_space - len());
-		m_len = len() + bytes_to_copy;
-	} else {
-		m_len = len() + next.len();
+	if (substr.empty())
+		return *this;
+
+	/* Count the matches first, so the new string can be allocated in one
+	   go. Both `substr` and `replacement` may point into this string, which
+	   is fine, because it stays untouched until the very end. */
+	while ((index = find_from(substr, index)) != invalid_index) {
+		index += substr.len;
+		matches++;
 	}
 
-	memmove(&m_ptr[old_len], next.m_ptr, bytes_to_copy);
-	m_ptr[m_space - 1] = 0;
+	if (!matches)
+		return *this;
+
+	new_len = m_len + (long) matches * (replacement.len - substr.len);
+	if (new_len > max_len)
+		throw csd::memory_exception("str: string too long");
+	new_str.reserve(new_len);
 
+	for (from = 0; matches--; from = index + substr.len) {
+		index = find_from(substr, from);
+		new_str.append_raw(m_ptr + from, index - from);
+		new_str.append_raw(replacement.ptr, replacement.len);
+	}
+	new_str.append_raw(m_ptr + from, m_len - from);
+
+	move_from(new_str);
+	return *this;
+}
+
+str& str::append(const str& next)
+{
+	append_raw(next.m_ptr, next.len());
 	return *this;
 }
 
 str& str::append(const char *next)
 {
-	int old_len = len();
-	int next_len = strlen(next);
-	int bytes_to_copy = next_len;
-	int required_bytes = len() + next_len + 1;
+	append_raw(next, strlen(next));
+	return *this;
+}
 
-	if (resize(required_bytes) < required_bytes) {
-		bytes_to_copy = next_len - (m_space - len());
-		m_len = len() + bytes_to_copy;
-	} else {
-		m_len = len() + next_len;
-	}
+str& str::append(csd::str_view next)
+{
+	append_raw(next.ptr, next.len);
+	return *this;
+}
 
-	memmove(&m_ptr[old_len], next, bytes_to_copy);
-	m_ptr[m_space - 1] = 0;
+str& str::append_hex(const void *data, int len)
+{
+	char *out = append_room(data, csd::hex_length(len));
 
+	m_len += csd::hex_encode(data, len, out);
+	m_ptr[m_len] = 0;
 	return *this;
 }
 
-void str::copy_from(const str& other)
+str& str::append_base64(const void *data, int len,
+						csd::base64_variant variant)
 {
-	int required_bytes = other.len() + 1;
+	char *out = append_room(data, csd::base64_length(len, variant));
 
-	if (resize(required_bytes) < required_bytes)
-		memmove(m_ptr, other.m_ptr, m_space - 1);
-	else
-		memmove(m_ptr, other.m_ptr, other.len());
+	m_len += csd::base64_encode(data, len, out, variant);
+	m_ptr[m_len] = 0;
+	return *this;
+}
 
-	m_len = other.len();
-	m_ptr[m_space - 1] = 0;
+int str::capacity() const
+{
+	return m_space - 1;
 }
 
-void str::copy_from_raw(const char *other, int other_len)
+void str::reserve(int nchars)
+{
+	if (nchars + 1 > m_space)
+		realloc_to(nchars + 1);
+}
+
+void str::shrink_to_fit()
+{
+	if (is_local() || m_space == m_len + 1)
+		return;
+
+	/* Short enough to move back into the object. */
+	if (m_len <= sso_capacity) {
+		char *old_ptr = m_ptr;
+
+		memcpy(m_local, old_ptr, m_len + 1);
+		m_ptr = m_local;
+		m_space = sso_capacity + 1;
+
+		delete[] old_ptr;
+		return;
+	}
+
+	realloc_to(m_len + 1);
+}
+
+void str::copy_from(const str& other)
 {
-	int required_bytes = other_len + 1;
+	copy_from_raw(other.m_ptr, other.len());
+}
 
-	if (resize(required_bytes) < required_bytes)
-		memmove(m_ptr, other, m_space - 1);
-	else
-		memmove(m_ptr, other, other_len);
+void str::copy_from_raw(const char *other, int other_len)
+{
+	/* Assignment does not need any spare room, so only allocate as much
+	   as the new contents need. */
+	if (other_len + 1 > m_space)
+		realloc_to(other_len + 1);
 
+	memmove(m_ptr, other, other_len);
 	m_len = other_len;
-	m_ptr[m_space - 1] = 0;
+	m_ptr[m_len] = 0;
+}
+
+void str::append_raw(const char *ptr, int nbytes)
+{
+	const void *data = ptr;
+	char *out = append_room(data, nbytes);
+
+	memmove(out, data, nbytes);
+	m_len += nbytes;
+	m_ptr[m_len] = 0;
+}
+
+char *str::append_room(const void *&data, long nbytes)
+{
+	const char *ptr = (const char *) data;
+
+	if (nbytes > max_len - m_len)
+		throw csd::memory_exception("str: string too long");
+
+	if (m_len + nbytes + 1 > m_space) {
+		/* `data` may point into this string, which moves when it grows. */
+		if (ptr >= m_ptr && ptr < m_ptr + m_space) {
+			int offset = ptr - m_ptr;
+			grow(m_len + nbytes + 1);
+			data = m_ptr + offset;
+		} else {
+			grow(m_len + nbytes + 1);
+		}
+	}
+
+	return m_ptr + m_len;
+}
+
+void str::move_from(str& moved)
+{
+	if (!is_local())
+		delete[] m_ptr;
+
+	m_len = moved.m_len;
+
+	/* A short string lives inside the object, so it has to be copied
+	   over. Longer strings can just steal the buffer. */
+	if (moved.is_local()) {
+		memcpy(m_local, moved.m_local, moved.m_len + 1);
+		m_ptr = m_local;
+		m_space = sso_capacity + 1;
+	} else {
+		m_ptr = moved.m_ptr;
+		m_space = moved.m_space;
+	}
+
+	moved.m_ptr = moved.m_local;
+	moved.m_space = sso_capacity + 1;
+	moved.m_len = 0;
+	moved.m_local[0] = 0;
+}
+
+bool str::is_local() const
+{
+	return m_ptr == m_local;
 }
 
 int str::resolve_index(int index) const
@@ -339,25 +837,39 @@ int str::resolve_index(int index) const
 	return index;
 }
 
-int str::resize(int nbytes)
+void str::grow(int nbytes)
 {
-	/* Our implementation of resize() only resizes up. */
+	int new_space;
+
 	if (m_space >= nbytes)
-		return m_space;
+		return;
+
+	/* Grow by doubling, so appending in a loop only copies the contents
+	   O(log n) times in total. */
+	new_space = m_space > max_len / 2 ? max_len + 1 : m_space * 2;
+	if (new_space < nbytes)
+		new_space = nbytes;
 
-	char *old_ptr = m_ptr;
+	realloc_to(new_space);
+}
+
+void str::realloc_to(int nbytes)
+{
+	char *new_ptr;
 
 	try {
-		m_ptr = new char[nbytes + 1];
+		new_ptr = new char[nbytes];
 	} catch (std::bad_alloc& v) {
-		return m_space;
+		throw csd::memory_exception("str: failed to allocate buffer");
 	}
 
-	memmove(m_ptr, old_ptr, m_space);
-	m_space = nbytes;
+	memcpy(new_ptr, m_ptr, m_len + 1);
+
+	if (!is_local())
+		delete[] m_ptr;
 
-	delete[] old_ptr;
-	return m_space;
+	m_ptr = new_ptr;
+	m_space = nbytes;
 }
 
 str& str::operator=(const str& other)
@@ -366,6 +878,13 @@ str& str::operator=(const str& other)
 	return *this;
 }
 
+str& str::operator=(str&& other)
+{
+	if (this != &other)
+		move_from(other);
+	return *this;
+}
+
 str& str::operator=(const char *other)
 {
 	copy_from_raw(other, strlen(other));
@@ -396,9 +915,14 @@ str& str::operator+=(const char *next)
 	return *this;
 }
 
-bool str::operator==(const str& other) const
+bool str::operator==(csd::str_view other) const
+{
+	return view() == other;
+}
+
+int str::operator<=>(csd::str_view other) const
 {
-	return len() == other.len() && !strncmp(m_ptr, other.m_ptr, len());
+	return view().compare(other);
 }
 
 char& str::operator[](int index)
@@ -96,6 +96,23 @@ void stream::write_byte(bytes::byte b)
 	m_write(m_byte_buffer);
 }
 
+void stream::write_string(csd::str_view text)
+{
+	bytes buf;
+
+	if (!is_writable())
+		throw csd::stream_exception("stream is not writable");
+
+	if (!m_write.has_routine()) {
+		for (int i = 0; i < text.len; i++)
+			m_write_single(text.ptr[i]);
+		return;
+	}
+
+	buf.use_static_buffer((byte *) text.ptr, text.len);
+	m_write(buf);
+}
+
 void stream::set_read_single(read_single_function_t f)
 {
 	m_read_single = f;
@@ -35,7 +35,8 @@ thread::thread(thread&& moved_thread)
 
 thread::~thread()
 {
-	pthread_join(m_id, &m_ret);
+	if (m_busy)
+		pthread_join(m_id, &m_ret);
 }
 
 pthread_t thread::getid() const
@@ -92,3 +93,39 @@ void thread::operator()(fptr_t fptr)
 {
 	run(fptr, NULL);
 }
+
+mutex::mutex()
+{
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+mutex::~mutex()
+{
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void mutex::lock()
+{
+	pthread_mutex_lock(&m_mutex);
+}
+
+void mutex::unlock()
+{
+	pthread_mutex_unlock(&m_mutex);
+}
+
+bool mutex::try_lock()
+{
+	return !pthread_mutex_trylock(&m_mutex);
+}
+
+scoped_lock::scoped_lock(mutex& locked_mutex)
+	: m_mutex(locked_mutex)
+{
+	m_mutex.lock();
+}
+
+scoped_lock::~scoped_lock()
+{
+	m_mutex.unlock();
+}
@@ -0,0 +1,660 @@
+/* libcsd/src/utf8.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/str.h>
+#include <string.h>
+
+#if defined __x86_64__ || defined __i386__
+# include <immintrin.h>
+# define CSD_UTF8_X86 1
+#endif
+
+/* UTF-8 validation. On x86, the input is checked 16 or 32 bytes at a time
+   with the lookup algorithm by Keiser and Lemire: three table lookups on the
+   high and low nibbles of each byte and the high nibble of the one before it
+   find every invalid pair of bytes, and a saturating subtraction on the bytes
+   two and three positions back checks that the lead bytes of longer sequences
+   are followed by the right number of continuation bytes. Blocks of plain
+   ASCII skip all of that.
+
+   Decoding and transcoding use a plain decoder for multi-byte sequences, but
+   copy runs of ASCII 16 bytes at a time. */
+
+namespace csd {
+
+using validate_function = bool (*)(const unsigned char *, int);
+
+/* Decodes one code point, and returns the length of the sequence. For an
+   invalid sequence, returns minus the length of its longest valid prefix,
+   but at least one byte. */
+static int decode_one(const unsigned char *p, const unsigned char *end,
+					  char32_t *codepoint)
+{
+	unsigned char lead = p[0];
+	unsigned char low = 0x80;
+	unsigned char high = 0xbf;
+	char32_t value;
+	int need;
+
+	if (lead < 0x80) {
+		*codepoint = lead;
+		return 1;
+	}
+
+	if (lead >= 0xc2 && lead <= 0xdf) {
+		need = 1;
+		value = lead & 0x1f;
+	} else if (lead >= 0xe0 && lead <= 0xef) {
+		need = 2;
+		value = lead & 0x0f;
+		if (lead == 0xe0)
+			low = 0xa0;
+		else if (lead == 0xed)
+			high = 0x9f;
+	} else if (lead >= 0xf0 && lead <= 0xf4) {
+		need = 3;
+		value = lead & 0x07;
+		if (lead == 0xf0)
+			low = 0x90;
+		else if (lead == 0xf4)
+			high = 0x8f;
+	} else {
+		return -1;
+	}
+
+	for (int i = 1; i <= need; i++) {
+		if (i >= end - p || p[i] < low || p[i] > high)
+			return -i;
+		value = (value << 6) | (p[i] & 0x3f);
+		low = 0x80;
+		high = 0xbf;
+	}
+
+	*codepoint = value;
+	return need + 1;
+}
+
+static inline bool is_ascii8(const unsigned char *p)
+{
+	unsigned long long word;
+
+	memcpy(&word, p, 8);
+	return !(word & 0x8080808080808080ULL);
+}
+
+static bool validate_scalar(const unsigned char *p, int len)
+{
+	const unsigned char *end = p + len;
+	char32_t codepoint;
+	int width;
+
+	while (p < end) {
+		if (end - p >= 8 && is_ascii8(p)) {
+			p += 8;
+			continue;
+		}
+
+		if ((width = decode_one(p, end, &codepoint)) < 0)
+			return false;
+		p += width;
+	}
+
+	return true;
+}
+
+#ifdef CSD_UTF8_X86
+
+/* Each class of error sets one bit in all three tables, so the error is
+   only reported if all three lookups agree. Some bits are shared, as their
+   errors can be told apart by the tables they appear in. */
+# define TOO_SHORT      (1 << 0) /* lead byte not followed by continuation */
+# define TOO_LONG       (1 << 1) /* ASCII followed by continuation */
+# define OVERLONG_3     (1 << 2) /* E0 80..9F */
+# define TOO_LARGE      (1 << 3) /* F4 90..BF, F5..FF */
+# define SURROGATE      (1 << 4) /* ED A0..BF */
+# define OVERLONG_2     (1 << 5) /* C0..C1 */
+# define TOO_LARGE_1000 (1 << 6) /* F5..FF 80..8F */
+# define OVERLONG_4     (1 << 6) /* F0 80..8F */
+# define TWO_CONTS      (1 << 7) /* continuation after continuation */
+# define CARRY          (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+# define BYTE_1_HIGH                                                       \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,  \
+		TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,              \
+		TOO_SHORT | OVERLONG_2, TOO_SHORT,                                 \
+		TOO_SHORT | OVERLONG_3 | SURROGATE,                                \
+		(char) (TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4)
+
+# define BYTE_1_LOW                                                        \
+	(char) (CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4),                 \
+		(char) (CARRY | OVERLONG_2), (char) CARRY, (char) CARRY,           \
+		(char) (CARRY | TOO_LARGE),                                        \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE),           \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000),                       \
+		(char) (CARRY | TOO_LARGE | TOO_LARGE_1000)
+
+# define BYTE_2_HIGH                                                       \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,      \
+		TOO_SHORT, TOO_SHORT,                                              \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3             \
+				| TOO_LARGE_1000 | OVERLONG_4),                            \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3             \
+				| TOO_LARGE),                                              \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE              \
+				| TOO_LARGE),                                              \
+		(char) (TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE              \
+				| TOO_LARGE),                                              \
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+/* Bytes above these values in the last three positions of a block start a
+   sequence which does not fit into it. */
+# define INCOMPLETE_TAIL (char) 0xef, (char) 0xdf, (char) 0xbf
+
+__attribute__((target("ssse3"))) static inline __m128i
+check_block_ssse3(__m128i input, __m128i prev_input)
+{
+	const __m128i byte_1_high = _mm_setr_epi8(BYTE_1_HIGH);
+	const __m128i byte_1_low = _mm_setr_epi8(BYTE_1_LOW);
+	const __m128i byte_2_high = _mm_setr_epi8(BYTE_2_HIGH);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	__m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+	__m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+	__m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+	__m128i special;
+	__m128i must_continue;
+
+	special = _mm_and_si128(
+		_mm_and_si128(
+			_mm_shuffle_epi8(byte_1_high,
+							 _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+			_mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+		_mm_shuffle_epi8(byte_2_high,
+						 _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+	/* Only the third byte of a 3 or 4 byte sequence, and the fourth byte of
+	   a 4 byte one end up with the top bit set. */
+	must_continue = _mm_and_si128(
+		_mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+					 _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80))),
+		_mm_set1_epi8((char) 0x80));
+
+	return _mm_xor_si128(must_continue, special);
+}
+
+__attribute__((target("ssse3"))) static bool
+validate_ssse3(const unsigned char *p, int len)
+{
+	const __m128i incomplete_max =
+		_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+					  INCOMPLETE_TAIL);
+	__m128i prev_input = _mm_setzero_si128();
+	__m128i prev_incomplete = _mm_setzero_si128();
+	__m128i error = _mm_setzero_si128();
+	unsigned char tail[16];
+	__m128i input;
+
+	/* The last block is padded with zeros, which also catches a sequence
+	   cut short by the end of the input. */
+	for (int i = 0;; i += 16) {
+		bool last = len - i < 16;
+
+		if (!last) {
+			input = _mm_loadu_si128((const __m128i *) (p + i));
+		} else {
+			memset(tail, 0, 16);
+			memcpy(tail, p + i, len - i);
+			input = _mm_loadu_si128((const __m128i *) tail);
+		}
+
+		if (!_mm_movemask_epi8(input)) {
+			error = _mm_or_si128(error, prev_incomplete);
+		} else {
+			error = _mm_or_si128(error, check_block_ssse3(input, prev_input));
+			prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+		}
+
+		prev_input = input;
+		if (last)
+			break;
+	}
+
+	error = _mm_or_si128(error, prev_incomplete);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128()))
+		== 0xffff;
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+check_block_avx2(__m256i input, __m256i prev_input)
+{
+	const __m256i byte_1_high =
+		_mm256_setr_epi8(BYTE_1_HIGH, BYTE_1_HIGH);
+	const __m256i byte_1_low = _mm256_setr_epi8(BYTE_1_LOW, BYTE_1_LOW);
+	const __m256i byte_2_high =
+		_mm256_setr_epi8(BYTE_2_HIGH, BYTE_2_HIGH);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	__m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+	__m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+	__m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+	__m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+	__m256i special;
+	__m256i must_continue;
+
+	special = _mm256_and_si256(
+		_mm256_and_si256(
+			_mm256_shuffle_epi8(
+				byte_1_high,
+				_mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+			_mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+		_mm256_shuffle_epi8(
+			byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+	must_continue = _mm256_and_si256(
+		_mm256_or_si256(
+			_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+			_mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80))),
+		_mm256_set1_epi8((char) 0x80));
+
+	return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2"))) static bool
+validate_avx2(const unsigned char *p, int len)
+{
+	const __m256i incomplete_max = _mm256_setr_epi8(
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, INCOMPLETE_TAIL);
+	__m256i prev_input = _mm256_setzero_si256();
+	__m256i prev_incomplete = _mm256_setzero_si256();
+	__m256i error = _mm256_setzero_si256();
+	unsigned char tail[32];
+	__m256i input;
+
+	for (int i = 0;; i += 32) {
+		bool last = len - i < 32;
+
+		if (!last) {
+			input = _mm256_loadu_si256((const __m256i *) (p + i));
+		} else {
+			memset(tail, 0, 32);
+			memcpy(tail, p + i, len - i);
+			input = _mm256_loadu_si256((const __m256i *) tail);
+		}
+
+		if (!_mm256_movemask_epi8(input)) {
+			error = _mm256_or_si256(error, prev_incomplete);
+		} else {
+			error = _mm256_or_si256(error, check_block_avx2(input, prev_input));
+			prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+		}
+
+		prev_input = input;
+		if (last)
+			break;
+	}
+
+	error = _mm256_or_si256(error, prev_incomplete);
+	return _mm256_testz_si256(error, error);
+}
+
+static bool validate_resolve(const unsigned char *, int);
+static validate_function validate_impl = validate_resolve;
+
+/* Picks the best implementation for this CPU on the first call. */
+static bool validate_resolve(const unsigned char *p, int len)
+{
+	validate_function impl = validate_scalar;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		impl = validate_avx2;
+	else if (__builtin_cpu_supports("ssse3"))
+		impl = validate_ssse3;
+
+	__atomic_store_n(&validate_impl, impl, __ATOMIC_RELAXED);
+	return impl(p, len);
+}
+
+#endif
+
+bool is_valid_utf8(const char *ptr, int len)
+{
+#ifdef CSD_UTF8_X86
+	return __atomic_load_n(&validate_impl, __ATOMIC_RELAXED)(
+		(const unsigned char *) ptr, len);
+#else
+	return validate_scalar((const unsigned char *) ptr, len);
+#endif
+}
+
+/* Counts the bytes which are greater than `than` after flipping the bits
+   in `flip`, compared as signed. Flipping the top bit makes it an unsigned
+   comparison. */
+static int count_greater(const char *ptr, int len, char flip, signed char than)
+{
+	int count = 0;
+	int i = 0;
+
+#ifdef CSD_UTF8_X86
+	const __m128i flip_bits = _mm_set1_epi8(flip);
+	const __m128i limit = _mm_set1_epi8(than);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i block = _mm_xor_si128(
+			_mm_loadu_si128((const __m128i *) (ptr + i)), flip_bits);
+		count += __builtin_popcount(
+			_mm_movemask_epi8(_mm_cmpgt_epi8(block, limit)));
+	}
+#endif
+
+	for (; i < len; i++)
+		count += (signed char) (ptr[i] ^ flip) > than;
+
+	return count;
+}
+
+int count_codepoints(const char *ptr, int len)
+{
+	/* Continuation bytes are 0x80 to 0xbf, so -128 to -65 when signed. */
+	return count_greater(ptr, len, 0, -65);
+}
+
+int utf16_length(const char *ptr, int len)
+{
+	/* Each 4 byte sequence, starting with 0xf0 or above, becomes a
+	   surrogate pair. */
+	return count_codepoints(ptr, len)
+		+ count_greater(ptr, len, (char) 0x80, 0xef ^ 0x80);
+}
+
+long utf8_length(const char16_t *units, int len)
+{
+	long total = 0;
+
+	for (int i = 0; i < len; i++) {
+		char16_t unit = units[i];
+
+		if (unit < 0x80) {
+			total += 1;
+		} else if (unit < 0x800) {
+			total += 2;
+		} else if (unit < 0xd800 || unit > 0xdfff) {
+			total += 3;
+		} else if (unit <= 0xdbff && i + 1 < len && units[i + 1] >= 0xdc00
+				   && units[i + 1] <= 0xdfff) {
+			total += 4;
+			i++;
+		} else {
+			return -1;
+		}
+	}
+
+	return total;
+}
+
+long utf8_length(const char32_t *units, int len)
+{
+	long total = 0;
+
+	for (int i = 0; i < len; i++) {
+		char32_t unit = units[i];
+
+		if (unit < 0x80)
+			total += 1;
+		else if (unit < 0x800)
+			total += 2;
+		else if (unit >= 0xd800 && unit <= 0xdfff)
+			return -1;
+		else if (unit < 0x10000)
+			total += 3;
+		else if (unit <= 0x10ffff)
+			total += 4;
+		else
+			return -1;
+	}
+
+	return total;
+}
+
+int utf8_to_utf16(const char *ptr, int len, char16_t *out)
+{
+	const unsigned char *p = (const unsigned char *) ptr;
+	const unsigned char *end = p + len;
+	const unsigned char *block_end;
+	char16_t *start = out;
+	char32_t codepoint;
+	int width;
+
+	while (p < end) {
+#ifdef CSD_UTF8_X86
+		if (end - p >= 16) {
+			__m128i block = _mm_loadu_si128((const __m128i *) p);
+
+			if (!_mm_movemask_epi8(block)) {
+				__m128i zero = _mm_setzero_si128();
+				_mm_storeu_si128((__m128i *) out,
+								 _mm_unpacklo_epi8(block, zero));
+				_mm_storeu_si128((__m128i *) (out + 8),
+								 _mm_unpackhi_epi8(block, zero));
+				p += 16;
+				out += 16;
+				continue;
+			}
+		}
+#endif
+
+		/* Decode everything up to the next block boundary, as there was
+		   something other than ASCII in it. */
+		block_end = end - p > 16 ? p + 16 : end;
+		while (p < block_end) {
+			if ((width = decode_one(p, end, &codepoint)) < 0)
+				return -1;
+			p += width;
+
+			if (codepoint < 0x10000) {
+				*out++ = codepoint;
+			} else {
+				codepoint -= 0x10000;
+				*out++ = 0xd800 + (codepoint >> 10);
+				*out++ = 0xdc00 + (codepoint & 0x3ff);
+			}
+		}
+	}
+
+	return out - start;
+}
+
+int utf8_to_utf32(const char *ptr, int len, char32_t *out)
+{
+	const unsigned char *p = (const unsigned char *) ptr;
+	const unsigned char *end = p + len;
+	const unsigned char *block_end;
+	char32_t *start = out;
+	int width;
+
+	while (p < end) {
+#ifdef CSD_UTF8_X86
+		if (end - p >= 16) {
+			__m128i block = _mm_loadu_si128((const __m128i *) p);
+
+			if (!_mm_movemask_epi8(block)) {
+				__m128i zero = _mm_setzero_si128();
+				__m128i low = _mm_unpacklo_epi8(block, zero);
+				__m128i high = _mm_unpackhi_epi8(block, zero);
+
+				_mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi16(low, zero));
+				_mm_storeu_si128((__m128i *) (out + 4),
+								 _mm_unpackhi_epi16(low, zero));
+				_mm_storeu_si128((__m128i *) (out + 8),
+								 _mm_unpacklo_epi16(high, zero));
+				_mm_storeu_si128((__m128i *) (out + 12),
+								 _mm_unpackhi_epi16(high, zero));
+				p += 16;
+				out += 16;
+				continue;
+			}
+		}
+#endif
+
+		block_end = end - p > 16 ? p + 16 : end;
+		while (p < block_end) {
+			if ((width = decode_one(p, end, out)) < 0)
+				return -1;
+			p += width;
+			out++;
+		}
+	}
+
+	return out - start;
+}
+
+static char *encode_one(char *out, char32_t codepoint)
+{
+	if (codepoint < 0x80) {
+		*out++ = codepoint;
+	} else if (codepoint < 0x800) {
+		*out++ = 0xc0 | (codepoint >> 6);
+		*out++ = 0x80 | (codepoint & 0x3f);
+	} else if (codepoint < 0x10000) {
+		*out++ = 0xe0 | (codepoint >> 12);
+		*out++ = 0x80 | ((codepoint >> 6) & 0x3f);
+		*out++ = 0x80 | (codepoint & 0x3f);
+	} else {
+		*out++ = 0xf0 | (codepoint >> 18);
+		*out++ = 0x80 | ((codepoint >> 12) & 0x3f);
+		*out++ = 0x80 | ((codepoint >> 6) & 0x3f);
+		*out++ = 0x80 | (codepoint & 0x3f);
+	}
+
+	return out;
+}
+
+int utf16_to_utf8(const char16_t *units, int len, char *out)
+{
+	char *start = out;
+	int i = 0;
+
+	while (i < len) {
+#ifdef CSD_UTF8_X86
+		if (len - i >= 8) {
+			__m128i block = _mm_loadu_si128((const __m128i *) (units + i));
+			__m128i non_ascii =
+				_mm_and_si128(block, _mm_set1_epi16((short) 0xff80));
+
+			if (_mm_movemask_epi8(
+					_mm_cmpeq_epi16(non_ascii, _mm_setzero_si128()))
+				== 0xffff) {
+				_mm_storel_epi64((__m128i *) out,
+								 _mm_packus_epi16(block, block));
+				i += 8;
+				out += 8;
+				continue;
+			}
+		}
+#endif
+
+		char16_t unit = units[i++];
+
+		if (unit < 0xd800 || unit > 0xdfff) {
+			out = encode_one(out, unit);
+		} else if (unit <= 0xdbff && i < len && units[i] >= 0xdc00
+				   && units[i] <= 0xdfff) {
+			out = encode_one(out, 0x10000 + ((unit - 0xd800) << 10)
+									  + (units[i] - 0xdc00));
+			i++;
+		} else {
+			return -1;
+		}
+	}
+
+	return out - start;
+}
+
+int utf32_to_utf8(const char32_t *units, int len, char *out)
+{
+	char *start = out;
+	int i = 0;
+
+	while (i < len) {
+#ifdef CSD_UTF8_X86
+		if (len - i >= 8) {
+			__m128i low = _mm_loadu_si128((const __m128i *) (units + i));
+			__m128i high = _mm_loadu_si128((const __m128i *) (units + i + 4));
+			__m128i non_ascii = _mm_and_si128(_mm_or_si128(low, high),
+											  _mm_set1_epi32(~0x7f));
+
+			if (_mm_movemask_epi8(
+					_mm_cmpeq_epi32(non_ascii, _mm_setzero_si128()))
+				== 0xffff) {
+				__m128i packed = _mm_packs_epi32(low, high);
+				_mm_storel_epi64((__m128i *) out,
+								 _mm_packus_epi16(packed, packed));
+				i += 8;
+				out += 8;
+				continue;
+			}
+		}
+#endif
+
+		char32_t unit = units[i++];
+
+		if ((unit >= 0xd800 && unit <= 0xdfff) || unit > 0x10ffff)
+			return -1;
+		out = encode_one(out, unit);
+	}
+
+	return out - start;
+}
+
+codepoint_iterator::codepoint_iterator(const char *ptr, const char *end)
+	: m_ptr(ptr)
+	, m_end(end)
+	, m_codepoint(0)
+	, m_width(0)
+{
+	decode();
+}
+
+char32_t codepoint_iterator::operator*() const
+{
+	return m_codepoint;
+}
+
+codepoint_iterator& codepoint_iterator::operator++()
+{
+	m_ptr += m_width;
+	decode();
+	return *this;
+}
+
+void codepoint_iterator::decode()
+{
+	if (m_ptr >= m_end)
+		return;
+
+	m_width = decode_one((const unsigned char *) m_ptr,
+						 (const unsigned char *) m_end, &m_codepoint);
+	if (m_width < 0) {
+		m_width = -m_width;
+		m_codepoint = replacement;
+	}
+}
+
+codepoint_iterator codepoint_range::begin() const
+{
+	return codepoint_iterator(ptr, ptr + len);
+}
+
+codepoint_iterator codepoint_range::end() const
+{
+	return codepoint_iterator(ptr + len, ptr + len);
+}
+
+} // namespace csd
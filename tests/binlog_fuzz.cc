@@ -0,0 +1,83 @@
+/* libcsd/tests/binlog_fuzz.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/binlog.h>
+#include <libcsd/print.h>
+
+/* Decodes a valid binary log, and then many damaged copies of it. A damaged
+   log may decode to anything, or throw an invalid_argument_exception, but
+   it must never crash the decoder, which is best seen when built with
+   -fsanitize=address,undefined. */
+
+static constexpr int rounds = 20000;
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ull;
+
+static unsigned random_number()
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state >> 32;
+}
+
+static const char *expected = "request 0 to /index.html\n"
+							   "     0.000 0x0   c   {te}\n"
+							   "+0.000000e+00 then 00000000\n";
+
+static bytes sample_log()
+{
+	csd::binary_log log;
+	auto plain = log.add_format<int, csd::str_view>("request {} to {}");
+	auto specs = log.add_format<double, unsigned, char, const char *>(
+		"{:>10.3f} {:#x} {:^5} {{{:.2s}}}");
+	auto swapped = log.add_format<long, float>("{1:+e} then {0:08d}");
+
+	for (int i = 0; i < 20; i++) {
+		log.write(plain, i, "/index.html");
+		log.write(specs, i * 1.5, (unsigned) i * 255, 'c', "text");
+		log.write(swapped, -i, i / 4.0f);
+	}
+
+	return log.to_bytes();
+}
+
+int main()
+{
+	bytes valid = sample_log();
+	bytes damaged;
+	str first;
+	int rejected = 0;
+	int size;
+	int pos;
+
+	first = csd::decode_binary_log(valid);
+	if (first.view().find(expected) != 0) {
+		println_to(2, "binlog_fuzz: unexpected output:", first);
+		return 1;
+	}
+
+	for (int round = 0; round < rounds; round++) {
+		size = valid.size();
+		if (round % 4 == 0)
+			size -= random_number() % size;
+
+		damaged.alloc(size);
+		damaged.copy_from(valid.raw_ptr(), size);
+
+		/* Leave the magic alone, or nothing past it is read. */
+		for (int i = random_number() % 8; i >= 0 && size > 8; i--) {
+			pos = 8 + random_number() % (size - 8);
+			((unsigned char *) damaged.raw_ptr())[pos] = random_number();
+		}
+
+		try {
+			csd::decode_binary_log(damaged);
+		} catch (const csd::invalid_argument_exception&) {
+			rejected++;
+		}
+	}
+
+	println("binlog_fuzz: ok,", rejected, "of", rounds,
+			"damaged logs rejected");
+	return 0;
+}
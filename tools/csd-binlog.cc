@@ -0,0 +1,27 @@
+/* libcsd/tools/csd-binlog.cc
+   Copyright (c) 2024 bellrise */
+
+#include <libcsd/binlog.h>
+#include <libcsd/print.h>
+
+/* Prints a log written by csd::binary_log as text. */
+
+int main(int argc, char **argv)
+{
+	csd::file in;
+
+	if (argc != 2) {
+		print_to(2, "usage: csd-binlog <file>\n");
+		return 1;
+	}
+
+	try {
+		in.open(argv[1], "rb");
+		print(csd::decode_binary_log(in.read(in.size())));
+	} catch (const csd::any_exception& e) {
+		println_to(2, "csd-binlog:", e.message());
+		return 1;
+	}
+
+	return 0;
+}